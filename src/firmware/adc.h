@@ -13,7 +13,8 @@
 void adc_init();
 void adc_process();
 
-uint8_t adc_get_throttle();
+// 10 bit resolution, oversampled
+uint16_t adc_get_throttle();
 uint16_t adc_get_torque();
 
 uint16_t adc_get_temperature_contr();
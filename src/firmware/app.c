@@ -17,6 +17,7 @@
 #include "eventlog.h"
 #include "util.h"
 #include "system.h"
+#include "battery.h"
 
 
 typedef struct
@@ -56,6 +57,9 @@ static uint16_t speed_limit_ramp_interval_rpm_x10;
 static bool cruise_paused;
 static int8_t temperature_contr_c;
 static int8_t temperature_motor_c;
+static int8_t temperature_predicted_c;
+static int32_t thermal_rise_x10000;
+static uint32_t next_thermal_model_ms;
 
 static uint16_t ramp_up_current_interval_ms;
 static uint32_t power_blocked_until_ms;
@@ -74,6 +78,7 @@ void apply_cruise(uint8_t* target_current, uint8_t throttle_percent);
 bool apply_throttle(uint8_t* target_current, uint8_t throttle_percent);
 bool apply_speed_limit(uint8_t* target_current, uint8_t throttle_percent, bool pas_engaged, bool throttle_override);
 bool apply_thermal_limit(uint8_t* target_current);
+void process_thermal_model();
 bool apply_low_voltage_limit(uint8_t* target_current);
 bool apply_shift_sensor_interrupt(uint8_t* target_current);
 bool apply_brake(uint8_t* target_current);
@@ -111,6 +116,9 @@ void app_init()
 	global_throttle_speed_limit_rpm_x10 = 0;
 	temperature_contr_c = 0;
 	temperature_motor_c = 0;
+	temperature_predicted_c = 0;
+	thermal_rise_x10000 = 0;
+	next_thermal_model_ms = 0;
 
 	ramp_up_current_interval_ms = (g_config.max_current_amps * 10u) / g_config.current_ramp_amps_s;
 	power_blocked_until_ms = 0;
@@ -189,6 +197,10 @@ void app_process()
 
 	motor_set_target_speed(target_cadence);
 	motor_set_target_current(target_current);
+	motor_set_limiting_active(thermal_limiting || lvc_limiting);
+
+	eventlog_trace(TRACE_CADENCE_RPM_X10, pas_get_cadence_rpm_x10());
+	eventlog_trace(TRACE_WHEEL_SPEED_RPM_X10, speed_sensor_get_rpm_x10());
 
 	if (target_current > 0)
 	{
@@ -311,6 +323,11 @@ uint8_t app_get_status_code()
 		return STATUS_ERROR_CURRENT_SENSE;
 	}
 
+	if (motor & MOTOR_ERROR_HVC)
+	{
+		return STATUS_ERROR_HIGH_VOLTAGE;
+	}
+
 	if (motor & MOTOR_ERROR_POWER_RESET)
 	{
 		// Phase line error code reused, cause and meaning
@@ -365,6 +382,16 @@ uint8_t app_get_temperature()
 	return (uint8_t)temp_max;
 }
 
+uint8_t app_get_predicted_temperature()
+{
+	if (temperature_predicted_c < 0)
+	{
+		return 0;
+	}
+
+	return (uint8_t)temperature_predicted_c;
+}
+
 void apply_pretension(uint8_t* target_current)
 {
 	uint16_t current_speed_rpm_x10 = speed_sensor_get_rpm_x10();
@@ -426,7 +453,13 @@ void apply_pas_torque(uint8_t* target_current)
 	{
 		if (pas_is_pedaling_forwards() && (pas_get_pulse_counter() > g_config.pas_start_delay_pulses || speed_sensor_is_moving()))
 		{
+#if (TORQUE_AVERAGING == TORQUE_AVERAGING_REVOLUTION)
+			uint16_t torque_nm_x100 = torque_sensor_get_revolution_nm_x100();
+#elif (TORQUE_AVERAGING == TORQUE_AVERAGING_HALF_REVOLUTION)
+			uint16_t torque_nm_x100 = torque_sensor_get_half_revolution_nm_x100();
+#else
 			uint16_t torque_nm_x100 = torque_sensor_get_nm_x100();
+#endif
 			uint16_t cadence_rpm_x10 = pas_get_cadence_rpm_x10();
 			if (cadence_rpm_x10 < TORQUE_POWER_LOWER_RPM_X10)
 			{
@@ -587,7 +620,14 @@ bool apply_speed_limit(uint8_t* target_current, uint8_t throttle_percent, bool p
 
 	if (max_speed_rpm_x10 > 0)
 	{
-		int16_t current_speed_rpm_x10 = speed_sensor_get_rpm_x10();
+		int32_t current_speed_rpm_x10 = speed_sensor_get_rpm_x10();
+
+		int16_t acceleration_rpm_x10_per_s = speed_sensor_get_acceleration_rpm_x10_per_s();
+		if (acceleration_rpm_x10_per_s > 0)
+		{
+			// use predicted speed to start ramp down earlier when accelerating
+			current_speed_rpm_x10 += (int32_t)acceleration_rpm_x10_per_s * SPEED_LIMIT_LOOKAHEAD_MS / 1000;
+		}
 
 		if (current_speed_rpm_x10 < max_speed_ramp_low_rpm_x10)
 		{
@@ -645,37 +685,85 @@ bool apply_thermal_limit(uint8_t* target_current)
 	int16_t max_temp_x100 = MAX(temp_contr_x100, temp_motor_x100);
 	int8_t max_temp = MAX(temperature_contr_c, temperature_motor_c);
 
+	// Model predicts rise above measured temperature, without temperature
+	// sensor (e.g. TSDZ2, or disabled in config) predicted temperature is n/a (0).
+	if ((HAS_CONTROLLER_TEMP_SENSOR || HAS_MOTOR_TEMP_SENSOR) && g_config.use_temperature_sensor)
+	{
+		process_thermal_model();
+	}
+	else
+	{
+		thermal_rise_x10000 = 0;
+	}
+
+	// Predicted temperature is never below measured since modeled rise is positive.
+	int16_t pred_temp_x100 = max_temp_x100 + (int16_t)(thermal_rise_x10000 / 100);
+	temperature_predicted_c = (int8_t)(pred_temp_x100 / 100);
+
 	if (eventlog_is_enabled() && g_config.use_temperature_sensor && system_ms() > next_log_temp_ms)
 	{
 		next_log_temp_ms = system_ms() + 10000;
 		eventlog_write_data(EVT_DATA_TEMPERATURE, (uint16_t)temperature_motor_c << 8 | temperature_contr_c);
+		eventlog_write_data(EVT_DATA_TEMPERATURE_PREDICTED, (uint16_t)temperature_predicted_c);
 		//eventlog_write_data(EVT_DATA_TEMPERATURE, (uint16_t)throttle_read() << 8 | temperature_contr_c);
 	}
 
+	bool ramp_down = false;
+	uint8_t max_current = 100;
+
 	if (max_temp >= (MAX_TEMPERATURE - MAX_TEMPERATURE_RAMP_DOWN_INTERVAL))
 	{
-		if (!temperature_limiting)
-		{
-			temperature_limiting = true;
-			eventlog_write_data(EVT_DATA_THERMAL_LIMITING, 1);
-		}
+		ramp_down = true;
 
 		if (max_temp_x100 > MAX_TEMPERATURE * 100)
 		{
 			max_temp_x100 = MAX_TEMPERATURE * 100;
 		}
 
-		uint8_t tmp = (uint8_t)MAP32(
+		max_current = (uint8_t)MAP32(
 			max_temp_x100,													// value
 			(MAX_TEMPERATURE - MAX_TEMPERATURE_RAMP_DOWN_INTERVAL) * 100,	// in_min
 			MAX_TEMPERATURE * 100,											// in_max
 			100,															// out_min
 			MAX_TEMPERATURE_LOW_CURRENT_PERCENT								// out_max
 		);
+	}
+
+	// Gentler and earlier ramp down on predicted winding temperature
+	if (temperature_predicted_c >= (MAX_TEMPERATURE - THERMAL_MODEL_RAMP_DOWN_INTERVAL))
+	{
+		ramp_down = true;
+
+		if (pred_temp_x100 > MAX_TEMPERATURE * 100)
+		{
+			pred_temp_x100 = MAX_TEMPERATURE * 100;
+		}
+
+		uint8_t tmp = (uint8_t)MAP32(
+			pred_temp_x100,													// value
+			(MAX_TEMPERATURE - THERMAL_MODEL_RAMP_DOWN_INTERVAL) * 100,		// in_min
+			MAX_TEMPERATURE * 100,											// in_max
+			100,															// out_min
+			MAX_TEMPERATURE_LOW_CURRENT_PERCENT								// out_max
+		);
+
+		if (tmp < max_current)
+		{
+			max_current = tmp;
+		}
+	}
+
+	if (ramp_down)
+	{
+		if (!temperature_limiting)
+		{
+			temperature_limiting = true;
+			eventlog_write_data(EVT_DATA_THERMAL_LIMITING, 1);
+		}
 
-		if (*target_current > tmp)
+		if (*target_current > max_current)
 		{
-			*target_current = tmp;
+			*target_current = max_current;
 			return true;
 		}
 	}
@@ -691,40 +779,67 @@ bool apply_thermal_limit(uint8_t* target_current)
 	return false;
 }
 
+void process_thermal_model()
+{
+	if (system_ms() < next_thermal_model_ms)
+	{
+		return;
+	}
+
+	next_thermal_model_ms = system_ms() + THERMAL_MODEL_INTERVAL_MS;
+
+	// Steady state rise, (A x10)^2 * gain gives degC x10000
+	int32_t current_x10 = motor_get_battery_current_x10();
+	int32_t target_rise_x10000 = current_x10 * current_x10 * THERMAL_MODEL_GAIN_X100;
+
+	int32_t diff_x10000 = target_rise_x10000 - thermal_rise_x10000;
+	if (diff_x10000 > 0)
+	{
+		thermal_rise_x10000 += diff_x10000 / (THERMAL_MODEL_HEAT_TAU_S * (1000 / THERMAL_MODEL_INTERVAL_MS));
+	}
+	else
+	{
+		thermal_rise_x10000 += diff_x10000 / (THERMAL_MODEL_COOL_TAU_S * (1000 / THERMAL_MODEL_INTERVAL_MS));
+	}
+}
+
 bool apply_low_voltage_limit(uint8_t* target_current)
 {
 	static uint32_t next_log_volt_ms = 10000;
 	static bool lvc_limiting = false;
 
-	static uint32_t next_voltage_reading_ms = 125;
-	static int32_t flt_min_bat_volt_x100 = 100 * 100;
-
-	if (system_ms() > next_voltage_reading_ms)
+	if (eventlog_is_enabled() && system_ms() > next_log_volt_ms)
 	{
-		next_voltage_reading_ms = system_ms() + 125;
-		int32_t voltage_reading_x100 = motor_get_battery_voltage_x10() * 10ul;
+		next_log_volt_ms = system_ms() + 10000;
+		eventlog_write_data(EVT_DATA_VOLTAGE, motor_get_battery_voltage_x10() * 10u);
+		eventlog_write_data(EVT_DATA_BATTERY_RESISTANCE, battery_get_resistance_mohm());
+	}
 
-		if (voltage_reading_x100 < flt_min_bat_volt_x100)
-		{
-			flt_min_bat_volt_x100 = EXPONENTIAL_FILTER(flt_min_bat_volt_x100, voltage_reading_x100, 8);
-		}
+	// Sag compensated voltage, avoids limiting power because of
+	// voltage drop under high load when battery is not empty.
+	uint16_t voltage_x100 = battery_get_ocv_voltage_x100();
+	if (voltage_x100 == 0)
+	{
+		// no reading available yet
+		return false;
+	}
 
-		if (eventlog_is_enabled() && system_ms() > next_log_volt_ms)
-		{
-			next_log_volt_ms = system_ms() + 10000;
-			eventlog_write_data(EVT_DATA_VOLTAGE, (uint16_t)voltage_reading_x100);
-		}
+	// With coulomb counted SOC the power is ramped down on SOC instead,
+	// voltage is then only used as protection below padded empty voltage.
+	uint16_t ramp_start_voltage_x100 = lvc_ramp_down_start_voltage_x100;
+	uint16_t ramp_end_voltage_x100 = lvc_ramp_down_end_voltage_x100;
+	if (battery_is_coulomb_counting())
+	{
+		ramp_start_voltage_x100 = lvc_ramp_down_end_voltage_x100;
+		ramp_end_voltage_x100 = lvc_voltage_x100;
 	}
 
-	uint16_t voltage_x100 = flt_min_bat_volt_x100;
+	bool ramp_down = false;
+	uint8_t max_current = 100;
 
-	if (voltage_x100 <= lvc_ramp_down_start_voltage_x100)
+	if (voltage_x100 <= ramp_start_voltage_x100)
 	{
-		if (!lvc_limiting)
-		{
-			eventlog_write_data(EVT_DATA_LVC_LIMITING, voltage_x100);
-			lvc_limiting = true;
-		}
+		ramp_down = true;
 
 		if (voltage_x100 < lvc_voltage_x100)
 		{
@@ -734,16 +849,47 @@ bool apply_low_voltage_limit(uint8_t* target_current)
 		// Ramp down power until LVC_LOW_CURRENT_PERCENT when approaching LVC
 		int8_t tmp = (int8_t)MAP32(
 			voltage_x100,						// value
-			lvc_ramp_down_end_voltage_x100,		// in_min
-			lvc_ramp_down_start_voltage_x100,	// in_max
+			ramp_end_voltage_x100,				// in_min
+			ramp_start_voltage_x100,			// in_max
 			LVC_LOW_CURRENT_PERCENT,			// out_min
 			100									// out_max
 		);
-		uint8_t tmp2 = (uint8_t)CLAMP(tmp, 0, 100);
+		max_current = (uint8_t)CLAMP(tmp, 0, 100);
+	}
+
+	if (battery_is_coulomb_counting())
+	{
+		uint8_t soc = battery_get_percent();
+		if (soc < LVC_RAMP_DOWN_OFFSET_PERCENT)
+		{
+			ramp_down = true;
+
+			uint8_t tmp = (uint8_t)MAP32(
+				soc,							// value
+				0,								// in_min
+				LVC_RAMP_DOWN_OFFSET_PERCENT,	// in_max
+				LVC_LOW_CURRENT_PERCENT,		// out_min
+				100								// out_max
+			);
+
+			if (tmp < max_current)
+			{
+				max_current = tmp;
+			}
+		}
+	}
+
+	if (ramp_down)
+	{
+		if (!lvc_limiting)
+		{
+			eventlog_write_data(EVT_DATA_LVC_LIMITING, voltage_x100);
+			lvc_limiting = true;
+		}
 
-		if (*target_current > tmp2)
+		if (*target_current > max_current)
 		{
-			*target_current = tmp2;
+			*target_current = max_current;
 			return true;
 		}
 	}
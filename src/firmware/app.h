@@ -36,7 +36,7 @@
 #define STATUS_ERROR_THROTTLE_HIGH			0x04
 #define STATUS_ERROR_THROTTLE				0x05
 #define STATUS_ERROR_LVC					0x06
-#define STATUS_ERROR_HIGH_VOLTAGE			0x07 // not implemented
+#define STATUS_ERROR_HIGH_VOLTAGE			0x07
 #define STATUS_ERROR_HALL_SENSOR			0x08
 #define STATUS_ERROR_PHASE_LINE				0x09
 #define STATUS_ERROR_CONTROLLER_OVER_TEMP	0x10
@@ -68,5 +68,6 @@ uint8_t app_get_assist_level();
 uint8_t app_get_lights();
 uint8_t app_get_status_code();
 uint8_t app_get_temperature();
+uint8_t app_get_predicted_temperature();
 
 #endif
@@ -17,9 +17,28 @@ static int16_t battery_empty_x100v;
 static int16_t battery_full_x100v;
 
 static uint8_t battery_percent;
+static uint8_t battery_voltage_percent;
 static uint32_t motor_disabled_at_ms;
 static bool first_reading_done;
 
+static int16_t resistance_mohm;
+static int32_t flt_ocv_x100v;
+static uint32_t next_resistance_sample_ms;
+static uint16_t stable_current_x10;
+static uint32_t stable_since_ms;
+static uint16_t ref_voltage_x10;
+static uint16_t ref_current_x10;
+static uint32_t ref_at_ms;
+static bool ref_valid;
+
+static uint32_t battery_capacity_mah;
+static uint16_t battery_nominal_x100v;
+static uint32_t battery_remaining_mah;
+static uint16_t consumed_mas;
+static uint32_t next_coulomb_sample_ms;
+static bool soc_anchored_at_rest;
+static uint8_t saved_soc_percent;
+
 /*
 No attempt is made to have accurate battery state of charge display.
 
@@ -44,11 +63,28 @@ For example, if the maximum battery voltage is 58.8V and the low cutoff voltage
 - The battery is considered at   0% SOC at 42.0V + 1.3V = 43.3V
 - LVC rampdown will start at 10% SOC, so: 43.3V + 0.1 * (57.5V - 43.3V) = 44.7V
 - Full LVC limiting will occur at 0% SOC, so: 43.3V
+
+If battery capacity is configured the SOC is instead computed by integrating
+measured battery current (coulomb counting). The voltage based SOC is then only
+used as starting point when no persisted SOC is available and for re-anchoring
+after the battery has been at rest for some time (e.g. charged while powered on).
+The SOC is persisted when there is no motor load so it survives power cycles.
+
+Voltage sag under load is compensated using an online estimate of the pack
+internal resistance (including wiring). A reference voltage is taken when the
+current has been low and stable, the resistance is then computed from the
+voltage drop when the current has been stable at a higher level shortly after:
+
+  R = (V_ref - V) / (I - I_ref)
+
+The estimated open circuit voltage (V + I * R) is used for voltage based SOC
+and for low voltage cutoff ramp down, so that power is not reduced because
+of sag while climbing.
 */
 
 static uint8_t compute_battery_percent()
 {
-	int16_t value_x100v = motor_get_battery_voltage_x10() * 10l;
+	int16_t value_x100v = (int16_t)flt_ocv_x100v;
 	int16_t percent = (int16_t)MAP32(value_x100v, battery_empty_x100v, battery_full_x100v, 0, 100);
 
 	return (uint8_t)CLAMP(percent, 0, 100);
@@ -94,13 +130,149 @@ static uint8_t map_percent_sw102(uint8_t percent)
 #endif
 
 
+static void process_resistance_estimation()
+{
+	if (system_ms() < next_resistance_sample_ms)
+	{
+		return;
+	}
+
+	next_resistance_sample_ms = system_ms() + BATTERY_RESISTANCE_SAMPLE_INTERVAL_MS;
+
+	uint16_t voltage_x10 = motor_get_battery_voltage_x10();
+	uint16_t current_x10 = motor_get_battery_current_x10();
+
+	// I * R in x100 V, (A x10) * (mOhm) / 100
+	int32_t sag_x100v = ((int32_t)current_x10 * resistance_mohm) / 100;
+	flt_ocv_x100v = EXPONENTIAL_FILTER(flt_ocv_x100v, (int32_t)voltage_x10 * 10 + sag_x100v, 8);
+
+	// Voltage and current are read at different times from motor controller,
+	// only use samples when current has been stable long enough for both to settle.
+	int16_t current_diff_x10 = (int16_t)current_x10 - stable_current_x10;
+	if (current_diff_x10 > BATTERY_RESISTANCE_STABLE_CURRENT_X10 ||
+		current_diff_x10 < -BATTERY_RESISTANCE_STABLE_CURRENT_X10)
+	{
+		stable_current_x10 = current_x10;
+		stable_since_ms = system_ms();
+		return;
+	}
+
+	if (system_ms() - stable_since_ms < BATTERY_RESISTANCE_SETTLE_MS)
+	{
+		return;
+	}
+
+	if (current_x10 <= BATTERY_RESISTANCE_LOW_CURRENT_X10)
+	{
+		ref_voltage_x10 = voltage_x10;
+		ref_current_x10 = current_x10;
+		ref_at_ms = system_ms();
+		ref_valid = true;
+	}
+	else if (ref_valid &&
+		system_ms() - ref_at_ms < BATTERY_RESISTANCE_REF_TIMEOUT_MS &&
+		current_x10 - ref_current_x10 >= BATTERY_RESISTANCE_MIN_DELTA_CURRENT_X10 &&
+		ref_voltage_x10 > voltage_x10)
+	{
+		// (V x10) / (A x10) gives Ohm, scale to mOhm
+		int32_t r = ((int32_t)(ref_voltage_x10 - voltage_x10) * 1000) / (current_x10 - ref_current_x10);
+
+		if (r >= BATTERY_RESISTANCE_MIN_MOHM && r <= BATTERY_RESISTANCE_MAX_MOHM)
+		{
+			resistance_mohm = EXPONENTIAL_FILTER(resistance_mohm, (int16_t)r, 4);
+		}
+
+		// at most one estimate per stable period
+		stable_since_ms = system_ms();
+	}
+}
+
+static void set_remaining_percent(uint8_t percent)
+{
+	battery_remaining_mah = (battery_capacity_mah * percent) / 100;
+	consumed_mas = 0;
+}
+
+static uint8_t compute_coulomb_percent()
+{
+	return (uint8_t)((battery_remaining_mah * 100) / battery_capacity_mah);
+}
+
+static void process_coulomb_counting()
+{
+	if (system_ms() < next_coulomb_sample_ms)
+	{
+		return;
+	}
+
+	// Fixed sample schedule, each sample accounts for exactly one interval.
+	// Rescheduling from now would lose the time main loop was late.
+	next_coulomb_sample_ms += BATTERY_COULOMB_SAMPLE_INTERVAL_MS;
+
+	// A x10 during sample interval gives consumed charge in mAs
+	consumed_mas += (uint16_t)(((uint32_t)motor_get_battery_current_x10() * BATTERY_COULOMB_SAMPLE_INTERVAL_MS) / 10);
+
+	while (consumed_mas >= 3600)
+	{
+		consumed_mas -= 3600;
+		if (battery_remaining_mah > 0)
+		{
+			--battery_remaining_mah;
+		}
+	}
+}
+
+static void process_soc_at_rest(uint32_t rest_ms)
+{
+	uint8_t coulomb_percent = compute_coulomb_percent();
+
+	if (!soc_anchored_at_rest && rest_ms > BATTERY_SOC_ANCHOR_REST_MS)
+	{
+		soc_anchored_at_rest = true;
+
+		int16_t diff = (int16_t)battery_voltage_percent - coulomb_percent;
+		if (diff > BATTERY_SOC_ANCHOR_DIFF_PERCENT || diff < -BATTERY_SOC_ANCHOR_DIFF_PERCENT)
+		{
+			set_remaining_percent(battery_voltage_percent);
+			coulomb_percent = battery_voltage_percent;
+		}
+	}
+
+	int16_t saved_diff = (int16_t)saved_soc_percent - coulomb_percent;
+	if (saved_diff >= BATTERY_SOC_SAVE_DIFF_PERCENT || saved_diff <= -BATTERY_SOC_SAVE_DIFF_PERCENT)
+	{
+		saved_soc_percent = coulomb_percent;
+		g_pstate.battery_soc_percent = coulomb_percent;
+		cfgstore_save_pstate();
+	}
+}
+
+
 void battery_init()
 {
 	// default to 70% until first reading is available
 	battery_percent = 70;
+	battery_voltage_percent = 70;
 	motor_disabled_at_ms = 0;
 	first_reading_done = false;
 
+	resistance_mohm = BATTERY_RESISTANCE_DEFAULT_MOHM;
+	flt_ocv_x100v = 0;
+	next_resistance_sample_ms = 0;
+	stable_current_x10 = 0;
+	stable_since_ms = 0;
+	ref_voltage_x10 = 0;
+	ref_current_x10 = 0;
+	ref_at_ms = 0;
+	ref_valid = false;
+
+	battery_capacity_mah = EXPAND_U16(g_config.battery_capacity_ah_x10_u16h, g_config.battery_capacity_ah_x10_u16l) * 100ul;
+	battery_remaining_mah = 0;
+	consumed_mas = 0;
+	next_coulomb_sample_ms = 0;
+	soc_anchored_at_rest = false;
+	saved_soc_percent = g_pstate.battery_soc_percent;
+
 	uint16_t battery_min_voltage_x100v = g_config.low_cut_off_v * 100u;
 	uint16_t battery_max_voltage_x100v =
 		EXPAND_U16(g_config.max_battery_x100v_u16h, g_config.max_battery_x100v_u16l);
@@ -111,6 +283,7 @@ void battery_init()
 
 	battery_full_x100v = battery_max_voltage_x100v - battery_full_pad_x100v;
 	battery_empty_x100v = battery_min_voltage_x100v + battery_empty_pad_x100v;
+	battery_nominal_x100v = (battery_full_x100v + battery_empty_x100v) / 2;
 }
 
 void battery_process()
@@ -119,14 +292,35 @@ void battery_process()
 	{
 		if (motor_get_battery_voltage_x10() > 0)
 		{
-			battery_percent = compute_battery_percent();
+			flt_ocv_x100v = motor_get_battery_voltage_x10() * 10l;
+			battery_voltage_percent = compute_battery_percent();
 			first_reading_done = true;
+			next_coulomb_sample_ms = system_ms() + BATTERY_COULOMB_SAMPLE_INTERVAL_MS;
+
+			if (battery_capacity_mah > 0)
+			{
+				// Use persisted SOC unless battery has obviously been
+				// charged (or used) since, then start from voltage.
+				int16_t diff = (int16_t)battery_voltage_percent - saved_soc_percent;
+				if (saved_soc_percent <= 100 &&
+					diff <= BATTERY_SOC_ANCHOR_DIFF_PERCENT && diff >= -BATTERY_SOC_ANCHOR_DIFF_PERCENT)
+				{
+					set_remaining_percent(saved_soc_percent);
+				}
+				else
+				{
+					set_remaining_percent(battery_voltage_percent);
+				}
+			}
 		}
 	}
 	else
 	{
 		uint8_t target_current = motor_get_target_current();
 
+		process_resistance_estimation();
+		battery_voltage_percent = compute_battery_percent();
+
 		if (motor_disabled_at_ms == 0 && target_current == 0)
 		{
 			motor_disabled_at_ms = system_ms();
@@ -134,13 +328,54 @@ void battery_process()
 		else if (target_current > 0)
 		{
 			motor_disabled_at_ms = 0;
+			soc_anchored_at_rest = false;
+		}
+
+		uint32_t rest_ms = system_ms() - motor_disabled_at_ms;
+		if (target_current == 0 && rest_ms > BATTERY_NO_LOAD_DELAY_MS && battery_capacity_mah > 0)
+		{
+			process_soc_at_rest(rest_ms);
 		}
 
-		if (target_current == 0 && (system_ms() - motor_disabled_at_ms) > BATTERY_NO_LOAD_DELAY_MS)
+		if (battery_capacity_mah > 0)
 		{
-			battery_percent = compute_battery_percent();
+			process_coulomb_counting();
 		}
 	}
+
+	if (battery_capacity_mah > 0 && first_reading_done)
+	{
+		battery_percent = compute_coulomb_percent();
+	}
+	else
+	{
+		battery_percent = battery_voltage_percent;
+	}
+}
+
+uint16_t battery_get_ocv_voltage_x100()
+{
+	return (uint16_t)flt_ocv_x100v;
+}
+
+uint16_t battery_get_resistance_mohm()
+{
+	return (uint16_t)resistance_mohm;
+}
+
+uint16_t battery_get_remaining_wh()
+{
+	if (battery_capacity_mah == 0 || !first_reading_done)
+	{
+		return 0;
+	}
+
+	return (uint16_t)((battery_remaining_mah * battery_nominal_x100v) / 100000ul);
+}
+
+bool battery_is_coulomb_counting()
+{
+	return battery_capacity_mah > 0;
 }
 
 uint8_t battery_get_percent()
@@ -9,7 +9,9 @@
 #ifndef _BATTERY_H_
 #define _BATTERY_H_
 
+#include "intellisense.h"
 #include <stdint.h>
+#include <stdbool.h>
 
 void battery_init();
 void battery_process();
@@ -17,4 +19,14 @@ void battery_process();
 uint8_t battery_get_percent();
 uint8_t battery_get_mapped_percent();
 
+// Battery voltage compensated for sag using estimated internal resistance.
+uint16_t battery_get_ocv_voltage_x100();
+uint16_t battery_get_resistance_mohm();
+
+// Remaining energy, only available when battery capacity is configured.
+uint16_t battery_get_remaining_wh();
+
+// True if battery capacity is configured and SOC is computed by coulomb counting.
+bool battery_is_coulomb_counting();
+
 #endif
@@ -11,10 +11,17 @@
 #include "bbsx/pins.h"
 
 
+// Throttle is sampled every other conversion, interleaved with the
+// temperature channels, and averaged over a number of samples.
+#define THROTTLE_OVERSAMPLING_SHIFT		3 // 8x
+
 static uint8_t next_channel;
+static uint8_t next_temperature_channel;
 static uint8_t no_adc_reading_counter;
 
-static uint8_t throttle_value;
+static uint16_t throttle_sum;
+static uint8_t throttle_samples;
+static uint16_t throttle_value;
 static uint16_t temperature_contr_value;
 static uint16_t temperature_motor_value;
 
@@ -44,16 +51,19 @@ void adc_init()
 	ADC_RES = 0;
 	ADC_RESL = 0;
 
-	// Arrange adc result for 8bit reading
+	// Arrange adc result with 8 high bits in ADC_RES and 2 low bits in ADC_RESL
 	CLEAR_BIT(PCON2, 5);
 
 	ADC_CONTR = (uint8_t)((1 << 7));
 
 	no_adc_reading_counter = 0;
+	throttle_sum = 0;
+	throttle_samples = 0;
 	throttle_value = 0;
 	temperature_contr_value = 0;
 	temperature_motor_value = 0;
 	next_channel = GET_PIN_NUM(PIN_THROTTLE);
+	next_temperature_channel = GET_PIN_NUM(PIN_TEMPERATURE_CONTR);
 
 
 	// throttle is read during init since a valid value must be
@@ -63,9 +73,13 @@ void adc_init()
 	// enable adc power and read throttle
 	ADC_CONTR = (uint8_t)((1 << 7) | (1 << 3) | next_channel);
 
-	// wait for throttle reading and process
-	while (!IS_BIT_SET(ADC_CONTR, 4));
-	adc_process();
+	// wait for enough throttle readings to get an averaged value,
+	// throttle is read every other conversion
+	for (uint8_t i = 0; i < (2 << THROTTLE_OVERSAMPLING_SHIFT); ++i)
+	{
+		while (!IS_BIT_SET(ADC_CONTR, 4));
+		adc_process();
+	}
 }
 
 void adc_process()
@@ -81,24 +95,30 @@ void adc_process()
 		{
 		case GET_PIN_NUM(PIN_THROTTLE):
 		{
-			throttle_value = ADC_RES;
-			next_channel = GET_PIN_NUM(PIN_TEMPERATURE_CONTR);
+			throttle_sum += (((uint16_t)ADC_RES) << 2) | ADC_RESL;
+			if (++throttle_samples == (1 << THROTTLE_OVERSAMPLING_SHIFT))
+			{
+				throttle_value = throttle_sum >> THROTTLE_OVERSAMPLING_SHIFT;
+				throttle_sum = 0;
+				throttle_samples = 0;
+			}
+			next_channel = next_temperature_channel;
 			break;
 		}
 		case GET_PIN_NUM(PIN_TEMPERATURE_CONTR):
 		{
 			temperature_contr_value = (((uint16_t)ADC_RES) << 2) | ADC_RESL;
 #ifdef BBSHD
-			next_channel = GET_PIN_NUM(PIN_TEMPERATURE_MOTOR);
-#else
-			next_channel = GET_PIN_NUM(PIN_THROTTLE);
+			next_temperature_channel = GET_PIN_NUM(PIN_TEMPERATURE_MOTOR);
 #endif
+			next_channel = GET_PIN_NUM(PIN_THROTTLE);
 			break;
 		}
 #ifdef BBSHD
 		case GET_PIN_NUM(PIN_TEMPERATURE_MOTOR):
 		{
 			temperature_motor_value = (((uint16_t)ADC_RES) << 2) | ADC_RESL;
+			next_temperature_channel = GET_PIN_NUM(PIN_TEMPERATURE_CONTR);
 			next_channel = GET_PIN_NUM(PIN_THROTTLE);
 			break;
 		}
@@ -111,10 +131,13 @@ void adc_process()
 		ADC_RES = 0;
 		ADC_CONTR = (uint8_t)(1 << 7);
 		no_adc_reading_counter = 0;
+		throttle_sum = 0;
+		throttle_samples = 0;
 		throttle_value = 0;
 		temperature_motor_value = 0;
 		temperature_contr_value = 0;
 		next_channel = GET_PIN_NUM(PIN_THROTTLE);
+		next_temperature_channel = GET_PIN_NUM(PIN_TEMPERATURE_CONTR);
 	}
 	else
 	{
@@ -127,7 +150,7 @@ void adc_process()
 }
 
 
-uint8_t adc_get_throttle()
+uint16_t adc_get_throttle()
 {
 	return throttle_value;
 }
@@ -10,6 +10,9 @@
 #include "sensors.h"
 #include "system.h"
 #include "eventlog.h"
+#include "cfgstore.h"
+#include "fwconfig.h"
+#include "util.h"
 #include "bbsx/uart_motor.h"
 #include "bbsx/pins.h"
 
@@ -33,6 +36,7 @@
 #define OPCODE_READ_CURRENT		0x41
 #define OPCODE_READ_VOLTAGE		0x42
 
+// response timeout while connecting and configuring motor controller
 #define READ_TIMEOUT			100
 
 #if defined(BBSHD)
@@ -45,20 +49,144 @@
 
 #define SPEED_STEPS					250
 
-// async om state machine
+// async com state machine
 #define COM_STATE_IDLE				0x01
 #define COM_STATE_WAIT_RESPONSE		0x02
-#define COM_STATE_SET_CURRENT		0x03
-#define COM_STATE_SET_SPEED			0x04
-#define COM_STATE_READ_STATUS		0x05
-#define COM_STATE_READ_CURRENT		0x06
-#define COM_STATE_READ_VOLTAGE		0x07
+
+// link to motor controller, connect and configure is done
+// in background by async com state machine
+#define LINK_STATE_CONNECT			0x01
+#define LINK_STATE_CONFIGURE		0x02
+#define LINK_STATE_READY			0x03
+#define LINK_STATE_PROBE			0x04
+
+#define BAUD_RATE_DEFAULT			4800
+
+// Give other MCU time to power on before first connect attempt
+#define CONNECT_POWER_ON_DELAY_MS		100
+#define CONNECT_RETRY_INTERVAL_MS		1000
+#define CONNECT_ATTEMPTS_BEFORE_ERROR	10
+
+#if HAS_MOTOR_BAUD_RATE_PROBE
+// Baud rates to probe, fastest first. A rate is accepted when
+// PROBE_HELLO_RESPONSES consecutive hello requests are answered.
+// Stored rate is abandoned after CONNECT_ATTEMPTS_BEFORE_FALLBACK failed connects.
+#define PROBE_HELLO_RESPONSES			5
+#define CONNECT_ATTEMPTS_BEFORE_FALLBACK	3
+#endif
+
+// Reconnect if this many requests in a row fails when link is ready
+#define COM_MAX_CONSECUTIVE_ERRORS		10
+
+// Minimum time from response (or timeout) until next request is sent,
+// same delay as original firmware uses between configuration requests.
+#define COM_REQUEST_GAP_MS				4
+
+// Response timeout is measured round trip time plus margin, within limits.
+// Minimum is the fixed timeout used before, a 5 byte request and response
+// takes ~21ms on the wire at 4800 baud leaving margin for motor mcu delay.
+#define COM_RESPONSE_TIMEOUT_MIN_MS		32
+#define COM_RESPONSE_TIMEOUT_MAX_MS		64
+#define COM_RESPONSE_TIMEOUT_MARGIN_MS	8
+#define COM_ROUND_TRIP_INITIAL_MS		24
+
+// Periodic reads, served round robin when no target current/speed change is pending.
+// A read overdue by more than COM_READ_MAX_DELAY_MS is served before pending changes,
+// at most one such read is sent between target current requests.
+#define COM_READ_STATUS					0
+#define COM_READ_CURRENT				1
+#define COM_READ_VOLTAGE				2
+#define COM_READS						3
+
+// Read periods depends on riding state:
+// * Idle (no motor power), voltage is read often since no-load voltage is used for battery SOC.
+// * Active, current is read often.
+// * Limiting (e.g. LVC, thermal), current and voltage read often since it drives the limiting.
+#define COM_READ_STATUS_PERIOD_MS				600
+#define COM_READ_CURRENT_PERIOD_MS				200
+#define COM_READ_VOLTAGE_PERIOD_MS				600
+
+#define COM_READ_STATUS_IDLE_PERIOD_MS			1000
+#define COM_READ_CURRENT_IDLE_PERIOD_MS			1000
+#define COM_READ_VOLTAGE_IDLE_PERIOD_MS			250
+
+#define COM_READ_CURRENT_LIMITING_PERIOD_MS		100
+#define COM_READ_VOLTAGE_LIMITING_PERIOD_MS		200
+
+#define COM_READ_MAX_DELAY_MS			1000
+
+// Interval for reporting communication statistics to eventlog
+#define COM_STATS_REPORT_INTERVAL_MS	10000
+
+// Target current changes acknowledged later than this are counted as slow
+#define COM_LATENCY_TARGET_MS			40
 
 #define MSGBUF_SIZE					8
+#define RXBUF_SIZE					16
+
+typedef struct
+{
+	uint8_t opcode;
+	uint8_t data;
+} configure_request_t;
+
+// This initialization is done exactly as in orginal firmware for BBSHD/BBS02.
+// The meaning of most parameters is unknown.
+// Followed by LVC and max current requests which depends on configuration.
+static const configure_request_t configure_requests[] =
+{
+#if defined (BBSHD)
+	{ OPCODE_UNKNOWN1, 0x5a },
+#elif defined (BBS02)
+	{ OPCODE_UNKNOWN1, 0x5f },
+#endif
+	{ OPCODE_UNKNOWN2, 0x11 },
+	{ OPCODE_UNKNOWN3, 0x78 },
+	{ OPCODE_UNKNOWN4, 0x64 },
+	{ OPCODE_UNKNOWN5, 0x50 },
+	{ OPCODE_UNKNOWN6, 0x46 },
+	{ OPCODE_UNKNOWN7, 0x0c }
+};
+
+#define CONFIGURE_REQUESTS			(sizeof(configure_requests) / sizeof(configure_request_t))
+#define CONFIGURE_STEP_LVC			(CONFIGURE_REQUESTS)
+#define CONFIGURE_STEP_MAX_CURRENT	(CONFIGURE_REQUESTS + 1)
+#define CONFIGURE_STEPS				(CONFIGURE_REQUESTS + 2)
+
+#if HAS_MOTOR_BAUD_RATE_PROBE
+static const uint16_t probe_baud_rates[] = { 38400, 19200, 9600 };
+
+#define PROBE_BAUD_RATES			(sizeof(probe_baud_rates) / sizeof(uint16_t))
+#endif
 
-static uint8_t is_connected;
 static uint8_t msgbuf[MSGBUF_SIZE];
 
+// Received bytes not yet consumed by parser. Bytes following
+// a parsed response are kept, stray bytes before are skipped.
+static uint8_t rxbuf[RXBUF_SIZE];
+static uint8_t rxbuf_len;
+
+// First byte of responses, value is not documented so it is
+// learned from hello response when connecting.
+static uint8_t response_header;
+static bool response_header_known;
+
+static uint16_t com_errors[MOTOR_COM_ERROR_COUNTERS];
+
+static uint16_t baud_rate;
+#if HAS_MOTOR_BAUD_RATE_PROBE
+static uint8_t probe_index;
+static uint8_t probe_responses;
+#endif
+
+static uint8_t link_state;
+static uint8_t configure_step;
+static uint8_t connect_attempts;
+static uint32_t next_connect_ms;
+static uint8_t consecutive_errors;
+static uint16_t configured_max_current_mA;
+static uint8_t configured_lvc_V;
+
 static bool target_speed_changed;
 static uint8_t target_speed;
 
@@ -77,18 +205,37 @@ static uint16_t battery_amp_x10;
 static uint8_t com_state;
 static uint8_t last_sent_opcode;
 static uint32_t last_request_write_ms;
-static uint32_t last_status_read_ms;
-static uint8_t next_status_read_opcode;
+static uint32_t last_response_ms;
+static uint16_t response_timeout_ms;
+static uint16_t round_trip_ms;
+
+static const uint8_t read_opcodes[COM_READS] = { OPCODE_READ_STATUS, OPCODE_READ_CURRENT, OPCODE_READ_VOLTAGE };
+static uint16_t read_period_ms[COM_READS];
+static uint32_t last_read_ms[COM_READS];
+static uint8_t next_read;
+static bool overdue_read_sent;
+
+static bool motor_power_enabled;
+static bool limiting_active;
+
+// target current latency, from change requested until acknowledged by motor controller
+static uint32_t target_current_changed_ms;
+static uint32_t target_current_sent_changed_ms;
+static uint16_t target_current_latency_max_ms;
+static uint32_t last_stats_report_ms;
+
+// request statistics since last report
+static uint16_t stats_requests_ok;
+static uint16_t stats_requests_failed;
+static uint16_t stats_target_current_slow;
 
 
 static uint8_t compute_checksum(uint8_t* msg, uint8_t len);
-static void send_request(uint8_t opcode, uint16_t data);
+static uint8_t get_response_length(uint8_t opcode);
 static void send_request_async(uint8_t opcode, uint16_t data);
 
-static int read_response(uint8_t opcode, uint16_t* out_data);
-static int try_read_response(uint8_t opcode, uint16_t* out_data);
-static int connect();
-static int configure(uint16_t max_current_mA, uint8_t lvc_V);
+static bool try_parse_response(uint8_t opcode, uint16_t* out_data);
+static void begin_connect(uint32_t delay_ms);
 
 static void process_com_state_machine();
 
@@ -108,7 +255,8 @@ void motor_init(uint16_t max_current_mA, uint8_t lvc_V, int16_t adc_calib_volt_s
 {
 	motor_pre_init();
 
-	is_connected = 0;
+	configured_max_current_mA = max_current_mA;
+	configured_lvc_V = lvc_V;
 	target_speed_changed = false;
 	target_speed = 0;
 	target_current_changed = false;
@@ -123,44 +271,66 @@ void motor_init(uint16_t max_current_mA, uint8_t lvc_V, int16_t adc_calib_volt_s
 	com_state = COM_STATE_IDLE;
 	last_sent_opcode = 0;
 	last_request_write_ms = 0;
-	last_status_read_ms = 0;
-	next_status_read_opcode = OPCODE_READ_STATUS;
-
-	uart_motor_open(4800);
-
-	// Give other MCU time to power on
-	while (system_ms() < 100);
-
-	if (connect() && configure(max_current_mA, lvc_V))
+	last_response_ms = 0;
+	round_trip_ms = COM_ROUND_TRIP_INITIAL_MS;
+	response_timeout_ms = COM_ROUND_TRIP_INITIAL_MS + COM_RESPONSE_TIMEOUT_MARGIN_MS;
+
+	read_period_ms[COM_READ_STATUS] = COM_READ_STATUS_PERIOD_MS;
+	read_period_ms[COM_READ_CURRENT] = COM_READ_CURRENT_PERIOD_MS;
+	read_period_ms[COM_READ_VOLTAGE] = COM_READ_VOLTAGE_PERIOD_MS;
+	for (uint8_t i = 0; i < COM_READS; ++i)
+	{
+		last_read_ms[i] = 0;
+	}
+	next_read = COM_READ_STATUS;
+	overdue_read_sent = false;
+	motor_power_enabled = false;
+	limiting_active = false;
+
+	target_current_changed_ms = 0;
+	target_current_sent_changed_ms = 0;
+	target_current_latency_max_ms = 0;
+	last_stats_report_ms = 0;
+	stats_requests_ok = 0;
+	stats_requests_failed = 0;
+	stats_target_current_slow = 0;
+
+	rxbuf_len = 0;
+	response_header = 0;
+	for (uint8_t i = 0; i < MOTOR_COM_ERROR_COUNTERS; ++i)
 	{
-		is_connected = 1;
+		com_errors[i] = 0;
+	}
 
-		eventlog_write(EVT_MSG_MOTOR_INIT_OK);
+	baud_rate = BAUD_RATE_DEFAULT;
+#if HAS_MOTOR_BAUD_RATE_PROBE
+	probe_index = 0;
+	probe_responses = 0;
 
-		motor_set_target_speed(0);
-		motor_set_target_current(0);
-		target_current_changed = true;
-		target_speed_changed = true;
-	}
-	else
+	uint16_t stored_baud_rate = EXPAND_U16(g_pstate.motor_baud_rate_u16h, g_pstate.motor_baud_rate_u16l);
+	if (stored_baud_rate != 0)
 	{
-		eventlog_write(EVT_ERROR_INIT_MOTOR);
+		baud_rate = stored_baud_rate;
 	}
+#endif
+
+	uart_motor_open(baud_rate);
+
+	// Connect and configure is done by com state machine,
+	// first attempt when motor controller has had time to power on.
+	begin_connect(0);
+	next_connect_ms = CONNECT_POWER_ON_DELAY_MS;
 }
 
 void motor_process()
 {
-	if (!is_connected)
-	{
-		return;
-	}
-
 	process_com_state_machine();
 }
 
 void motor_enable()
 {
 	SET_PIN_HIGH(PIN_MOTOR_POWER_ENABLE);
+	motor_power_enabled = true;
 }
 
 void motor_disable()
@@ -174,9 +344,15 @@ void motor_disable()
 		// when brake eventually released.
 
 		SET_PIN_LOW(PIN_MOTOR_POWER_ENABLE);
+		motor_power_enabled = false;
 	}	
 }
 
+void motor_set_limiting_active(bool active)
+{
+	limiting_active = active;
+}
+
 uint16_t motor_status()
 {
 	return status_flags;
@@ -216,6 +392,11 @@ void motor_set_target_current(uint8_t percent)
 
 	if (target_current != percent)
 	{
+		if (!target_current_changed)
+		{
+			target_current_changed_ms = system_ms();
+		}
+
 		target_current = percent;
 		target_current_changed = true;
 	}
@@ -259,6 +440,16 @@ uint16_t motor_get_battery_voltage_x10()
 	return battery_volt_x10;
 }
 
+uint16_t motor_get_com_errors(uint8_t counter)
+{
+	if (counter < MOTOR_COM_ERROR_COUNTERS)
+	{
+		return com_errors[counter];
+	}
+
+	return 0;
+}
+
 static uint8_t compute_checksum(uint8_t* msg, uint8_t len)
 {
 	uint8_t checksum = 0;
@@ -270,14 +461,9 @@ static uint8_t compute_checksum(uint8_t* msg, uint8_t len)
 	return checksum;
 }
 
-static void send_request(uint8_t opcode, uint16_t data)
+static uint8_t get_response_length(uint8_t opcode)
 {
-	// empty rx buffer
-	while (uart_motor_available()) uart_motor_read();
-
-	send_request_async(opcode, data);
-
-	uart_motor_flush();
+	return (opcode == OPCODE_LVC || opcode == OPCODE_READ_STATUS || opcode == OPCODE_READ_VOLTAGE) ? 5 : 4;
 }
 
 static void send_request_async(uint8_t opcode, uint16_t data)
@@ -306,399 +492,583 @@ static void send_request_async(uint8_t opcode, uint16_t data)
 	}
 }
 
-static int read_response(uint8_t opcode, uint16_t* out_data)
+static void consume_rxbuf(uint8_t count)
 {
-	uint32_t end = system_ms() + READ_TIMEOUT;
-
-	uint8_t len = (opcode == OPCODE_LVC || opcode == OPCODE_READ_STATUS || opcode == OPCODE_READ_VOLTAGE) ? 5 : 4;
-
-	uint8_t i = 0;
-	while (i < len && system_ms() < end)
-	{
-		if (uart_motor_available())
-		{
-			msgbuf[i++] = uart_motor_read();
-		}
-	}
-
-	if (i == len && msgbuf[1] == opcode)
+	for (uint8_t i = count; i < rxbuf_len; ++i)
 	{
-		uint8_t checksum = compute_checksum(&msgbuf[1], (uint8_t)(i - 2));
-		if (checksum == msgbuf[i - 1])
-		{
-			if (out_data != 0)
-			{
-				if (opcode == OPCODE_LVC || opcode == OPCODE_READ_STATUS || opcode == OPCODE_READ_VOLTAGE)
-				{
-					*out_data = msgbuf[2] << 8 | msgbuf[3];
-				}
-				else
-				{
-					*out_data = msgbuf[2];
-				}
-			}
-
-			return 1;
-		}
-
-		return 0; // failed to verify message
+		rxbuf[i - count] = rxbuf[i];
 	}
 
-	// read failure
-	return 0;
+	rxbuf_len -= count;
 }
 
-static int try_read_response(uint8_t opcode, uint16_t* out_data)
+static void increment_com_errors(uint8_t counter, uint8_t count)
 {
-	uint8_t len = (opcode == OPCODE_LVC || opcode == OPCODE_READ_STATUS || opcode == OPCODE_READ_VOLTAGE) ? 5 : 4;
-
-	uint8_t i = 0;
-	while (uart_motor_available() && i < MSGBUF_SIZE)
+	// saturate instead of wrapping around
+	if (com_errors[counter] <= (uint16_t)(0xffff - count))
 	{
-		msgbuf[i++] = uart_motor_read();
+		com_errors[counter] += count;
 	}
+	else
+	{
+		com_errors[counter] = 0xffff;
+	}
+}
 
-	// clear anything that could be left in rxbuffer in case of error.
-	while (uart_motor_available()) uart_motor_read();
+static bool try_parse_response(uint8_t opcode, uint16_t* out_data)
+{
+	uint8_t len = get_response_length(opcode);
 
-	if (i < len)
+	while (uart_motor_available() && rxbuf_len < RXBUF_SIZE)
 	{
-		// failed to read entire response
-		return 0;
+		rxbuf[rxbuf_len++] = uart_motor_read();
 	}
 
-	if (i == len && msgbuf[1] == opcode)
+	// Scan for response frame identified by header, opcode and checksum.
+	// Header is accepted as is until learned from hello response.
+	for (uint8_t i = 0; i + len <= rxbuf_len; ++i)
 	{
-		uint8_t checksum = compute_checksum(&msgbuf[1], (uint8_t)(i - 2));
-		if (checksum == msgbuf[i - 1])
+		uint8_t* frame = rxbuf + i;
+		if ((!response_header_known || frame[0] == response_header) &&
+			frame[1] == opcode && compute_checksum(frame + 1, (uint8_t)(len - 2)) == frame[len - 1])
 		{
+			if (!response_header_known && opcode == OPCODE_HELLO)
+			{
+				response_header = frame[0];
+				response_header_known = true;
+			}
+
 			if (out_data != 0)
 			{
-				if (opcode == OPCODE_LVC || opcode == OPCODE_READ_STATUS || opcode == OPCODE_READ_VOLTAGE)
+				if (len == 5)
 				{
-					*out_data = ((uint16_t)msgbuf[2] << 8) | msgbuf[3];
+					*out_data = ((uint16_t)frame[2] << 8) | frame[3];
 				}
 				else
 				{
-					*out_data = msgbuf[2];
+					*out_data = frame[2];
 				}
 			}
 
-			return 1;
+			if (i > 0)
+			{
+				increment_com_errors(MOTOR_COM_ERROR_SKIPPED_BYTES, i);
+			}
+
+			consume_rxbuf(i + len);
+			return true;
 		}
+	}
 
-		return 0; // failed to verify message
+	if (rxbuf_len == RXBUF_SIZE)
+	{
+		// no frame found in full buffer, keep bytes which could be start of frame
+		increment_com_errors(MOTOR_COM_ERROR_SKIPPED_BYTES, RXBUF_SIZE - (len - 1));
+		consume_rxbuf(RXBUF_SIZE - (len - 1));
 	}
 
-	// read failure
-	return 0;
+	return false;
 }
 
 
-static int connect()
+static void begin_connect(uint32_t delay_ms)
 {
-	for (int i = 0; i < 10; ++i)
-	{
-		send_request(OPCODE_HELLO, 0x00);
-
-		if (read_response(OPCODE_HELLO, 0))
-		{
-			system_delay_ms(4);
-			return 1;
-		}
-		else
-		{
-			system_delay_ms(1000);
-		}
-	}
-
-	return 0;
+	// learn header again, motor controller could have been replaced
+	response_header_known = false;
+	link_state = LINK_STATE_CONNECT;
+	configure_step = 0;
+	connect_attempts = 0;
+	consecutive_errors = 0;
+	next_connect_ms = system_ms() + delay_ms;
 }
 
-static int configure(uint16_t max_current_mA, uint8_t lvc_V)
+#if HAS_MOTOR_BAUD_RATE_PROBE
+static void set_baud_rate(uint16_t baud)
 {
-	uint16_t tmp = 0;
+	uart_motor_close();
+	uart_motor_open(baud);
+	baud_rate = baud;
+	rxbuf_len = 0;
+}
 
-	// This initialization is done exactly as in orginal firmware for BBSHD/BBS02.
-	// The meaning of most parameters is unknown.
+static void store_baud_rate(uint16_t baud)
+{
+	g_pstate.motor_baud_rate_u16l = (uint8_t)baud;
+	g_pstate.motor_baud_rate_u16h = (uint8_t)(baud >> 8);
+	cfgstore_save_pstate();
 
-#if defined (BBSHD)
-	send_request(OPCODE_UNKNOWN1, 0x5a);
-#elif defined (BBS02)
-	send_request(OPCODE_UNKNOWN1, 0x5f);
-#else
-	return 0;
-#endif
+	eventlog_write_data(EVT_DATA_MOTOR_BAUD_RATE, baud);
+}
 
-	if (!read_response(OPCODE_UNKNOWN1, 0))
+static void process_probe_response(bool ok)
+{
+	if (ok)
 	{
-		return 0;
-	}
+		if (++probe_responses == PROBE_HELLO_RESPONSES)
+		{
+			store_baud_rate(baud_rate);
 
-	system_delay_ms(4);
+			link_state = LINK_STATE_CONFIGURE;
+			configure_step = 0;
+		}
+		return;
+	}
 
-	send_request(OPCODE_UNKNOWN2, 0x11);
-	if (!read_response(OPCODE_UNKNOWN2, 0))
+	probe_responses = 0;
+	if (++probe_index < PROBE_BAUD_RATES)
 	{
-		return 0;
+		set_baud_rate(probe_baud_rates[probe_index]);
 	}
-
-	system_delay_ms(4);
-
-	send_request(OPCODE_UNKNOWN3, 0x78);
-	if (!read_response(OPCODE_UNKNOWN3, 0))
+	else
 	{
-		return 0;
+		// no faster rate verified, motor controller could have been confused
+		// by requests sent at wrong rate, connect again at default rate.
+		set_baud_rate(BAUD_RATE_DEFAULT);
+		store_baud_rate(BAUD_RATE_DEFAULT);
+		begin_connect(CONNECT_POWER_ON_DELAY_MS);
 	}
+}
+#endif
 
-	system_delay_ms(4);
+static void process_link_response(bool ok)
+{
+	uint32_t now = system_ms();
 
-	send_request(OPCODE_UNKNOWN4, 0x64);
-	if (!read_response(OPCODE_UNKNOWN4, 0))
+	if (link_state == LINK_STATE_CONNECT)
 	{
-		return 0;
-	}
+		if (ok)
+		{
+			link_state = LINK_STATE_CONFIGURE;
+			configure_step = 0;
 
-	system_delay_ms(4);
+#if HAS_MOTOR_BAUD_RATE_PROBE
+			if (g_pstate.motor_baud_rate_u16l == 0 && g_pstate.motor_baud_rate_u16h == 0)
+			{
+				link_state = LINK_STATE_PROBE;
+				probe_index = 0;
+				probe_responses = 0;
+				set_baud_rate(probe_baud_rates[0]);
+			}
+#endif
+		}
+		else
+		{
+			next_connect_ms = now + CONNECT_RETRY_INTERVAL_MS;
+			++connect_attempts;
 
-	send_request(OPCODE_UNKNOWN5, 0x50);
-	if (!read_response(OPCODE_UNKNOWN5, 0))
+#if HAS_MOTOR_BAUD_RATE_PROBE
+			if (baud_rate != BAUD_RATE_DEFAULT && connect_attempts == CONNECT_ATTEMPTS_BEFORE_FALLBACK)
+			{
+				// stored rate no longer works, e.g. motor controller replaced
+				set_baud_rate(BAUD_RATE_DEFAULT);
+				store_baud_rate(BAUD_RATE_DEFAULT);
+			}
+#endif
+
+			if (connect_attempts == CONNECT_ATTEMPTS_BEFORE_ERROR)
+			{
+				// keep trying in background, motor controller could power on later
+				eventlog_write(EVT_ERROR_INIT_MOTOR);
+			}
+		}
+	}
+#if HAS_MOTOR_BAUD_RATE_PROBE
+	else if (link_state == LINK_STATE_PROBE)
 	{
-		return 0;
+		process_probe_response(ok);
 	}
+#endif
+	else if (link_state == LINK_STATE_CONFIGURE)
+	{
+		if (!ok)
+		{
+			eventlog_write(EVT_ERROR_INIT_MOTOR);
+			begin_connect(CONNECT_RETRY_INTERVAL_MS);
+		}
+		else if (++configure_step == CONFIGURE_STEPS)
+		{
+			link_state = LINK_STATE_READY;
+			consecutive_errors = 0;
 
-	system_delay_ms(4);
+			eventlog_write(EVT_MSG_MOTOR_INIT_OK);
 
-	send_request(OPCODE_UNKNOWN6, 0x46);
-	if (!read_response(OPCODE_UNKNOWN6, 0))
-	{
-		return 0;
+			// motor controller has no target set after configure,
+			// resend current values and refresh all readings
+			target_current_changed = true;
+			target_current_changed_ms = now;
+			target_speed_changed = true;
+			for (uint8_t i = 0; i < COM_READS; ++i)
+			{
+				last_read_ms[i] = now - read_period_ms[i];
+			}
+		}
 	}
+}
+
+static void send_request_from_idle(uint8_t opcode, uint16_t data, uint32_t now)
+{
+	send_request_async(opcode, data);
+	last_sent_opcode = opcode;
+	last_request_write_ms = now;
+	com_state = COM_STATE_WAIT_RESPONSE;
+}
 
-	system_delay_ms(4);
+static void send_link_request(uint32_t now)
+{
+	uint16_t tmp;
 
-	send_request(OPCODE_UNKNOWN7, 0x0c);
-	if (!read_response(OPCODE_UNKNOWN7, 0))
+	if (link_state == LINK_STATE_CONNECT)
 	{
-		return 0;
+		if (now >= next_connect_ms)
+		{
+			send_request_from_idle(OPCODE_HELLO, 0x00, now);
+		}
 	}
-
-	system_delay_ms(4);
-
-	send_request(OPCODE_LVC, (uint32_t)(((uint32_t)lvc_V * adc_steps_per_volt_x100) / 100u));
-	if (!read_response(OPCODE_LVC, 0))
+	else if (link_state == LINK_STATE_PROBE)
 	{
-		return 0;
+		send_request_from_idle(OPCODE_HELLO, 0x00, now);
 	}
+	else if (configure_step < CONFIGURE_REQUESTS)
+	{
+		send_request_from_idle(configure_requests[configure_step].opcode, configure_requests[configure_step].data, now);
+	}
+	else if (configure_step == CONFIGURE_STEP_LVC)
+	{
+		send_request_from_idle(OPCODE_LVC, (uint16_t)(((uint32_t)configured_lvc_V * adc_steps_per_volt_x100) / 100u), now);
+	}
+	else if (configure_step == CONFIGURE_STEP_MAX_CURRENT)
+	{
+		tmp = (uint16_t)((configured_max_current_mA * (uint32_t)ADC_STEPS_PER_AMP_X10) / 10000UL);
+		if (tmp > 255)
+		{
+			tmp = 255;
+		}
+		eventlog_write_data(EVT_DATA_MAX_CURRENT_ADC_REQUEST, tmp);
 
-	system_delay_ms(4);
+		send_request_from_idle(OPCODE_MAX_CURRENT, tmp, now);
+	}
+}
 
-	tmp = (uint16_t)((max_current_mA * (uint32_t)ADC_STEPS_PER_AMP_X10) / 10000UL);
-	if (tmp > 255)
+static void update_read_periods()
+{
+	if (!motor_power_enabled || target_current == 0)
 	{
-		tmp = 255;
+		read_period_ms[COM_READ_STATUS] = COM_READ_STATUS_IDLE_PERIOD_MS;
+		read_period_ms[COM_READ_CURRENT] = COM_READ_CURRENT_IDLE_PERIOD_MS;
+		read_period_ms[COM_READ_VOLTAGE] = COM_READ_VOLTAGE_IDLE_PERIOD_MS;
 	}
-	eventlog_write_data(EVT_DATA_MAX_CURRENT_ADC_REQUEST, tmp);
-
-	send_request(OPCODE_MAX_CURRENT, tmp);
-	if (!read_response(OPCODE_MAX_CURRENT, &tmp))
+	else if (limiting_active)
 	{
-		return 0;
+		read_period_ms[COM_READ_STATUS] = COM_READ_STATUS_PERIOD_MS;
+		read_period_ms[COM_READ_CURRENT] = COM_READ_CURRENT_LIMITING_PERIOD_MS;
+		read_period_ms[COM_READ_VOLTAGE] = COM_READ_VOLTAGE_LIMITING_PERIOD_MS;
 	}
 	else
 	{
-		eventlog_write_data(EVT_DATA_MAX_CURRENT_ADC_RESPONSE, tmp);
+		read_period_ms[COM_READ_STATUS] = COM_READ_STATUS_PERIOD_MS;
+		read_period_ms[COM_READ_CURRENT] = COM_READ_CURRENT_PERIOD_MS;
+		read_period_ms[COM_READ_VOLTAGE] = COM_READ_VOLTAGE_PERIOD_MS;
 	}
+}
 
-	system_delay_ms(4);
+static uint8_t get_next_due_read(uint32_t now)
+{
+	for (uint8_t i = 0; i < COM_READS; ++i)
+	{
+		uint8_t idx = (uint8_t)((next_read + i) % COM_READS);
+		if (now - last_read_ms[idx] >= read_period_ms[idx])
+		{
+			return idx;
+		}
+	}
 
-	return 1;
+	return COM_READS;
 }
 
+static void send_read_request(uint8_t idx, uint32_t now)
+{
+	send_request_from_idle(read_opcodes[idx], 0, now);
+	last_read_ms[idx] = now;
+	next_read = (uint8_t)((idx + 1) % COM_READS);
+}
 
 static void process_com_state_machine_idle()
 {
 	// Async state machine loop for serial communication with motor control MCU.
 	//
 	// Handles:
+	// * Connect and configure, also reconnect if link is lost
 	// * Set target current
 	// * Set target speed
 	// * Read motor status
 	// * Read motor current
 	// * Read battery voltage
 	//
-	// Set target speed/current are prioritzed over status reading (shorter check interval).
+	// Pending target current/speed changes are sent before periodic reads,
+	// only latest value is sent if changed several times while waiting.
+	// Reads are served round robin with individual periods
+	// adapted to riding state.
 
 	uint32_t now = system_ms();
 
 	// make sure requests have some space between them
-	if (now - last_request_write_ms < 32)
+	if (now - last_response_ms < COM_REQUEST_GAP_MS)
 	{
 		return;
 	}
 
+	if (link_state != LINK_STATE_READY)
+	{
+		send_link_request(now);
+		return;
+	}
+
+	update_read_periods();
+	uint8_t read = get_next_due_read(now);
+
+	// Do not starve reads while target current is continuously changing (e.g. ramping).
+	// Reads are often overdue together, only one is let ahead of a pending change
+	// to limit the added latency to one read round trip.
+	if (read != COM_READS && !overdue_read_sent &&
+		now - last_read_ms[read] > (uint32_t)read_period_ms[read] + COM_READ_MAX_DELAY_MS)
+	{
+		send_read_request(read, now);
+		overdue_read_sent = true;
+		return;
+	}
+
 	if (target_current_changed)
 	{
-		send_request_async(OPCODE_TARGET_CURRENT, target_current);
-		last_sent_opcode = OPCODE_TARGET_CURRENT;
-		last_request_write_ms = now;
-		com_state = COM_STATE_WAIT_RESPONSE;
+		send_request_from_idle(OPCODE_TARGET_CURRENT, target_current, now);
+		target_current_sent_changed_ms = target_current_changed_ms;
 		target_current_changed = false;
+		overdue_read_sent = false;
 		return;
 	}
 
 	if (target_speed_changed)
 	{
-		send_request_async(OPCODE_TARGET_SPEED, (uint8_t)(((uint16_t)SPEED_STEPS * target_speed) / 100));
-		last_sent_opcode = OPCODE_TARGET_SPEED;
-		last_request_write_ms = now;
-		com_state = COM_STATE_WAIT_RESPONSE;
+		send_request_from_idle(OPCODE_TARGET_SPEED, (uint8_t)(((uint16_t)SPEED_STEPS * target_speed) / 100), now);
 		target_speed_changed = false;
 		return;
 	}
 
-	if ((now - last_status_read_ms) > 200)
+	if (read != COM_READS)
 	{
-		send_request_async(next_status_read_opcode, 0);
-		last_sent_opcode = next_status_read_opcode;
-		last_request_write_ms = now;
-		com_state = COM_STATE_WAIT_RESPONSE;
-		if (next_status_read_opcode == OPCODE_READ_STATUS)
-		{
-			last_status_read_ms = now;
-		}
-		return;
+		send_read_request(read, now);
 	}
 }
 
-static void process_com_state_machine_wait_response()
+static void process_response(bool ok, uint16_t data)
 {
-	uint8_t response_length = 0;
-
-	switch (last_sent_opcode)
+	if (link_state != LINK_STATE_READY)
 	{
-	case OPCODE_TARGET_CURRENT:
-	case OPCODE_TARGET_SPEED:
-	case OPCODE_READ_CURRENT:
-		response_length = 4;
-		break;
-	case OPCODE_READ_VOLTAGE:
-	case OPCODE_READ_STATUS:
-		response_length = 5;
-		break;
-	}
+		if (ok && last_sent_opcode == OPCODE_MAX_CURRENT)
+		{
+			eventlog_write_data(EVT_DATA_MAX_CURRENT_ADC_RESPONSE, data);
+		}
 
-	if (uart_motor_available() >= response_length || (system_ms() - last_request_write_ms) > 32)
-	{
-		switch (last_sent_opcode)
+		if (!ok)
 		{
-		case OPCODE_TARGET_CURRENT:
-			com_state = COM_STATE_SET_CURRENT;
-			break;
-		case OPCODE_TARGET_SPEED:
-			com_state = COM_STATE_SET_SPEED;
-			break;
-		case OPCODE_READ_CURRENT:
-			com_state = COM_STATE_READ_CURRENT;
-			break;
-		case OPCODE_READ_VOLTAGE:
-			com_state = COM_STATE_READ_VOLTAGE;
-			break;
-		case OPCODE_READ_STATUS:
-			com_state = COM_STATE_READ_STATUS;
-			break;
-		default:
-			com_state = COM_STATE_IDLE;
-			break;
+			increment_com_errors(MOTOR_COM_ERROR_CONNECT, 1);
 		}
+
+		process_link_response(ok);
+		return;
 	}
-}
 
-static void process_com_state_machine()
-{
-	uint16_t data;
-	switch (com_state)
+	switch (last_sent_opcode)
 	{
-	case COM_STATE_IDLE:
-		process_com_state_machine_idle();
-		break;
+	case OPCODE_TARGET_CURRENT:
+		if (ok)
+		{
+			uint16_t latency = (uint16_t)(last_response_ms - target_current_sent_changed_ms);
+			if (latency > target_current_latency_max_ms)
+			{
+				target_current_latency_max_ms = latency;
+			}
 
-	case COM_STATE_WAIT_RESPONSE:
-		process_com_state_machine_wait_response();
-		break;
+			if (latency > COM_LATENCY_TARGET_MS)
+			{
+				++stats_target_current_slow;
+			}
 
-	case COM_STATE_SET_CURRENT:
-		if (try_read_response(OPCODE_TARGET_CURRENT, &data))
-		{
 			eventlog_write_data(EVT_DATA_TARGET_CURRENT, data);
 		}
 		else
 		{
+			increment_com_errors(MOTOR_COM_ERROR_TARGET_CURRENT, 1);
 			eventlog_write(EVT_ERROR_CHANGE_TARGET_CURRENT);
-		}
 
-		com_state = COM_STATE_IDLE;
+			// resend unless superseded by a newer value, target could otherwise
+			// remain unapplied for as long as it is not changed again
+			if (!target_current_changed)
+			{
+				target_current_changed = true;
+				target_current_changed_ms = target_current_sent_changed_ms;
+			}
+		}
 		break;
 
-	case COM_STATE_SET_SPEED:
-		if (try_read_response(OPCODE_TARGET_SPEED, &data))
+	case OPCODE_TARGET_SPEED:
+		if (ok)
 		{
 			eventlog_write_data(EVT_DATA_TARGET_SPEED, (uint8_t)((data * 100) / SPEED_STEPS));
 		}
 		else
 		{
+			increment_com_errors(MOTOR_COM_ERROR_TARGET_SPEED, 1);
 			eventlog_write(EVT_ERROR_CHANGE_TARGET_SPEED);
+			target_speed_changed = true;
 		}
-
-		com_state = COM_STATE_IDLE;
 		break;
 
-	case COM_STATE_READ_STATUS:
-		if (try_read_response(OPCODE_READ_STATUS, &data))
+	case OPCODE_READ_STATUS:
+		if (ok)
 		{
 			if (data != status_flags)
 			{
+				if ((data & MOTOR_ERROR_POWER_RESET) && !(status_flags & MOTOR_ERROR_POWER_RESET))
+				{
+					// Motor controller has been reset (e.g. brown out) and
+					// lost its configuration, reconnect in background.
+					eventlog_write(EVT_MSG_MOTOR_RECONNECT);
+					begin_connect(CONNECT_POWER_ON_DELAY_MS);
+				}
+
 				status_flags = data;
 				eventlog_write_data(EVT_DATA_MOTOR_STATUS, status_flags);
 			}
 		}
 		else
 		{
+			increment_com_errors(MOTOR_COM_ERROR_READ_STATUS, 1);
 			eventlog_write(EVT_ERROR_READ_MOTOR_STATUS);
 		}
-
-		next_status_read_opcode = OPCODE_READ_CURRENT;
-		com_state = COM_STATE_IDLE;
 		break;
 
-	case COM_STATE_READ_CURRENT:
-		if (try_read_response(OPCODE_READ_CURRENT, &data))
+	case OPCODE_READ_CURRENT:
+		if (ok)
 		{
 			battery_amp_x10 = (data * 100) / ADC_STEPS_PER_AMP_X10;
 		}
 		else
 		{
+			increment_com_errors(MOTOR_COM_ERROR_READ_CURRENT, 1);
 			eventlog_write(EVT_ERROR_READ_MOTOR_CURRENT);
 		}
-
-		next_status_read_opcode = OPCODE_READ_VOLTAGE;
-		com_state = COM_STATE_IDLE;
 		break;
 
-	case COM_STATE_READ_VOLTAGE:
-		if (try_read_response(OPCODE_READ_VOLTAGE, &data))
+	case OPCODE_READ_VOLTAGE:
+		if (ok)
 		{
 			battery_adc_steps = data;
 			battery_volt_x10 = (uint16_t)(((uint32_t)battery_adc_steps * 1000) / adc_steps_per_volt_x100);
 		}
 		else
 		{
+			increment_com_errors(MOTOR_COM_ERROR_READ_VOLTAGE, 1);
 			eventlog_write(EVT_ERROR_READ_MOTOR_VOLTAGE);
 		}
+		break;
+	}
+
+	if (ok)
+	{
+		++stats_requests_ok;
+		consecutive_errors = 0;
+	}
+	else
+	{
+		++stats_requests_failed;
+		if (++consecutive_errors == COM_MAX_CONSECUTIVE_ERRORS && link_state == LINK_STATE_READY)
+		{
+			// motor controller not responding, possibly powered off, try to reconnect
+			eventlog_write(EVT_MSG_MOTOR_RECONNECT);
+			begin_connect(CONNECT_RETRY_INTERVAL_MS);
+		}
+	}
+}
+
+static void process_com_state_machine_wait_response()
+{
+	uint32_t now = system_ms();
+	uint16_t elapsed = (uint16_t)(now - last_request_write_ms);
+
+	uint16_t timeout = link_state == LINK_STATE_READY ? response_timeout_ms : READ_TIMEOUT;
+
+	uint16_t data = 0;
+	bool complete = try_parse_response(last_sent_opcode, &data);
+	if (!complete && elapsed <= timeout)
+	{
+		return;
+	}
+
+	if (complete && link_state == LINK_STATE_READY)
+	{
+		// adapt timeout to measured round trip time
+		round_trip_ms = (round_trip_ms * 3 + elapsed) / 4;
 
-		next_status_read_opcode = OPCODE_READ_STATUS;
-		com_state = COM_STATE_IDLE;
+		response_timeout_ms = round_trip_ms + COM_RESPONSE_TIMEOUT_MARGIN_MS;
+		if (response_timeout_ms < COM_RESPONSE_TIMEOUT_MIN_MS)
+		{
+			response_timeout_ms = COM_RESPONSE_TIMEOUT_MIN_MS;
+		}
+		else if (response_timeout_ms > COM_RESPONSE_TIMEOUT_MAX_MS)
+		{
+			response_timeout_ms = COM_RESPONSE_TIMEOUT_MAX_MS;
+		}
+	}
+
+	last_response_ms = now;
+	process_response(complete, data);
+
+	com_state = COM_STATE_IDLE;
+}
+
+static void process_com_stats()
+{
+	uint32_t now = system_ms();
+	if (link_state != LINK_STATE_READY || now - last_stats_report_ms < COM_STATS_REPORT_INTERVAL_MS)
+	{
+		return;
+	}
+
+	last_stats_report_ms = now;
+
+	eventlog_write_data(EVT_DATA_MOTOR_COM_ROUND_TRIP, round_trip_ms);
+
+	eventlog_write_data(EVT_DATA_MOTOR_COM_REQUESTS_OK, stats_requests_ok);
+
+	if (stats_requests_failed > 0)
+	{
+		eventlog_write_data(EVT_DATA_MOTOR_COM_REQUESTS_FAILED, stats_requests_failed);
+	}
+
+	if (target_current_latency_max_ms > 0)
+	{
+		eventlog_write_data(EVT_DATA_MOTOR_COM_LATENCY, target_current_latency_max_ms);
+		eventlog_write_data(EVT_DATA_MOTOR_COM_LATENCY_SLOW, stats_target_current_slow);
+	}
+
+	stats_requests_ok = 0;
+	stats_requests_failed = 0;
+	stats_target_current_slow = 0;
+	target_current_latency_max_ms = 0;
+}
+
+static void process_com_state_machine()
+{
+	switch (com_state)
+	{
+	case COM_STATE_IDLE:
+		process_com_state_machine_idle();
 		break;
 
+	case COM_STATE_WAIT_RESPONSE:
+		process_com_state_machine_wait_response();
+		break;
 	}
+
+	process_com_stats();
 }
@@ -7,6 +7,7 @@
  */
 
 #include "sensors.h"
+#include "sensors_core.h"
 #include "system.h"
 #include "adc.h"
 #include "util.h"
@@ -24,12 +25,8 @@
 // interrupt runs at 100us interval, see timer0 in timers.c
 // timer0 is shared between system and sensors modules
 
-#define PAS_SENSOR_NUM_SIGNALS			PAS_PULSES_REVOLUTION
-#define PAS_SENSOR_MIN_PULSE_MS_X10		50	// 500rpm limit
-
-#define SPEED_SENSOR_MIN_PULSE_MS_X10	500
-#define SPEED_SENSOR_TIMEOUT_MS_X10		25000
-
+// PAS and speed sensor pins are sampled in timer interrupt,
+// edges are decoded in sensors_core.c.
 
 // Some versions of the BBSHD motor (hall sensor board)
 // has a PTC thermistor instead of a NTC thermistor.
@@ -67,18 +64,11 @@ static bool bbshd_ptc_thermistor;
 #endif
 
 
-static volatile uint16_t pas_pulse_counter;
-static volatile bool pas_direction_backward;
-static volatile uint16_t pas_period_length;	// pulse length counted in interrupt frequency (100us)
-static uint16_t pas_period_counter;
+static uint16_t pas_period_counter;	// ticks since last pulse, counted in interrupt frequency (100us)
 static bool pas_prev1;
-static bool pas_prev2;
-static uint16_t pas_stop_delay_periods;
 
-static volatile uint16_t speed_ticks_period_length; // pulse length counted in interrupt frequency (100us)
-static uint16_t speed_period_counter;
+static uint16_t speed_period_counter; // ticks since last pulse, counted in interrupt frequency (100us)
 static bool speed_prev_state;
-static uint8_t speed_ticks_per_rpm;
 
 
 static float thermistor_ntc_calculate_temperature(float R, float invBeta)
@@ -133,14 +123,10 @@ void sensors_init()
 #endif
 
 	pas_period_counter = 0;
-	pas_pulse_counter = 0;
-	pas_direction_backward = false;
-	pas_period_length = 0;
-	pas_stop_delay_periods = 1500;
 	speed_period_counter = 0;
-	speed_ticks_period_length = 0;
 	speed_prev_state = false;
-	speed_ticks_per_rpm = 1;
+
+	sensors_core_init();
 
 	// pins do not have external interrupt, use timer0 to evaluate state frequently
 	SET_PIN_INPUT(PIN_PAS1);
@@ -151,104 +137,41 @@ void sensors_init()
 	SET_PIN_QUASI(PIN_SHIFT_SENSOR); // input pullup
 
 	pas_prev1 = GET_PIN_STATE(PIN_PAS1);
-	pas_prev2 = GET_PIN_STATE(PIN_PAS2);
 
 	timer0_init_sensors();
 }
 
 void sensors_process()
 {
-
-}
-
-void pas_set_stop_delay(uint16_t delay_ms)
-{
-	pas_stop_delay_periods = delay_ms * 10;
+	sensors_core_process();
 }
 
-uint16_t pas_get_cadence_rpm_x10()
+void sensors_disable_interrupts()
 {
-	uint16_t tmp;
 	ET0 = 0; // disable timer0 interrupts
-	tmp = pas_period_length;
-	ET0 = 1;
-
-	if (tmp > 0)
-	{
-		return (uint16_t)((6000000ul / PAS_SENSOR_NUM_SIGNALS) / tmp);
-	}
-	else
-	{
-		return 0;
-	}
 }
 
-uint16_t pas_get_pulse_counter()
+void sensors_enable_interrupts()
 {
-	uint16_t tmp;
-	ET0 = 0; // disable timer0 interrupts
-	tmp = pas_pulse_counter;
 	ET0 = 1;
-
-	return tmp;
 }
 
-bool pas_is_pedaling_forwards()
-{
-	uint16_t period_length;
-	uint8_t direction_backward;
-	ET0 = 0; // disable timer0 interrupts
-	period_length = pas_period_length;
-	direction_backward = pas_direction_backward;
-	ET0 = 1;
-
-	// atomic read operation, no need to disable timer interrupt
-	return period_length > 0 && !direction_backward;
-}
-
-bool pas_is_pedaling_backwards()
-{
-	uint16_t period_length;
-	uint8_t direction_backward;
-	ET0 = 0; // disable timer0 interrupts
-	period_length = pas_period_length;
-	direction_backward = pas_direction_backward;
-	ET0 = 1;
-
-	return period_length > 0 && direction_backward;
-}
-
-void speed_sensor_set_signals_per_rpm(uint8_t num_signals)
+uint16_t torque_sensor_get_nm_x100()
 {
-	speed_ticks_per_rpm = num_signals;
+	return 0;
 }
 
-bool speed_sensor_is_moving()
+uint16_t torque_sensor_get_revolution_nm_x100()
 {
-	uint16_t tmp;
-	ET0 = 0; // disable timer0 interrupts
-	tmp = speed_ticks_period_length;
-	ET0 = 1;
-
-	return tmp > 0;
+	return 0;
 }
 
-uint16_t speed_sensor_get_rpm_x10()
+uint16_t torque_sensor_get_half_revolution_nm_x100()
 {
-	uint16_t tmp;
-	ET0 = 0; // disable timer0 interrupts
-	tmp = speed_ticks_period_length;
-	ET0 = 1;
-
-	if (tmp > 0)
-	{
-		return 6000000ul / tmp / speed_ticks_per_rpm;
-	}
-
 	return 0;
 }
 
-uint16_t torque_sensor_get_nm_x100()
+uint16_t torque_sensor_get_revolution_peak_nm_x100()
 {
 	return 0;
 }
@@ -258,6 +181,11 @@ bool torque_sensor_ok()
 	return true;
 }
 
+bool torque_sensor_calibrate(uint8_t index, uint16_t nm_x100)
+{
+	return false;
+}
+
 
 int16_t temperature_contr_x100()
 {
@@ -365,34 +293,11 @@ void sensors_timer0_isr() // runs every 100us, see timers.c
 	// Pas
 	{
 		bool pas1 = GET_PIN_STATE(PIN_PAS1);
-		bool pas2 = GET_PIN_STATE(PIN_PAS2);
 
-		if (pas1 && !pas_prev1 /* && pas_period_counter > PAS_SENSOR_MIN_PULSE_MS_X10 */)
+		// sensors core is only called on rising edge, cheap tick counting otherwise
+		if (pas1 && !pas_prev1 && sensors_core_pas_edge(GET_PIN_STATE(PIN_PAS2), pas_period_counter))
 		{
-			pas_pulse_counter++;
-
-			if (pas_direction_backward != pas2)
-			{
-				pas_direction_backward = pas2;
-
-				// Reset pas pulse counter if pedal direction is changed,
-				// this variable counts the number of pulses since start of pedaling session.
-				pas_pulse_counter = 0;
-			}
-			
-			if (pas_period_counter > 0)
-			{
-				if (pas_period_counter <= pas_stop_delay_periods)
-				{
-					pas_period_length = pas_period_counter; // save in order to be able to calculate rpm when needed
-				}
-				else
-				{
-					pas_period_length = 0;
-				}
-
-				pas_period_counter = 0;
-			}
+			pas_period_counter = 0;
 		}
 		else
 		{
@@ -401,17 +306,16 @@ void sensors_timer0_isr() // runs every 100us, see timers.c
 			{
 				pas_period_counter++;
 			}
-			
-			if (pas_period_length > 0 && pas_period_counter > pas_stop_delay_periods)
+
+			// Stop timeout only needs coarse resolution, checked every
+			// 256 ticks (25.6ms) instead of calling sensors core every tick.
+			if ((uint8_t)pas_period_counter == 0)
 			{
-				pas_period_length = 0;
-				pas_pulse_counter = 0;
-				pas_direction_backward = false;
+				sensors_core_pas_idle(pas_period_counter);
 			}
 		}
 
 		pas_prev1 = pas1;
-		pas_prev2 = pas2;
 	}
 
 
@@ -419,17 +323,8 @@ void sensors_timer0_isr() // runs every 100us, see timers.c
 	{
 		bool spd = GET_PIN_STATE(PIN_SPEED_SENSOR);
 
-		if (spd && !speed_prev_state && speed_period_counter > SPEED_SENSOR_MIN_PULSE_MS_X10)
+		if (spd && !speed_prev_state && sensors_core_speed_edge(speed_period_counter))
 		{
-			if (speed_period_counter <= SPEED_SENSOR_TIMEOUT_MS_X10)
-			{
-				speed_ticks_period_length = speed_period_counter;
-			}
-			else
-			{
-				speed_ticks_period_length = 0;
-			}
-				
 			speed_period_counter = 0;
 		}
 		else
@@ -439,15 +334,14 @@ void sensors_timer0_isr() // runs every 100us, see timers.c
 			{
 				speed_period_counter++;
 			}
-			
-			if (speed_ticks_period_length > 0 && speed_period_counter > SPEED_SENSOR_TIMEOUT_MS_X10)
+
+			if ((uint8_t)speed_period_counter == 0)
 			{
-				speed_ticks_period_length = 0;
+				sensors_core_speed_idle(speed_period_counter);
 			}
 		}
 
 		speed_prev_state = spd;
 	}
-	
 }
 #pragma restore
@@ -16,6 +16,15 @@
 
 #define EEPROM_CONFIG_PAGE		0
 #define EEPROM_PSTATE_PAGE		1
+#define EEPROM_TRIP_PAGE_A		2
+#define EEPROM_TRIP_PAGE_B		3
+
+// Smallest eeprom page size of supported controllers.
+#define EEPROM_TRIP_PAGE_SIZE	256
+
+// Trip slot is sequence number, version, data and checksum.
+#define TRIP_SLOT_SIZE			(sizeof(trip_t) + 3)
+#define TRIP_NUM_SLOTS			(EEPROM_TRIP_PAGE_SIZE / TRIP_SLOT_SIZE)
 
 #define EEPROM_OK					0
 #define EEPROM_ERROR_SELECT_PAGE	1
@@ -25,6 +34,7 @@
 #define EEPROM_ERROR_CHECKSUM		5
 #define EEPROM_ERROR_ERASE			6
 #define EEPROM_ERROR_WRITE			7
+#define EEPROM_OK_UPGRADED			8
 
 static const uint8_t default_current_limits[] = { 7, 10, 14, 19, 26, 36, 50, 70, 98 };
 
@@ -32,6 +42,13 @@ static const uint8_t default_current_limits[] = { 7, 10, 14, 19, 26, 36, 50, 70,
 static const uint8_t default_torque_factors[] = { 10, 15, 23, 44, 57, 74, 88, 105, 126 };
 #endif
 
+#if (THROTTLE_RESPONSE_CURVE == THROTTLE_RESPONSE_CUSTOM)
+static const uint8_t default_throttle_custom_map[101] =
+{
+	THROTTLE_CUSTOM_MAP
+};
+#endif
+
 typedef struct
 {
 	uint8_t version;
@@ -43,8 +60,14 @@ static header_t header;
 
 config_t g_config;
 pstate_t g_pstate;
+trip_t g_trip;
 
-static uint8_t read(uint8_t page, uint8_t version, uint8_t* dst, uint8_t size);
+static uint8_t trip_page;
+static uint8_t trip_slot;
+static uint8_t trip_seq;
+static bool trip_spare_erased;
+
+static uint8_t read(uint8_t page, uint8_t version, uint8_t* dst, uint8_t size, bool allow_upgrade);
 static uint8_t write(uint8_t page, uint8_t version, uint8_t* src, uint8_t size);
 
 static bool read_config();
@@ -55,6 +78,16 @@ static bool read_pstate();
 static bool write_pstate();
 static void load_default_pstate();
 
+static bool read_trip();
+static bool find_trip_slot(uint8_t page, uint8_t* slot, uint8_t* seq);
+static bool read_trip_slot(uint8_t page, uint8_t slot, uint8_t* seq);
+static uint8_t trip_spare_page();
+static bool is_trip_page_erased(uint8_t page);
+static bool erase_trip_spare_page();
+static bool write_trip(bool power_down);
+static bool write_trip_slot(uint8_t page, uint8_t slot, uint8_t seq);
+static void load_default_trip();
+
 void cfgstore_init()
 {
 	if (!read_config())
@@ -66,6 +99,11 @@ void cfgstore_init()
 	{
 		cfgstore_reset_pstate();
 	}
+
+	if (!read_trip())
+	{
+		load_default_trip();
+	}
 }
 
 bool cfgstore_reset_config()
@@ -96,11 +134,22 @@ bool cfgstore_save_pstate()
 	return write_pstate();
 }
 
+bool cfgstore_reset_trip()
+{
+	load_default_trip();
+	return write_trip(false);
+}
+
+bool cfgstore_save_trip(bool power_down)
+{
+	return write_trip(power_down);
+}
+
 static bool read_config()
 {
 	eventlog_write(EVT_MSG_CONFIG_READ_BEGIN);
 
-	uint8_t res = read(EEPROM_CONFIG_PAGE, CONFIG_VERSION, (uint8_t*)&g_config, sizeof(config_t));
+	uint8_t res = read(EEPROM_CONFIG_PAGE, CONFIG_VERSION, (uint8_t*)&g_config, sizeof(config_t), false);
 	switch (res)
 	{
 	default:
@@ -158,6 +207,8 @@ static void load_default_config()
 	g_config.max_battery_x100v_u16l = (uint8_t)5460;
 	g_config.max_battery_x100v_u16h = (uint8_t)(5460 >> 8);
 	g_config.low_cut_off_v = 42;
+	g_config.battery_capacity_ah_x10_u16l = 0;
+	g_config.battery_capacity_ah_x10_u16h = 0;
 
 	g_config.use_speed_sensor = 1;
 	g_config.use_shift_sensor = HAS_SHIFT_SENSOR_SUPPORT;
@@ -214,13 +265,32 @@ static void load_default_config()
 		g_config.assist_levels[0][i+1].torque_amplification_factor_x10 = 0;
 #endif	
 	}
+
+	for (uint8_t i = 0; i < THROTTLE_CURVE_POINTS; ++i)
+	{
+		uint8_t x = i * 5;
+#if (THROTTLE_RESPONSE_CURVE == THROTTLE_RESPONSE_QUADRATIC)
+		g_config.throttle_curve[i] = (uint8_t)(((uint16_t)x * x) / 100);
+#elif (THROTTLE_RESPONSE_CURVE == THROTTLE_RESPONSE_CUSTOM)
+		g_config.throttle_curve[i] = default_throttle_custom_map[x];
+#else
+		g_config.throttle_curve[i] = x;
+#endif
+	}
+
+	g_config.throttle_deadband_mv = 50;
+	g_config.throttle_filter_cutoff_hz = 5;
 }
 
 static bool read_pstate()
 {
 	eventlog_write(EVT_MSG_PSTATE_READ_BEGIN);
 
-	uint8_t res = read(EEPROM_PSTATE_PAGE, PSTATE_VERSION, (uint8_t*)&g_pstate, sizeof(pstate_t));
+	// pstate is only ever appended to, older versions are upgraded
+	// by keeping stored values and using defaults for new fields.
+	load_default_pstate();
+
+	uint8_t res = read(EEPROM_PSTATE_PAGE, PSTATE_VERSION, (uint8_t*)&g_pstate, sizeof(pstate_t), true);
 	switch (res)
 	{
 	default:
@@ -236,6 +306,10 @@ static bool read_pstate()
 	case EEPROM_OK:
 		eventlog_write(EVT_MSG_PSTATE_READ_DONE);
 		break;
+	case EEPROM_OK_UPGRADED:
+		eventlog_write(EVT_MSG_PSTATE_READ_DONE);
+		write_pstate();
+		return true;
 	}
 
 	return res == EEPROM_OK;
@@ -267,9 +341,268 @@ static void load_default_pstate()
 {
 	g_pstate.adc_voltage_calibration_steps_x100_i16l = 0;
 	g_pstate.adc_voltage_calibration_steps_x100_i16h = 0;
+
+	g_pstate.hall_calibrated = 0;
+	memset(&g_pstate.hall_angles, 0, sizeof(g_pstate.hall_angles));
+
+	g_pstate.motor_baud_rate_u16l = 0;
+	g_pstate.motor_baud_rate_u16h = 0;
+
+	g_pstate.battery_soc_percent = 0xff;
+
+	g_pstate.torque_calibration_points = 0;
+	memset(&g_pstate.torque_calibration_adc, 0, sizeof(g_pstate.torque_calibration_adc));
+	memset(&g_pstate.torque_calibration_nm_x100, 0, sizeof(g_pstate.torque_calibration_nm_x100));
+}
+
+/*
+Trip state is written to the next slot of the active trip page on every save.
+When the active page is full writing continues from slot 0 of the other page,
+the spare page. Latest slot of a page is the last valid slot in a consecutive
+sequence from slot 0, sequence numbers continue across pages so latest of both
+pages is found at startup.
+
+Only the spare page is ever erased, never the page holding the latest valid
+slot, and only once a slot on the active page has been verified. It is erased
+at the first regular save after switching page so no erase is needed when
+saving at power down, there may not be enough time left for it.
+*/
+static bool read_trip()
+{
+	uint8_t slot_a, seq_a, slot_b, seq_b;
+	bool found_a = find_trip_slot(EEPROM_TRIP_PAGE_A, &slot_a, &seq_a);
+	bool found_b = find_trip_slot(EEPROM_TRIP_PAGE_B, &slot_b, &seq_b);
+
+	if (found_a && (!found_b || (int8_t)(seq_a - seq_b) > 0))
+	{
+		trip_page = EEPROM_TRIP_PAGE_A;
+		trip_slot = slot_a;
+		trip_seq = seq_a;
+	}
+	else if (found_b)
+	{
+		trip_page = EEPROM_TRIP_PAGE_B;
+		trip_slot = slot_b;
+		trip_seq = seq_b;
+	}
+	else
+	{
+		// next write goes to slot 0 of page A
+		trip_page = EEPROM_TRIP_PAGE_B;
+		trip_slot = TRIP_NUM_SLOTS - 1;
+		trip_seq = 0;
+	}
+
+	trip_spare_erased = is_trip_page_erased(trip_spare_page());
+
+	if (!found_a && !found_b)
+	{
+		return false;
+	}
+
+	return read_trip_slot(trip_page, trip_slot, &trip_seq);
+}
+
+static bool find_trip_slot(uint8_t page, uint8_t* slot, uint8_t* seq)
+{
+	uint8_t tmp;
+	bool found = false;
+
+	for (uint8_t i = 0; i < TRIP_NUM_SLOTS; ++i)
+	{
+		if (!read_trip_slot(page, i, &tmp))
+		{
+			break;
+		}
+
+		if (found && tmp != (uint8_t)(*seq + 1))
+		{
+			// older data from before wraparound
+			break;
+		}
+
+		found = true;
+		*slot = i;
+		*seq = tmp;
+	}
+
+	return found;
+}
+
+static bool read_trip_slot(uint8_t page, uint8_t slot, uint8_t* seq)
+{
+	int offset = slot * TRIP_SLOT_SIZE;
+	uint8_t* ptr = (uint8_t*)&g_trip;
+	uint8_t checksum = 0;
+	int data;
+
+	if (!eeprom_select_page(page))
+	{
+		return false;
+	}
+
+	data = eeprom_read_byte(offset++);
+	if (data < 0)
+	{
+		return false;
+	}
+	*seq = (uint8_t)data;
+	checksum += (uint8_t)data;
+
+	data = eeprom_read_byte(offset++);
+	if (data != TRIP_VERSION)
+	{
+		return false;
+	}
+	checksum += (uint8_t)data;
+
+	for (uint8_t i = 0; i < sizeof(trip_t); ++i)
+	{
+		data = eeprom_read_byte(offset++);
+		if (data < 0)
+		{
+			return false;
+		}
+
+		checksum += (uint8_t)data;
+		*ptr = (uint8_t)data;
+		++ptr;
+	}
+
+	// inverted checksum so that an erased page is never valid
+	data = eeprom_read_byte(offset);
+	return data == (uint8_t)~checksum;
+}
+
+static uint8_t trip_spare_page()
+{
+	return trip_page == EEPROM_TRIP_PAGE_A ? EEPROM_TRIP_PAGE_B : EEPROM_TRIP_PAGE_A;
 }
 
-static uint8_t read(uint8_t page, uint8_t version, uint8_t* dst, uint8_t size)
+static bool is_trip_page_erased(uint8_t page)
+{
+	if (!eeprom_select_page(page))
+	{
+		return false;
+	}
+
+	for (int i = 0; i < TRIP_NUM_SLOTS * TRIP_SLOT_SIZE; ++i)
+	{
+		if (eeprom_read_byte(i) != 0xff)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static bool erase_trip_spare_page()
+{
+	if (!eeprom_select_page(trip_spare_page()) || !eeprom_erase_page())
+	{
+		eventlog_write(EVT_ERROR_EEPROM_ERASE);
+		return false;
+	}
+
+	trip_spare_erased = true;
+	return true;
+}
+
+static bool write_trip(bool power_down)
+{
+	uint8_t seq = trip_seq + 1;
+	uint8_t slot = trip_slot + 1;
+
+	// Slot may contain a partial write from power loss, which cannot
+	// be overwritten without erase on all controllers, continue on spare page.
+	if (slot >= TRIP_NUM_SLOTS || !write_trip_slot(trip_page, slot, seq))
+	{
+		if (!trip_spare_erased && (power_down || !erase_trip_spare_page()))
+		{
+			eventlog_write(EVT_ERROR_EEPROM_WRITE);
+			return false;
+		}
+
+		if (!write_trip_slot(trip_spare_page(), 0, seq))
+		{
+			eventlog_write(EVT_ERROR_EEPROM_WRITE);
+			return false;
+		}
+
+		// previous page is now spare, holding older data
+		trip_page = trip_spare_page();
+		trip_spare_erased = false;
+		slot = 0;
+	}
+
+	trip_slot = slot;
+	trip_seq = seq;
+
+	// latest slot verified on active page, prepare spare page for next switch
+	if (!power_down && !trip_spare_erased)
+	{
+		erase_trip_spare_page();
+	}
+
+	return true;
+}
+
+static bool write_trip_slot(uint8_t page, uint8_t slot, uint8_t seq)
+{
+	uint8_t* ptr = (uint8_t*)&g_trip;
+	uint8_t checksum = seq + TRIP_VERSION;
+	int offset = slot * TRIP_SLOT_SIZE;
+	uint8_t i;
+
+	if (!eeprom_select_page(page))
+	{
+		return false;
+	}
+
+	bool res = eeprom_write_byte(offset, seq) &&
+		eeprom_write_byte(offset + 1, TRIP_VERSION);
+
+	for (i = 0; res && i < sizeof(trip_t); ++i)
+	{
+		res = eeprom_write_byte(offset + 2 + i, ptr[i]);
+		checksum += ptr[i];
+	}
+
+	res = res && eeprom_write_byte(offset + 2 + sizeof(trip_t), (uint8_t)~checksum);
+
+	eeprom_end_write();
+
+	// verify, flash cannot be written if not erased
+	res = res && eeprom_read_byte(offset) == seq &&
+		eeprom_read_byte(offset + 1) == TRIP_VERSION;
+
+	for (i = 0; res && i < sizeof(trip_t); ++i)
+	{
+		res = eeprom_read_byte(offset + 2 + i) == ptr[i];
+	}
+
+	res = res && eeprom_read_byte(offset + 2 + sizeof(trip_t)) == (uint8_t)~checksum;
+
+	return res;
+}
+
+static void load_default_trip()
+{
+	g_trip.odometer_m = 0;
+	g_trip.motor_on_s = 0;
+	g_trip.total_charge_mah = 0;
+	g_trip.total_energy_wh_x10 = 0;
+
+	g_trip.distance_m = 0;
+	g_trip.energy_wh_x10 = 0;
+	g_trip.max_speed_kph_x10 = 0;
+	g_trip.max_temperature_c = 0;
+
+	g_trip.consumption_wh_km_x10 = TRIP_DEFAULT_CONSUMPTION_WH_KM_X10;
+}
+
+static uint8_t read(uint8_t page, uint8_t version, uint8_t* dst, uint8_t size, bool allow_upgrade)
 {
 	uint8_t read_offset = 0;
 	uint8_t* ptr = 0;
@@ -295,12 +628,19 @@ static uint8_t read(uint8_t page, uint8_t version, uint8_t* dst, uint8_t size)
 	}
 
 	// verify header ok
+	bool upgrade = false;
 	if (header.version != version)
 	{
-		return EEPROM_ERROR_VERSION;
-	}
+		if (!allow_upgrade || header.version > version || header.length > size)
+		{
+			return EEPROM_ERROR_VERSION;
+		}
 
-	if (header.length != size)
+		// older version is a prefix of current data
+		upgrade = true;
+		size = header.length;
+	}
+	else if (header.length != size)
 	{
 		return EEPROM_ERROR_LENGHT;
 	}
@@ -327,7 +667,7 @@ static uint8_t read(uint8_t page, uint8_t version, uint8_t* dst, uint8_t size)
 		return EEPROM_ERROR_CHECKSUM;
 	}
 
-	return EEPROM_OK;
+	return upgrade ? EEPROM_OK_UPGRADED : EEPROM_OK;
 }
 
 static uint8_t write(uint8_t page, uint8_t version, uint8_t* src, uint8_t size)
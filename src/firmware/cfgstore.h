@@ -54,8 +54,15 @@
 #define LIGHTS_MODE_ALWAYS_ON			2
 #define LIGHTS_MODE_BRAKE_LIGHT			3
 
-#define CONFIG_VERSION					5
-#define PSTATE_VERSION					1
+#define CONFIG_VERSION					8
+#define PSTATE_VERSION					5
+#define TRIP_VERSION					2
+
+// Throttle response curve points at 0%, 5%, ..., 100% throttle.
+#define THROTTLE_CURVE_POINTS			21
+
+// Max number of torque sensor calibration points.
+#define TORQUE_CALIBRATION_POINTS		8
 
 
 typedef struct
@@ -83,6 +90,8 @@ typedef struct
 	uint8_t max_battery_x100v_u16h;
 	uint8_t low_cut_off_v;
 	uint8_t max_speed_kph;
+	uint8_t battery_capacity_ah_x10_u16l;
+	uint8_t battery_capacity_ah_x10_u16h;
 
 	// externals
 	uint8_t use_speed_sensor;
@@ -125,17 +134,62 @@ typedef struct
 	uint8_t assist_mode_select;
 	uint8_t assist_startup_level;
 	assist_level_t assist_levels[2][10];
+
+	// throttle response curve, motor current percent for each point
+	uint8_t throttle_curve[THROTTLE_CURVE_POINTS];
+
+	// throttle input filtering, 0 Hz disables low pass filter
+	uint8_t throttle_deadband_mv;
+	uint8_t throttle_filter_cutoff_hz;
 } config_t;
 
 typedef struct
 {
 	uint8_t adc_voltage_calibration_steps_x100_i16l;
 	uint8_t adc_voltage_calibration_steps_x100_i16h;
+
+	// learned motor rotor angle for each hall sensor state (1-6), only used when calibrated
+	uint8_t hall_calibrated;
+	uint8_t hall_angles[6];
+
+	// verified motor controller uart baud rate, 0 if not probed
+	uint8_t motor_baud_rate_u16l;
+	uint8_t motor_baud_rate_u16h;
+
+	// coulomb counted battery state of charge, 0xff if unknown
+	uint8_t battery_soc_percent;
+
+	// torque sensor calibration, adc steps above bias at known pedal torque,
+	// built in default table is used if less than 2 points are calibrated
+	uint8_t torque_calibration_points;
+	uint16_t torque_calibration_adc[TORQUE_CALIBRATION_POINTS];
+	uint16_t torque_calibration_nm_x100[TORQUE_CALIBRATION_POINTS];
 } pstate_t;
 
+// Trip state is saved often and stored wear levelled in two alternating
+// pages, data is reset to defaults when TRIP_VERSION changes.
+typedef struct
+{
+	// lifetime totals
+	uint32_t odometer_m;
+	uint32_t motor_on_s;
+	uint32_t total_charge_mah;
+	uint32_t total_energy_wh_x10;
+
+	// trip totals, can be reset from config tool
+	uint32_t distance_m;
+	uint32_t energy_wh_x10;
+	uint16_t max_speed_kph_x10;
+	uint8_t max_temperature_c;
+
+	// rolling average energy consumption
+	uint16_t consumption_wh_km_x10;
+} trip_t;
+
 
 extern config_t g_config;
 extern pstate_t g_pstate;
+extern trip_t g_trip;
 
 void cfgstore_init();
 
@@ -145,4 +199,9 @@ bool cfgstore_save_config();
 bool cfgstore_reset_pstate();
 bool cfgstore_save_pstate();
 
+bool cfgstore_reset_trip();
+// Set power_down when saving with little time left before power is lost,
+// save then never erases eeprom and is skipped if that would be required.
+bool cfgstore_save_trip(bool power_down);
+
 #endif
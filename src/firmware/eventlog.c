@@ -8,12 +8,34 @@
 
 #include "eventlog.h"
 #include "uart.h"
+#include "system.h"
 
 static bool is_enabled;
 
+static uint16_t trace_interval_ms[TRACE_SIGNALS];
+static uint16_t trace_deadband[TRACE_SIGNALS];
+static int16_t trace_last_value[TRACE_SIGNALS];
+static uint32_t trace_last_ms[TRACE_SIGNALS];
+
+static const uint8_t trace_event[TRACE_SIGNALS] =
+{
+	EVT_DATA_THROTTLE_ADC,
+	EVT_DATA_TORQUE_ADC,
+	EVT_DATA_CADENCE_RPM,
+	EVT_DATA_WHEEL_SPEED_RPM
+};
+
 void eventlog_init(bool enabled)
 {
 	is_enabled = enabled;
+
+	for (uint8_t i = 0; i < TRACE_SIGNALS; ++i)
+	{
+		trace_interval_ms[i] = 0;
+		trace_deadband[i] = 0;
+		trace_last_value[i] = 0;
+		trace_last_ms[i] = 0;
+	}
 }
 
 bool eventlog_is_enabled()
@@ -37,6 +59,7 @@ void eventlog_write(uint8_t evt)
 	uart_write(evt);
 	uart_write((uint8_t)0xee + evt);
 }
+
 void eventlog_write_data(uint8_t evt, int16_t data)
 {
 	if (!is_enabled)
@@ -52,3 +75,49 @@ void eventlog_write_data(uint8_t evt, int16_t data)
 	uart_write((uint8_t)data); checksum += (uint8_t)data;
 	uart_write(checksum);
 }
+
+bool eventlog_set_trace(uint8_t signal, uint16_t interval_ms, uint16_t deadband)
+{
+	if (signal >= TRACE_SIGNALS)
+	{
+		return false;
+	}
+
+	trace_interval_ms[signal] = interval_ms;
+	trace_deadband[signal] = deadband;
+	trace_last_ms[signal] = 0;
+
+	// force first value to be logged
+	trace_last_value[signal] = INT16_MIN;
+
+	return true;
+}
+
+void eventlog_trace(uint8_t signal, int16_t value)
+{
+	if (!is_enabled || trace_interval_ms[signal] == 0)
+	{
+		return;
+	}
+
+	uint32_t now = system_ms();
+	if ((now - trace_last_ms[signal]) < trace_interval_ms[signal])
+	{
+		return;
+	}
+
+	int32_t diff = (int32_t)value - trace_last_value[signal];
+	if (diff < 0)
+	{
+		diff = -diff;
+	}
+
+	if (diff <= trace_deadband[signal])
+	{
+		return;
+	}
+
+	trace_last_value[signal] = value;
+	trace_last_ms[signal] = now;
+	eventlog_write_data(trace_event[signal], value);
+}
@@ -24,6 +24,8 @@
 #define EVT_MSG_PSTATE_READ_DONE			8
 #define EVT_MSG_PSTATE_WRITE_BEGIN			9
 #define EVT_MSG_PSTATE_WRITE_DONE			10
+#define EVT_MSG_HALL_CALIBRATION_STARTED	11
+#define EVT_MSG_MOTOR_RECONNECT				12
 
 
 #define EVT_ERROR_INIT_MOTOR				64
@@ -43,6 +45,7 @@
 #define EVT_ERROR_WATCHDOG_TRIGGERED		77
 #define EVT_ERROR_EXTCOM_CHEKSUM			78
 #define EVT_ERROR_EXTCOM_DISCARD			79
+#define EVT_ERROR_HALL_CALIBRATION			80
 
 
 #define EVT_DATA_TARGET_CURRENT				128
@@ -66,6 +69,27 @@
 #define EVT_DATA_CALIBRATE_VOLTAGE			146
 #define EVT_DATA_TORQUE_ADC					147
 #define EVT_DATA_TORQUE_ADC_CALIBRATED		148
+#define EVT_DATA_HALL_CALIBRATION			149
+#define EVT_DATA_MOTOR_COM_ROUND_TRIP		150
+#define EVT_DATA_MOTOR_COM_LATENCY			151
+#define EVT_DATA_MOTOR_BAUD_RATE			152
+#define EVT_DATA_MOTOR_COM_REQUESTS_OK		153
+#define EVT_DATA_MOTOR_COM_REQUESTS_FAILED	154
+#define EVT_DATA_MOTOR_COM_LATENCY_SLOW		155
+#define EVT_DATA_BATTERY_RESISTANCE			156
+#define EVT_DATA_TEMPERATURE_PREDICTED		157
+#define EVT_DATA_CADENCE_RPM				158
+#define EVT_DATA_WHEEL_SPEED_RPM			159
+#define EVT_DATA_TORQUE_CALIBRATION			160
+#define EVT_DATA_TORQUE_BIAS_DRIFT			161
+
+
+// Traced signals, all disabled at startup.
+#define TRACE_THROTTLE_ADC					0
+#define TRACE_TORQUE_ADC					1
+#define TRACE_CADENCE_RPM_X10				2
+#define TRACE_WHEEL_SPEED_RPM_X10			3
+#define TRACE_SIGNALS						4
 
 
 void eventlog_init(bool enabled);
@@ -76,5 +100,11 @@ void eventlog_set_enabled(bool enabled);
 void eventlog_write(uint8_t evt);
 void eventlog_write_data(uint8_t evt, int16_t data);
 
+// Configure rate limit of a traced signal, interval 0 disables trace.
+// Value is logged when it differs more than deadband from last logged value
+// and at least interval_ms has passed since last logged.
+bool eventlog_set_trace(uint8_t signal, uint16_t interval_ms, uint16_t deadband);
+void eventlog_trace(uint8_t signal, int16_t value);
+
 
 #endif
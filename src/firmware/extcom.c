@@ -14,6 +14,7 @@
 #include "sensors.h"
 #include "motor.h"
 #include "battery.h"
+#include "trip.h"
 #include "app.h"
 #include "util.h"
 #include "version.h"
@@ -43,11 +44,31 @@
 #define OPCODE_READ_EVTLOG_ENABLE				0x02
 #define OPCODE_READ_CONFIG						0x03
 #define OPCODE_READ_STATUS						0x04
+#define OPCODE_READ_HALL_CALIBRATION			0x05
+#define OPCODE_READ_TRIP						0x06
 
 #define OPCODE_WRITE_EVTLOG_ENABLE				0xf0
 #define OPCODE_WRITE_CONFIG						0xf1
 #define OPCODE_WRITE_RESET_CONFIG				0xf2
 #define OPCODE_WRITE_ADC_VOLTAGE_CALIBRATION	0xf3
+#define OPCODE_WRITE_START_HALL_CALIBRATION		0xf4
+#define OPCODE_WRITE_RESET_TRIP					0xf5
+#define OPCODE_WRITE_TRACE						0xf6
+#define OPCODE_WRITE_TORQUE_CALIBRATION			0xf7
+
+// Multi byte values in responses are big endian (high byte first).
+//
+// Status response: motor status (u16), app status code, battery percent,
+// battery voltage x10 (u16), battery current x10 (u16), motor com error counters (u16),
+// measured temperature, predicted winding temperature.
+// Length is included in response, fields are only ever appended.
+#define STATUS_DATA_LENGTH						(10 + 2 * MOTOR_COM_ERROR_COUNTERS)
+
+// Trip response: odometer m, motor on s, total charge mAh, total energy Wh x10,
+// trip distance m, trip energy Wh x10 (all u32), trip max speed km/h x10 (u16),
+// trip max temperature, consumption Wh/km x10 (u16), remaining range km (u16).
+// Length is included in response, fields are only ever appended.
+#define TRIP_DATA_LENGTH						31
 
 
 // Bafang display communication
@@ -85,6 +106,8 @@ static uint32_t discard_until_ms;
 
 static uint8_t compute_checksum(uint8_t* buf, uint8_t length);
 static void write_uart_and_increment_checksum(uint8_t data, uint8_t* checksum);
+static void write_uart_u16_and_increment_checksum(uint16_t data, uint8_t* checksum);
+static void write_uart_u32_and_increment_checksum(uint32_t data, uint8_t* checksum);
 
 static int16_t try_process_request();
 static int16_t try_process_read_request();
@@ -97,11 +120,23 @@ static int16_t process_read_fw_version();
 static int16_t process_read_evtlog_enable();
 static int16_t process_read_config();
 static int16_t process_read_status();
+static int16_t process_read_trip();
+#if HAS_MOTOR_HALL_CALIBRATION
+static int16_t process_read_hall_calibration();
+#endif
 
 static int16_t process_write_evtlog_enable();
 static int16_t process_write_config();
 static int16_t process_write_reset_config();
 static int16_t process_write_adc_voltage_calibration();
+static int16_t process_write_reset_trip();
+static int16_t process_write_trace();
+#if HAS_TORQUE_SENSOR
+static int16_t process_write_torque_calibration();
+#endif
+#if HAS_MOTOR_HALL_CALIBRATION
+static int16_t process_write_start_hall_calibration();
+#endif
 
 
 static int16_t process_bafang_display_read_status();
@@ -211,6 +246,20 @@ static void write_uart_and_increment_checksum(uint8_t data, uint8_t* checksum)
 	uart_write(data);
 }
 
+// Multi byte values are sent big endian (high byte first)
+// as all other multi byte values in protocol.
+static void write_uart_u16_and_increment_checksum(uint16_t data, uint8_t* checksum)
+{
+	write_uart_and_increment_checksum((uint8_t)(data >> 8), checksum);
+	write_uart_and_increment_checksum((uint8_t)data, checksum);
+}
+
+static void write_uart_u32_and_increment_checksum(uint32_t data, uint8_t* checksum)
+{
+	write_uart_u16_and_increment_checksum((uint16_t)(data >> 16), checksum);
+	write_uart_u16_and_increment_checksum((uint16_t)data, checksum);
+}
+
 static int16_t try_process_request()
 {
 	if (msg_len < 1)
@@ -250,6 +299,12 @@ static int16_t try_process_read_request()
 		return process_read_config();
 	case OPCODE_READ_STATUS:
 		return process_read_status();
+	case OPCODE_READ_TRIP:
+		return process_read_trip();
+#if HAS_MOTOR_HALL_CALIBRATION
+	case OPCODE_READ_HALL_CALIBRATION:
+		return process_read_hall_calibration();
+#endif
 	}
 
 	return DISCARD;
@@ -272,6 +327,18 @@ static int16_t try_process_write_request()
 		return process_write_reset_config();
 	case OPCODE_WRITE_ADC_VOLTAGE_CALIBRATION:
 		return process_write_adc_voltage_calibration();
+	case OPCODE_WRITE_RESET_TRIP:
+		return process_write_reset_trip();
+	case OPCODE_WRITE_TRACE:
+		return process_write_trace();
+#if HAS_TORQUE_SENSOR
+	case OPCODE_WRITE_TORQUE_CALIBRATION:
+		return process_write_torque_calibration();
+#endif
+#if HAS_MOTOR_HALL_CALIBRATION
+	case OPCODE_WRITE_START_HALL_CALIBRATION:
+		return process_write_start_hall_calibration();
+#endif
 	}
 
 	return DISCARD;
@@ -419,10 +486,116 @@ static int16_t process_read_config()
 
 static int16_t process_read_status()
 {
-	// :TODO:
-	return 0;
+	if (msg_len < 3)
+	{
+		return KEEP;
+	}
+
+	if (compute_checksum(msgbuf, 2) == msgbuf[2])
+	{
+		uint16_t motor = motor_status();
+		uint16_t volt_x10 = motor_get_battery_voltage_x10();
+		uint16_t amp_x10 = motor_get_battery_current_x10();
+
+		uint8_t checksum = 0;
+		write_uart_and_increment_checksum(REQUEST_TYPE_READ, &checksum);
+		write_uart_and_increment_checksum(OPCODE_READ_STATUS, &checksum);
+		write_uart_and_increment_checksum(STATUS_DATA_LENGTH, &checksum);
+
+		write_uart_u16_and_increment_checksum(motor, &checksum);
+		write_uart_and_increment_checksum(app_get_status_code(), &checksum);
+		write_uart_and_increment_checksum(battery_get_percent(), &checksum);
+		write_uart_u16_and_increment_checksum(volt_x10, &checksum);
+		write_uart_u16_and_increment_checksum(amp_x10, &checksum);
+
+		for (uint8_t i = 0; i < MOTOR_COM_ERROR_COUNTERS; ++i)
+		{
+			write_uart_u16_and_increment_checksum(motor_get_com_errors(i), &checksum);
+		}
+
+		write_uart_and_increment_checksum(app_get_temperature(), &checksum);
+		write_uart_and_increment_checksum(app_get_predicted_temperature(), &checksum);
+
+		uart_write(checksum);
+	}
+	else
+	{
+		eventlog_write(EVT_ERROR_EXTCOM_CHEKSUM);
+		return DISCARD;
+	}
+
+	return 3;
 }
 
+static int16_t process_read_trip()
+{
+	if (msg_len < 3)
+	{
+		return KEEP;
+	}
+
+	if (compute_checksum(msgbuf, 2) == msgbuf[2])
+	{
+		uint8_t checksum = 0;
+		write_uart_and_increment_checksum(REQUEST_TYPE_READ, &checksum);
+		write_uart_and_increment_checksum(OPCODE_READ_TRIP, &checksum);
+		write_uart_and_increment_checksum(TRIP_DATA_LENGTH, &checksum);
+
+		write_uart_u32_and_increment_checksum(g_trip.odometer_m, &checksum);
+		write_uart_u32_and_increment_checksum(g_trip.motor_on_s, &checksum);
+		write_uart_u32_and_increment_checksum(g_trip.total_charge_mah, &checksum);
+		write_uart_u32_and_increment_checksum(g_trip.total_energy_wh_x10, &checksum);
+		write_uart_u32_and_increment_checksum(g_trip.distance_m, &checksum);
+		write_uart_u32_and_increment_checksum(g_trip.energy_wh_x10, &checksum);
+		write_uart_u16_and_increment_checksum(g_trip.max_speed_kph_x10, &checksum);
+		write_uart_and_increment_checksum(g_trip.max_temperature_c, &checksum);
+		write_uart_u16_and_increment_checksum(g_trip.consumption_wh_km_x10, &checksum);
+		write_uart_u16_and_increment_checksum(trip_get_range_km(), &checksum);
+
+		uart_write(checksum);
+	}
+	else
+	{
+		eventlog_write(EVT_ERROR_EXTCOM_CHEKSUM);
+		return DISCARD;
+	}
+
+	return 3;
+}
+
+#if HAS_MOTOR_HALL_CALIBRATION
+static int16_t process_read_hall_calibration()
+{
+	if (msg_len < 3)
+	{
+		return KEEP;
+	}
+
+	if (compute_checksum(msgbuf, 2) == msgbuf[2])
+	{
+		uint8_t checksum = 0;
+		write_uart_and_increment_checksum(REQUEST_TYPE_READ, &checksum);
+		write_uart_and_increment_checksum(OPCODE_READ_HALL_CALIBRATION, &checksum);
+		write_uart_and_increment_checksum(motor_get_hall_calibration_state(), &checksum);
+		write_uart_and_increment_checksum(g_pstate.hall_calibrated, &checksum);
+
+		for (uint8_t i = 0; i < MOTOR_HALL_STATES; ++i)
+		{
+			write_uart_and_increment_checksum(g_pstate.hall_angles[i], &checksum);
+		}
+
+		uart_write(checksum);
+	}
+	else
+	{
+		eventlog_write(EVT_ERROR_EXTCOM_CHEKSUM);
+		return DISCARD;
+	}
+
+	return 3;
+}
+#endif
+
 static int16_t process_write_evtlog_enable()
 {
 	if (msg_len < 4)
@@ -507,6 +680,32 @@ static int16_t process_write_reset_config()
 		uart_write(checksum);
 	}
 	else
+	{
+		eventlog_write(EVT_ERROR_EXTCOM_CHEKSUM);
+		return DISCARD;
+	}
+
+	return 3;
+}
+
+static int16_t process_write_reset_trip()
+{
+	if (msg_len < 3)
+	{
+		return KEEP;
+	}
+
+	if (compute_checksum(msgbuf, 2) == msgbuf[2])
+	{
+		bool res = trip_reset();
+
+		uint8_t checksum = 0;
+		write_uart_and_increment_checksum(REQUEST_TYPE_WRITE, &checksum);
+		write_uart_and_increment_checksum(OPCODE_WRITE_RESET_TRIP, &checksum);
+		write_uart_and_increment_checksum((uint8_t)res, &checksum);
+		uart_write(checksum);
+	}
+	else
 	{
 		eventlog_write(EVT_ERROR_EXTCOM_CHEKSUM);
 		return DISCARD;
@@ -515,6 +714,80 @@ static int16_t process_write_reset_config()
 	return 3;
 }
 
+static int16_t process_write_trace()
+{
+	if (msg_len < 8)
+	{
+		return KEEP;
+	}
+
+	if (compute_checksum(msgbuf, 7) == msgbuf[7])
+	{
+		uint16_t interval_ms = ((uint16_t)msgbuf[3] << 8) | msgbuf[4];
+		uint16_t deadband = ((uint16_t)msgbuf[5] << 8) | msgbuf[6];
+
+		bool res = eventlog_set_trace(msgbuf[2], interval_ms, deadband);
+
+		uint8_t checksum = 0;
+		write_uart_and_increment_checksum(REQUEST_TYPE_WRITE, &checksum);
+		write_uart_and_increment_checksum(OPCODE_WRITE_TRACE, &checksum);
+		write_uart_and_increment_checksum(msgbuf[2], &checksum);
+		write_uart_and_increment_checksum((uint8_t)res, &checksum);
+		uart_write(checksum);
+	}
+	else
+	{
+		eventlog_write(EVT_ERROR_EXTCOM_CHEKSUM);
+		return DISCARD;
+	}
+
+	return 8;
+}
+
+#if HAS_TORQUE_SENSOR
+static int16_t process_write_torque_calibration()
+{
+	if (msg_len < 6)
+	{
+		return KEEP;
+	}
+
+	if (compute_checksum(msgbuf, 5) == msgbuf[5])
+	{
+		uint8_t index = msgbuf[2];
+		uint16_t nm_x100 = ((uint16_t)msgbuf[3] << 8) | msgbuf[4];
+
+		// records current torque sensor reading for known torque applied on pedal
+		bool res = torque_sensor_calibrate(index, nm_x100);
+		if (res)
+		{
+			res = cfgstore_save_pstate();
+		}
+
+		uint16_t adc = 0;
+		if (res && index < TORQUE_CALIBRATION_POINTS)
+		{
+			adc = g_pstate.torque_calibration_adc[index];
+		}
+
+		uint8_t checksum = 0;
+		write_uart_and_increment_checksum(REQUEST_TYPE_WRITE, &checksum);
+		write_uart_and_increment_checksum(OPCODE_WRITE_TORQUE_CALIBRATION, &checksum);
+		write_uart_and_increment_checksum(index, &checksum);
+		write_uart_and_increment_checksum((uint8_t)res, &checksum);
+		write_uart_u16_and_increment_checksum(adc, &checksum);
+		uart_write(checksum);
+	}
+	else
+	{
+		eventlog_write(EVT_ERROR_EXTCOM_CHEKSUM);
+		return DISCARD;
+	}
+
+	return 6;
+}
+#endif
+
 static int16_t process_write_adc_voltage_calibration()
 {
 	if (msg_len < 5)
@@ -549,6 +822,36 @@ static int16_t process_write_adc_voltage_calibration()
 }
 
 
+#if HAS_MOTOR_HALL_CALIBRATION
+static int16_t process_write_start_hall_calibration()
+{
+	if (msg_len < 3)
+	{
+		return KEEP;
+	}
+
+	if (compute_checksum(msgbuf, 2) == msgbuf[2])
+	{
+		// runs in background, result is polled with OPCODE_READ_HALL_CALIBRATION
+		bool res = motor_start_hall_calibration();
+
+		uint8_t checksum = 0;
+		write_uart_and_increment_checksum(REQUEST_TYPE_WRITE, &checksum);
+		write_uart_and_increment_checksum(OPCODE_WRITE_START_HALL_CALIBRATION, &checksum);
+		write_uart_and_increment_checksum((uint8_t)res, &checksum);
+		uart_write(checksum);
+	}
+	else
+	{
+		eventlog_write(EVT_ERROR_EXTCOM_CHEKSUM);
+		return DISCARD;
+	}
+
+	return 3;
+}
+#endif
+
+
 static int16_t process_bafang_display_read_status()
 {
 	if (msg_len < 2)
@@ -676,6 +979,9 @@ static int16_t process_bafang_display_read_range()
 
 		value = ((290u * value) + 5050u) / 100u;
 	}
+#elif DISPLAY_RANGE_FIELD_DATA == DISPLAY_RANGE_FIELD_RANGE
+	// display converts to miles if configured
+	value = trip_get_range_km();
 #elif DISPLAY_RANGE_FIELD_DATA == DISPLAY_RANGE_FIELD_POWER
 	if (app_get_lights())
 	{
@@ -34,6 +34,20 @@
 	#define HAS_SHIFT_SENSOR_SUPPORT			0
 #endif
 
+// Hall sensor angles can be learned by rotating the motor open loop,
+// only possible when motor control is implemented in this firmware.
+#if defined(TSDZ2)
+	#define HAS_MOTOR_HALL_CALIBRATION			1
+#else
+	#define HAS_MOTOR_HALL_CALIBRATION			0
+#endif
+
+// Experimental, probe if motor controller MCU on BBSHD/BBS02 responds at
+// higher baud rate than the 4800 used by original firmware. Fastest verified
+// rate is stored in persisted state and used on following startups,
+// falls back to 4800 if motor controller stops responding.
+#define HAS_MOTOR_BAUD_RATE_PROBE				0
+
 #if defined(BBS02)
 	#define MAX_CADENCE_RPM_X10					1500
 #elif defined(BBSHD)
@@ -61,6 +75,19 @@
 // max temperature.
 #define MAX_TEMPERATURE_LOW_CURRENT_PERCENT		30
 
+// First order thermal model predicting winding temperature ahead of the
+// temperature sensors from I^2 heating of battery current.
+// Steady state temperature rise above sensor is I^2 * GAIN / 100 (degC),
+// approached with HEAT time constant and decaying with COOL time constant.
+#define THERMAL_MODEL_INTERVAL_MS				100
+#define THERMAL_MODEL_GAIN_X100					2
+#define THERMAL_MODEL_HEAT_TAU_S				60
+#define THERMAL_MODEL_COOL_TAU_S				120
+
+// Current ramp down based on predicted temperature starts at
+// MAX_TEMPERATURE - 15, wider than for measured temperature.
+#define THERMAL_MODEL_RAMP_DOWN_INTERVAL		15
+
 // No battery percent mapping
 #define BATTERY_PERCENT_MAP_NONE				0
 // Map battery percent to provide a linear relationship on the
@@ -73,10 +100,66 @@
 // Time with no motor load until battery voltage is updated to avoid voltage sag.
 #define BATTERY_NO_LOAD_DELAY_MS		1000
 
+// Battery internal resistance estimation. Resistance is computed from the
+// voltage drop between a low current reference and a higher current,
+// both held stable for BATTERY_RESISTANCE_SETTLE_MS.
+#define BATTERY_RESISTANCE_SAMPLE_INTERVAL_MS	100
+#define BATTERY_RESISTANCE_SETTLE_MS			1000
+#define BATTERY_RESISTANCE_REF_TIMEOUT_MS		30000
+#define BATTERY_RESISTANCE_STABLE_CURRENT_X10	10
+#define BATTERY_RESISTANCE_LOW_CURRENT_X10		20
+#define BATTERY_RESISTANCE_MIN_DELTA_CURRENT_X10	50
+
+// Limits and initial value for estimated battery internal resistance (incl. wiring).
+#define BATTERY_RESISTANCE_MIN_MOHM				10
+#define BATTERY_RESISTANCE_MAX_MOHM				500
+#define BATTERY_RESISTANCE_DEFAULT_MOHM			100
+
+// Battery over voltage protection (TSDZ2), motor outputs are disabled when
+// bus voltage rises above this (e.g. from energy returned by braking).
+// Fixed controller limit, not the configured max battery voltage which is only
+// used for display. Above a full 14S pack (58.8V), below 63V capacitor rating.
+#if defined(TSDZ2)
+	#define HIGH_VOLTAGE_LIMIT_X100V			6100
+	#define HIGH_VOLTAGE_HYSTERESIS_X100V		100
+#endif
+
 // Padding values for voltage range of battery.
 #define BATTERY_FULL_OFFSET_PERCENT		8
 #define BATTERY_EMPTY_OFFSET_PERCENT	8
 
+// Interval for integrating battery current when battery capacity is configured.
+#define BATTERY_COULOMB_SAMPLE_INTERVAL_MS		100
+
+// Coulomb counted SOC is re-anchored to voltage based SOC if they differ more than
+// BATTERY_SOC_ANCHOR_DIFF_PERCENT after no motor load for BATTERY_SOC_ANCHOR_REST_MS.
+#define BATTERY_SOC_ANCHOR_REST_MS				60000
+#define BATTERY_SOC_ANCHOR_DIFF_PERCENT			10
+
+// Coulomb counted SOC is persisted when there is no motor load
+// and it has changed at least this much since last saved.
+#define BATTERY_SOC_SAVE_DIFF_PERCENT			2
+
+// Interval for integrating trip energy and distance.
+#define TRIP_SAMPLE_INTERVAL_MS					100
+
+// Energy consumption estimate is updated for every TRIP_CONSUMPTION_SEGMENT_M
+// travelled, filtered over about TRIP_CONSUMPTION_FILTER_SEGMENTS segments.
+#define TRIP_CONSUMPTION_SEGMENT_M				1000
+#define TRIP_CONSUMPTION_FILTER_SEGMENTS		8
+
+// Consumption estimate used until first segment has been travelled.
+#define TRIP_DEFAULT_CONSUMPTION_WH_KM_X10		150
+
+// Trip state is saved when stopped with brake applied if travelled at least
+// TRIP_SAVE_DISTANCE_M or motor has been on TRIP_SAVE_MOTOR_ON_S since last save.
+#define TRIP_SAVE_DISTANCE_M					500
+#define TRIP_SAVE_MOTOR_ON_S					60
+
+// Trip state is saved on any change when battery voltage drops below this
+// percentage of low voltage cutoff, i.e. when battery is switched off.
+#define TRIP_POWER_DOWN_VOLTAGE_PERCENT			80
+
 // Battery SOC percentage when current ramp down starts.
 #define LVC_RAMP_DOWN_OFFSET_PERCENT			10
 
@@ -91,6 +174,17 @@
 // and be at 50% of assist target current when reaching 50.
 #define SPEED_LIMIT_RAMP_DOWN_INTERVAL_KPH		3
 
+// Pedaling is considered stopped when no PAS pulse has been received
+// for this many times the last pulse period, but not earlier than
+// PAS_STOP_MIN_DELAY_MS. Configured PAS stop delay is the upper limit.
+#define PAS_STOP_PERIOD_FACTOR					3
+#define PAS_STOP_MIN_DELAY_MS					100
+
+// Look ahead time when accelerating towards speed limit.
+// Speed limit ramp down is applied on the speed predicted this far ahead
+// based on current acceleration in order to reduce overshoot.
+#define SPEED_LIMIT_LOOKAHEAD_MS				500
+
 // Current ramp down (e.g. when releasing throttle, stop pedaling etc.) in percent per 10 millisecond.
 // Specifying 1 will make ramp down periond 1 second if releasing from full throttle.
 // Set to 100 to disable
@@ -100,6 +194,8 @@
 #define WALK_MODE_SPEED_KPH						4
 
 
+// Default throttle response curve when config is reset,
+// the curve can be changed from the config tool.
 #define THROTTLE_RESPONSE_LINEAR				1
 #define THROTTLE_RESPONSE_QUADRATIC				2
 #define THROTTLE_RESPONSE_CUSTOM				3
@@ -142,6 +238,15 @@
 // configured value.
 #define TORQUE_POWER_LOWER_RPM_X10				300
 
+// Torque used for torque pas assist. Torque is averaged per PAS pulse,
+// pulse averages are then averaged over a sliding window, including
+// the pulse in progress.
+#define TORQUE_AVERAGING_NONE					0	// instantaneous reading
+#define TORQUE_AVERAGING_REVOLUTION				1	// smooth, mean over last pedal revolution
+#define TORQUE_AVERAGING_HALF_REVOLUTION		2	// responsive, mean over last half pedal revolution
+
+#define TORQUE_AVERAGING						TORQUE_AVERAGING_HALF_REVOLUTION
+
 // Number of PAS sensor pulses to engage cruise mode,
 // there are 24 pulses per revolution.
 #define CRUISE_ENGAGE_PAS_PULSES				PAS_PULSES_REVOLUTION / 2
@@ -151,11 +256,11 @@
 #define CRUISE_DISENGAGE_PAS_PULSES				PAS_PULSES_REVOLUTION / 2
 
 
-// Option to control what data is displayed in "Range" field on display
-// since range calculation is not implemented.
+// Option to control what data is displayed in "Range" field on display.
 #define DISPLAY_RANGE_FIELD_ZERO				0
 #define DISPLAY_RANGE_FIELD_TEMPERATURE			1	// max temperature of controller / motor
 #define DISPLAY_RANGE_FIELD_POWER				2	// requested current x10 (lights off) / actual current x10 (lights on)
+#define DISPLAY_RANGE_FIELD_RANGE				3	// estimated remaining range (km), requires battery capacity to be configured
 
 // uncomment and select option above
 // #define DISPLAY_RANGE_FIELD_DATA		DISPLAY_RANGE_FIELD_ZERO
@@ -14,6 +14,7 @@
 #include "eventlog.h"
 #include "app.h"
 #include "battery.h"
+#include "trip.h"
 #include "watchdog.h"
 #include "adc.h"
 #include "motor.h"
@@ -56,9 +57,13 @@ void main(void)
 	pas_set_stop_delay((uint16_t)g_config.pas_stop_delay_x100s * 10);
 
 	battery_init();
+	trip_init();
 	throttle_init(
 		EXPAND_U16(g_config.throttle_start_voltage_mv_u16h, g_config.throttle_start_voltage_mv_u16l),
-		EXPAND_U16(g_config.throttle_end_voltage_mv_u16h, g_config.throttle_end_voltage_mv_u16l)
+		EXPAND_U16(g_config.throttle_end_voltage_mv_u16h, g_config.throttle_end_voltage_mv_u16l),
+		g_config.throttle_deadband_mv,
+		g_config.throttle_filter_cutoff_hz,
+		g_config.throttle_curve
 	);
 
 	motor_init(g_config.max_current_amps * 1000, g_config.low_cut_off_v,
@@ -81,6 +86,7 @@ void main(void)
 			next_app_proccess = now + APP_PROCESS_INTERVAL_MS;
 
 			battery_process();
+			trip_process();
 			sensors_process();
 			extcom_process();
 			app_process();
@@ -9,13 +9,36 @@
 #ifndef _MOTOR_H_
 #define _MOTOR_H_
 
+#include "intellisense.h"
 #include <stdint.h>
+#include <stdbool.h>
+#include "fwconfig.h"
 
 #define MOTOR_ERROR_LVC				0x0800
+#define MOTOR_ERROR_HVC				0x0400
 #define MOTOR_ERROR_HALL_SENSOR		0x2000
 #define MOTOR_ERROR_CURRENT_SENSE	0x0004
 #define MOTOR_ERROR_POWER_RESET		0x0020
 
+#define MOTOR_HALL_CALIBRATION_IDLE		0
+#define MOTOR_HALL_CALIBRATION_RUNNING	1
+#define MOTOR_HALL_CALIBRATION_OK		2
+#define MOTOR_HALL_CALIBRATION_FAILED	3
+
+// Number of entries in learned hall sensor angle table (hall state 1-6)
+#define MOTOR_HALL_STATES				6
+
+// Error counters for communication with separate motor controller MCU (BBSHD/BBS02),
+// always zero when motor control is implemented in this firmware.
+#define MOTOR_COM_ERROR_TARGET_CURRENT	0
+#define MOTOR_COM_ERROR_TARGET_SPEED	1
+#define MOTOR_COM_ERROR_READ_STATUS		2
+#define MOTOR_COM_ERROR_READ_CURRENT	3
+#define MOTOR_COM_ERROR_READ_VOLTAGE	4
+#define MOTOR_COM_ERROR_CONNECT			5
+#define MOTOR_COM_ERROR_SKIPPED_BYTES	6
+#define MOTOR_COM_ERROR_COUNTERS		7
+
 void motor_pre_init();
 void motor_init(uint16_t max_current_mA, uint8_t lvc_V, int16_t adc_calib_volt_step_offset);
 
@@ -31,10 +54,23 @@ uint8_t motor_get_target_current();
 void motor_set_target_speed(uint8_t percent);
 void motor_set_target_current(uint8_t percent);
 
+// Current limiting based on motor readings (e.g. LVC, thermal) is active,
+// readings from motor controller are refreshed more often when set.
+void motor_set_limiting_active(bool active);
+
 int16_t motor_calibrate_battery_voltage(uint16_t actual_voltage_x100);
 
+#if HAS_MOTOR_HALL_CALIBRATION
+// Rotates motor open loop at low current and learns hall sensor angles,
+// result is stored in pstate when done. Only allowed when motor is stopped.
+bool motor_start_hall_calibration();
+uint8_t motor_get_hall_calibration_state();
+#endif
+
 uint16_t motor_get_battery_lvc_x10();
 uint16_t motor_get_battery_current_x10();
 uint16_t motor_get_battery_voltage_x10();
 
+uint16_t motor_get_com_errors(uint8_t counter);
+
 #endif
@@ -14,6 +14,8 @@
 #include <stdint.h>
 #include <stdbool.h>
 
+#define TORQUE_CALIBRATION_RESET	0xff
+
 void sensors_init();
 void sensors_process();
 
@@ -26,10 +28,20 @@ bool pas_is_pedaling_backwards();
 void speed_sensor_set_signals_per_rpm(uint8_t num_signals);
 bool speed_sensor_is_moving();
 uint16_t speed_sensor_get_rpm_x10();
+int16_t speed_sensor_get_acceleration_rpm_x10_per_s();
+uint16_t speed_sensor_get_pulse_counter();
 
 uint16_t torque_sensor_get_nm_x100();
+uint16_t torque_sensor_get_revolution_nm_x100();
+uint16_t torque_sensor_get_half_revolution_nm_x100();
+uint16_t torque_sensor_get_revolution_peak_nm_x100();
 bool torque_sensor_ok();
 
+// Record current torque sensor reading as calibration point at known torque,
+// points must be recorded in order of increasing torque starting at index 0.
+// Index TORQUE_CALIBRATION_RESET clears calibration.
+bool torque_sensor_calibrate(uint8_t index, uint16_t nm_x100);
+
 int16_t temperature_contr_x100();
 int16_t temperature_motor_x100();
 
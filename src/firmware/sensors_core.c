@@ -0,0 +1,442 @@
+/*
+ * bbs-fw
+ *
+ * Copyright (C) Daniel Nilsson, 2022.
+ *
+ * Released under the GPL License, Version 3
+ */
+
+#include "sensors_core.h"
+#include "sensors.h"
+#include "system.h"
+#include "fwconfig.h"
+#include "util.h"
+
+// Edge decoding runs in interrupt context, see sensors_core_*_edge/idle.
+// WARNING:
+// No 16/32 bit or float computations in these (multiply/divide/modulo),
+// they are called from the bbsx timer interrupt.
+// Read SDCC compiler manual for more info.
+
+// Speed is averaged over one wheel revolution (one period per magnet)
+// to cancel out uneven magnet spacing. Between pulses the speed is
+// limited to what the elapsed time allows so that it decays
+// when the wheel slows down instead of holding the last value.
+
+// Cadence is extrapolated between PAS pulses in the same way,
+// and pedaling is considered stopped when no pulse has been seen for
+// a multiple of the last period, see PAS_STOP_PERIOD_FACTOR.
+
+// PAS glitch filter, edges faster than 500rpm are rejected. Disabled on
+// BBSHD/BBS02 where it has never been enabled for the sampled PAS signal.
+#if defined(BBSHD) || defined(BBS02)
+#define PAS_SENSOR_GLITCH_FILTER		0
+#else
+#define PAS_SENSOR_GLITCH_FILTER		1
+#endif
+
+#define PAS_SENSOR_MIN_PULSE_TICKS		((sensor_ticks_t)(60000000ul / 500 / PAS_PULSES_REVOLUTION / SENSOR_TICK_US))	// 500rpm limit
+
+#define SPEED_SENSOR_MIN_PULSE_TICKS	((sensor_ticks_t)(50000ul / SENSOR_TICK_US))
+#define SPEED_SENSOR_TIMEOUT_TICKS		((sensor_ticks_t)(2500000ul / SENSOR_TICK_US))
+
+#define SPEED_HISTORY_SIZE				10	// max configurable wheel sensor signals
+#define SPEED_ACCELERATION_FILTER		4
+
+
+// shared with interrupt context
+static volatile uint16_t pas_pulse_counter;
+static volatile bool pas_direction_backward;
+static volatile bool pas_running;
+static volatile sensor_ticks_t pas_period_ticks;	// 0 if no valid period measured
+static volatile sensor_ticks_t pas_stop_delay_ticks;
+
+static volatile bool speed_running;
+static volatile sensor_ticks_t speed_period_ticks;	// 0 if no valid period measured
+static volatile uint16_t speed_pulse_counter;
+
+// main loop only
+static uint16_t pas_last_pulse_counter;
+static uint32_t pas_last_pulse_ms;
+static uint32_t pas_last_period_us;
+static uint16_t pas_cadence_rpm_x10;
+
+static uint8_t speed_ticks_per_rpm;
+static uint32_t speed_periods_us[SPEED_HISTORY_SIZE];
+static uint8_t speed_history_idx;
+static uint8_t speed_history_count;
+static uint16_t speed_last_pulse_counter;
+static uint32_t speed_last_pulse_ms;
+static uint32_t speed_last_period_us;
+static uint16_t speed_avg_rpm_x10;
+static uint16_t speed_rpm_x10;
+static int16_t speed_acceleration_rpm_x10_per_s;
+
+
+static uint16_t compute_revolution_average_rpm_x10()
+{
+	uint8_t num = speed_ticks_per_rpm;
+	if (num > speed_history_count)
+	{
+		num = speed_history_count;
+	}
+
+	uint32_t sum = 0;
+	uint8_t idx = speed_history_idx;
+	uint8_t i;
+	for (i = 0; i < num; ++i)
+	{
+		idx = idx > 0 ? idx - 1 : SPEED_HISTORY_SIZE - 1;
+		sum += speed_periods_us[idx];
+	}
+
+	uint32_t avg_period_us = sum / num;
+	if (avg_period_us == 0)
+	{
+		return 0;
+	}
+
+	return (uint16_t)(600000000ul / avg_period_us / speed_ticks_per_rpm);
+}
+
+static void speed_reset()
+{
+	speed_history_idx = 0;
+	speed_history_count = 0;
+	speed_last_period_us = 0;
+	speed_avg_rpm_x10 = 0;
+	speed_rpm_x10 = 0;
+	speed_acceleration_rpm_x10_per_s = 0;
+}
+
+
+void sensors_core_init()
+{
+	pas_pulse_counter = 0;
+	pas_direction_backward = false;
+	pas_running = false;
+	pas_period_ticks = 0;
+	pas_stop_delay_ticks = (sensor_ticks_t)(1500000ul / SENSOR_TICK_US);
+
+	speed_running = false;
+	speed_period_ticks = 0;
+	speed_pulse_counter = 0;
+
+	pas_last_pulse_counter = 0;
+	pas_last_pulse_ms = 0;
+	pas_last_period_us = 0;
+	pas_cadence_rpm_x10 = 0;
+
+	speed_ticks_per_rpm = 1;
+	speed_last_pulse_counter = 0;
+	speed_last_pulse_ms = 0;
+	speed_reset();
+}
+
+static void process_pas(uint16_t pulse_counter, uint32_t period_us)
+{
+	uint32_t now_ms = system_ms();
+
+	if (period_us == 0)
+	{
+		// not pedaling or first pulse after pedals has been still
+		pas_last_pulse_counter = pulse_counter;
+		pas_last_pulse_ms = now_ms;
+		pas_last_period_us = 0;
+		pas_cadence_rpm_x10 = 0;
+		return;
+	}
+
+	if (pulse_counter != pas_last_pulse_counter || pas_last_period_us == 0)
+	{
+		pas_last_pulse_counter = pulse_counter;
+		pas_last_pulse_ms = now_ms;
+		pas_last_period_us = period_us;
+	}
+
+	pas_cadence_rpm_x10 = (uint16_t)((600000000ul / PAS_PULSES_REVOLUTION) / pas_last_period_us);
+
+	uint32_t elapsed_us = (now_ms - pas_last_pulse_ms) * 1000;
+	if (elapsed_us > pas_last_period_us)
+	{
+		uint32_t stop_us = pas_last_period_us * PAS_STOP_PERIOD_FACTOR;
+		if (stop_us < PAS_STOP_MIN_DELAY_MS * 1000ul)
+		{
+			stop_us = PAS_STOP_MIN_DELAY_MS * 1000ul;
+		}
+
+		if (elapsed_us > stop_us)
+		{
+			pas_cadence_rpm_x10 = 0;
+		}
+		else
+		{
+			// cadence can at most be what corresponds to the elapsed time
+			uint16_t max_rpm_x10 = (uint16_t)((600000000ul / PAS_PULSES_REVOLUTION) / elapsed_us);
+			if (max_rpm_x10 < pas_cadence_rpm_x10)
+			{
+				pas_cadence_rpm_x10 = max_rpm_x10;
+			}
+		}
+	}
+}
+
+static void process_speed(uint16_t pulse_counter, uint32_t period_us)
+{
+	uint32_t now_ms = system_ms();
+
+	if (period_us == 0)
+	{
+		// not moving or first pulse after standstill
+		if (speed_history_count > 0)
+		{
+			speed_reset();
+		}
+
+		speed_last_pulse_counter = pulse_counter;
+		speed_last_pulse_ms = now_ms;
+		return;
+	}
+
+	if (pulse_counter != speed_last_pulse_counter)
+	{
+		uint16_t prev_avg_rpm_x10 = speed_avg_rpm_x10;
+		uint16_t period_ms = (uint16_t)(period_us / 1000);
+
+		speed_periods_us[speed_history_idx] = period_us;
+		speed_history_idx = (speed_history_idx + 1) % SPEED_HISTORY_SIZE;
+		if (speed_history_count < SPEED_HISTORY_SIZE)
+		{
+			speed_history_count++;
+		}
+
+		speed_avg_rpm_x10 = compute_revolution_average_rpm_x10();
+
+		if (prev_avg_rpm_x10 > 0 && period_ms > 0)
+		{
+			// change of revolution average over the last pulse period
+			int32_t acceleration = ((int32_t)speed_avg_rpm_x10 - prev_avg_rpm_x10) * 1000 / period_ms;
+			acceleration = EXPONENTIAL_FILTER((int32_t)speed_acceleration_rpm_x10_per_s, acceleration, SPEED_ACCELERATION_FILTER);
+
+			if (acceleration > INT16_MAX)
+			{
+				acceleration = INT16_MAX;
+			}
+			else if (acceleration < INT16_MIN)
+			{
+				acceleration = INT16_MIN;
+			}
+
+			speed_acceleration_rpm_x10_per_s = (int16_t)acceleration;
+		}
+
+		speed_last_pulse_counter = pulse_counter;
+		speed_last_pulse_ms = now_ms;
+		speed_last_period_us = period_us;
+	}
+
+	speed_rpm_x10 = speed_avg_rpm_x10;
+
+	// No pulse for longer than last period means wheel is slowing down,
+	// speed can at most be what corresponds to the elapsed time.
+	uint32_t elapsed_us = (now_ms - speed_last_pulse_ms) * 1000;
+	if (elapsed_us > speed_last_period_us)
+	{
+		uint16_t max_rpm_x10 = (uint16_t)(600000000ul / elapsed_us / speed_ticks_per_rpm);
+		if (max_rpm_x10 < speed_rpm_x10)
+		{
+			speed_rpm_x10 = max_rpm_x10;
+			if (speed_acceleration_rpm_x10_per_s > 0)
+			{
+				speed_acceleration_rpm_x10_per_s = 0;
+			}
+		}
+	}
+}
+
+
+void sensors_core_process()
+{
+	uint16_t pas_counter, speed_counter;
+	sensor_ticks_t pas_period, speed_period;
+
+	sensors_disable_interrupts();
+	pas_counter = pas_pulse_counter;
+	pas_period = pas_period_ticks;
+	speed_counter = speed_pulse_counter;
+	speed_period = speed_period_ticks;
+	sensors_enable_interrupts();
+
+	process_pas(pas_counter, (uint32_t)pas_period * SENSOR_TICK_US);
+	process_speed(speed_counter, (uint32_t)speed_period * SENSOR_TICK_US);
+}
+
+
+void pas_set_stop_delay(uint16_t delay_ms)
+{
+	sensor_ticks_t ticks = (sensor_ticks_t)(delay_ms * (1000ul / SENSOR_TICK_US));
+
+	sensors_disable_interrupts();
+	pas_stop_delay_ticks = ticks;
+	sensors_enable_interrupts();
+}
+
+uint16_t pas_get_pulse_counter()
+{
+	uint16_t tmp;
+	sensors_disable_interrupts();
+	tmp = pas_pulse_counter;
+	sensors_enable_interrupts();
+
+	return tmp;
+}
+
+bool pas_is_pedaling_forwards()
+{
+	bool direction_backward;
+	sensors_disable_interrupts();
+	direction_backward = pas_direction_backward;
+	sensors_enable_interrupts();
+
+	return pas_cadence_rpm_x10 > 0 && !direction_backward;
+}
+
+bool pas_is_pedaling_backwards()
+{
+	bool direction_backward;
+	sensors_disable_interrupts();
+	direction_backward = pas_direction_backward;
+	sensors_enable_interrupts();
+
+	return pas_cadence_rpm_x10 > 0 && direction_backward;
+}
+
+uint16_t pas_get_cadence_rpm_x10()
+{
+	return pas_cadence_rpm_x10;
+}
+
+void speed_sensor_set_signals_per_rpm(uint8_t num_signals)
+{
+	if (num_signals < 1)
+	{
+		num_signals = 1;
+	}
+
+	speed_ticks_per_rpm = num_signals;
+}
+
+bool speed_sensor_is_moving()
+{
+	sensor_ticks_t tmp;
+	sensors_disable_interrupts();
+	tmp = speed_period_ticks;
+	sensors_enable_interrupts();
+
+	return tmp > 0;
+}
+
+uint16_t speed_sensor_get_pulse_counter()
+{
+	uint16_t tmp;
+	sensors_disable_interrupts();
+	tmp = speed_pulse_counter;
+	sensors_enable_interrupts();
+
+	return tmp;
+}
+
+uint16_t speed_sensor_get_rpm_x10()
+{
+	return speed_rpm_x10;
+}
+
+int16_t speed_sensor_get_acceleration_rpm_x10_per_s()
+{
+	return speed_acceleration_rpm_x10_per_s;
+}
+
+
+#if defined(BBSHD) || defined(BBS02)
+#pragma save
+#pragma nooverlay // See SDCC manual about function calls in ISR
+#endif
+bool sensors_core_pas_edge(bool pas2, sensor_ticks_t elapsed)
+{
+#if PAS_SENSOR_GLITCH_FILTER
+	if (pas_running && elapsed < PAS_SENSOR_MIN_PULSE_TICKS)
+	{
+		// glitch, ignore edge
+		return false;
+	}
+#endif
+
+	pas_pulse_counter++;
+
+	if (pas_direction_backward != pas2)
+	{
+		pas_direction_backward = pas2;
+
+		// Reset pas pulse counter if pedal direction is changed,
+		// this variable counts the number of pulses since start of pedaling session.
+		pas_pulse_counter = 0;
+	}
+
+	if (pas_running && elapsed <= pas_stop_delay_ticks)
+	{
+		pas_period_ticks = elapsed; // save in order to be able to calculate rpm when needed
+	}
+	else
+	{
+		// first pulse after pedals has been still, no period to measure yet
+		pas_period_ticks = 0;
+	}
+
+	pas_running = true;
+	return true;
+}
+
+void sensors_core_pas_idle(sensor_ticks_t elapsed)
+{
+	if (pas_running && elapsed > pas_stop_delay_ticks)
+	{
+		pas_running = false;
+		pas_period_ticks = 0;
+		pas_pulse_counter = 0;
+		pas_direction_backward = false;
+	}
+}
+
+bool sensors_core_speed_edge(sensor_ticks_t elapsed)
+{
+	if (speed_running && elapsed < SPEED_SENSOR_MIN_PULSE_TICKS)
+	{
+		// debounce
+		return false;
+	}
+
+	if (speed_running && elapsed <= SPEED_SENSOR_TIMEOUT_TICKS)
+	{
+		speed_period_ticks = elapsed;
+	}
+	else
+	{
+		speed_period_ticks = 0;
+	}
+
+	speed_running = true;
+	speed_pulse_counter++;
+	return true;
+}
+
+void sensors_core_speed_idle(sensor_ticks_t elapsed)
+{
+	if (speed_running && elapsed > SPEED_SENSOR_TIMEOUT_TICKS)
+	{
+		speed_running = false;
+		speed_period_ticks = 0;
+	}
+}
+#if defined(BBSHD) || defined(BBS02)
+#pragma restore
+#endif
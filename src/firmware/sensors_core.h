@@ -0,0 +1,52 @@
+/*
+ * bbs-fw
+ *
+ * Copyright (C) Daniel Nilsson, 2022.
+ *
+ * Released under the GPL License, Version 3
+ */
+
+#ifndef _SENSORS_CORE_H_
+#define _SENSORS_CORE_H_
+
+#include "intellisense.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Target independent PAS and speed sensor decoding.
+// Target specific sensors implementation detects rising edges on
+// the sensor pins and reports them together with the number of
+// ticks elapsed since the previous accepted edge.
+
+#if defined(BBSHD) || defined(BBS02)
+typedef uint16_t sensor_ticks_t;
+#define SENSOR_TICK_US		100		// pins sampled in 100us timer interrupt
+#elif defined(TSDZ2)
+typedef uint32_t sensor_ticks_t;
+#define SENSOR_TICK_US		1		// edge interrupts with us timestamp
+#endif
+
+void sensors_core_init();
+
+// Call from sensors_process, computes cadence and speed.
+void sensors_core_process();
+
+// Called from interrupt context.
+// Returns false if edge is rejected (glitch/debounce), in which case
+// the elapsed ticks should keep counting from the previous edge.
+bool sensors_core_pas_edge(bool pas2, sensor_ticks_t elapsed);
+bool sensors_core_speed_edge(sensor_ticks_t elapsed);
+
+// Called with ticks elapsed since last accepted edge when no edge is detected,
+// handles stop/timeout. Called from interrupt context (bbsx) or from main loop
+// (TSDZ2), an edge interrupting it at timeout at most restarts pulse counting.
+void sensors_core_pas_idle(sensor_ticks_t elapsed);
+void sensors_core_speed_idle(sensor_ticks_t elapsed);
+
+// Implemented by target sensors, masks sensor interrupts
+// while state shared with interrupt context is accessed.
+void sensors_disable_interrupts();
+void sensors_enable_interrupts();
+
+#endif
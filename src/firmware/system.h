@@ -24,5 +24,10 @@ void system_init();
 uint32_t system_ms();
 void system_delay_ms(uint16_t ms);
 
+#if defined(TSDZ2)
+// Microsecond timestamp, wraps around after ~71 minutes.
+uint32_t system_us();
+#endif
+
 #endif
 
@@ -0,0 +1,277 @@
+/*
+ * bbs-fw
+ *
+ * Copyright (C) Daniel Nilsson, 2022.
+ *
+ * Released under the GPL License, Version 3
+ */
+
+#include "fake_motor_mcu.h"
+#include "motor.h"
+
+// must match bbsx/motor.c
+#define OPCODE_LVC				0x60
+#define OPCODE_MAX_CURRENT		0x61
+#define OPCODE_TARGET_SPEED		0x63
+#define OPCODE_TARGET_CURRENT	0x64
+#define OPCODE_HELLO			0x67
+#define OPCODE_READ_STATUS		0x40
+#define OPCODE_READ_CURRENT		0x41
+#define OPCODE_READ_VOLTAGE		0x42
+
+void fake_mcu_init(fake_motor_mcu_t* mcu, uint32_t seed)
+{
+	mcu->baud_rate = 4800;
+	// actual response header of motor controller is unknown, any value works
+	// as long as firmware does not depend on a specific value
+	mcu->header = 0x51;
+	mcu->latency_min_us = 2000;
+	mcu->latency_max_us = 4000;
+	mcu->drop_rx_per_mille = 0;
+	mcu->drop_tx_per_mille = 0;
+	mcu->bad_checksum_per_mille = 0;
+	mcu->bad_header_per_mille = 0;
+	mcu->status = 0;
+	mcu->voltage_adc = 0;
+	mcu->current_adc = 0;
+
+	mcu->request_len = 0;
+	mcu->last_rx_us = 0;
+	mcu->tx_head = 0;
+	mcu->tx_tail = 0;
+	mcu->tx_busy_until_us = 0;
+
+	mcu->requests = 0;
+	mcu->requests_bad = 0;
+	mcu->responses = 0;
+	mcu->bytes_dropped = 0;
+	mcu->power_resets = 0;
+
+	mcu->rng = seed ? seed : 1;
+
+	fake_mcu_power_on(mcu);
+	mcu->status &= ~MOTOR_ERROR_POWER_RESET;
+	mcu->power_resets = 0;
+}
+
+void fake_mcu_power_off(fake_motor_mcu_t* mcu)
+{
+	mcu->powered = false;
+	mcu->request_len = 0;
+	mcu->tx_head = mcu->tx_tail;
+}
+
+void fake_mcu_power_on(fake_motor_mcu_t* mcu)
+{
+	mcu->powered = true;
+	mcu->configured = false;
+	mcu->target_current = 0;
+	mcu->target_speed = 0;
+	mcu->lvc_adc = 0;
+	mcu->max_current_adc = 0;
+	mcu->status |= MOTOR_ERROR_POWER_RESET;
+	++mcu->power_resets;
+}
+
+uint32_t fake_mcu_random(fake_motor_mcu_t* mcu, uint32_t n)
+{
+	// xorshift32
+	uint32_t x = mcu->rng;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	mcu->rng = x;
+
+	return n ? x % n : 0;
+}
+
+static uint8_t checksum(const uint8_t* frame, uint8_t len)
+{
+	uint8_t sum = 0;
+	for (uint8_t i = 1; i < len - 1; ++i)
+	{
+		sum += frame[i];
+	}
+
+	return sum;
+}
+
+static uint8_t request_length(uint8_t opcode)
+{
+	switch (opcode)
+	{
+	case OPCODE_LVC:
+		return 5;
+	case OPCODE_READ_STATUS:
+	case OPCODE_READ_CURRENT:
+	case OPCODE_READ_VOLTAGE:
+		return 3;
+	default:
+		return 4;
+	}
+}
+
+static void send_response(fake_motor_mcu_t* mcu, uint8_t opcode, uint16_t data, bool two_bytes, uint32_t now_us)
+{
+	uint8_t frame[5];
+	uint8_t len = 0;
+
+	frame[len++] = mcu->header;
+	frame[len++] = opcode;
+	if (two_bytes)
+	{
+		frame[len++] = (uint8_t)(data >> 8);
+	}
+	frame[len++] = (uint8_t)data;
+	frame[len++] = 0;
+	frame[len - 1] = checksum(frame, len);
+
+	if (fake_mcu_random(mcu, 1000) < mcu->bad_checksum_per_mille)
+	{
+		frame[len - 1] ^= 0x5a;
+	}
+
+	if (fake_mcu_random(mcu, 1000) < mcu->bad_header_per_mille)
+	{
+		frame[0] ^= 0xa5;
+	}
+
+	uint32_t byte_us = 10000000UL / mcu->baud_rate;
+	uint32_t latency = mcu->latency_min_us;
+	if (mcu->latency_max_us > mcu->latency_min_us)
+	{
+		latency += fake_mcu_random(mcu, mcu->latency_max_us - mcu->latency_min_us + 1);
+	}
+
+	uint32_t t = now_us + latency;
+	if (t < mcu->tx_busy_until_us)
+	{
+		t = mcu->tx_busy_until_us;
+	}
+
+	for (uint8_t i = 0; i < len; ++i)
+	{
+		t += byte_us;
+		if (fake_mcu_random(mcu, 1000) < mcu->drop_tx_per_mille)
+		{
+			++mcu->bytes_dropped;
+			continue;
+		}
+
+		uint8_t next = (uint8_t)((mcu->tx_head + 1) % FAKE_MCU_QUEUE_SIZE);
+		if (next != mcu->tx_tail)
+		{
+			mcu->tx[mcu->tx_head].byte = frame[i];
+			mcu->tx[mcu->tx_head].time_us = t;
+			mcu->tx_head = next;
+		}
+	}
+
+	mcu->tx_busy_until_us = t;
+	++mcu->responses;
+}
+
+static void process_request(fake_motor_mcu_t* mcu, uint32_t now_us)
+{
+	uint8_t* req = mcu->request;
+	uint8_t opcode = req[1];
+
+	++mcu->requests;
+
+	if (checksum(req, mcu->request_len) != req[mcu->request_len - 1])
+	{
+		++mcu->requests_bad;
+		return;
+	}
+
+	switch (opcode)
+	{
+	case OPCODE_HELLO:
+		send_response(mcu, opcode, req[2], false, now_us);
+		break;
+	case OPCODE_LVC:
+		mcu->lvc_adc = ((uint16_t)req[2] << 8) | req[3];
+		send_response(mcu, opcode, mcu->lvc_adc, true, now_us);
+		break;
+	case OPCODE_MAX_CURRENT:
+		// last configuration request
+		mcu->max_current_adc = req[2];
+		mcu->configured = true;
+		mcu->status &= ~MOTOR_ERROR_POWER_RESET;
+		send_response(mcu, opcode, req[2], false, now_us);
+		break;
+	case OPCODE_TARGET_CURRENT:
+		if (mcu->configured)
+		{
+			mcu->target_current = req[2];
+		}
+		send_response(mcu, opcode, req[2], false, now_us);
+		break;
+	case OPCODE_TARGET_SPEED:
+		if (mcu->configured)
+		{
+			mcu->target_speed = req[2];
+		}
+		send_response(mcu, opcode, req[2], false, now_us);
+		break;
+	case OPCODE_READ_STATUS:
+		send_response(mcu, opcode, mcu->status, true, now_us);
+		break;
+	case OPCODE_READ_CURRENT:
+		send_response(mcu, opcode, mcu->current_adc, false, now_us);
+		break;
+	case OPCODE_READ_VOLTAGE:
+		send_response(mcu, opcode, mcu->voltage_adc, true, now_us);
+		break;
+	default:
+		// unknown configuration parameters
+		send_response(mcu, opcode, req[2], false, now_us);
+		break;
+	}
+}
+
+void fake_mcu_receive(fake_motor_mcu_t* mcu, uint8_t byte, uint32_t baud_rate, uint32_t now_us)
+{
+	if (!mcu->powered)
+	{
+		return;
+	}
+
+	if (baud_rate != mcu->baud_rate || fake_mcu_random(mcu, 1000) < mcu->drop_rx_per_mille)
+	{
+		// lost or garbled
+		++mcu->bytes_dropped;
+		return;
+	}
+
+	if (mcu->request_len > 0 && now_us - mcu->last_rx_us > FAKE_MCU_REQUEST_GAP_US)
+	{
+		mcu->request_len = 0;
+	}
+	mcu->last_rx_us = now_us;
+
+	if (mcu->request_len == 0 && byte != 0xaa)
+	{
+		return;
+	}
+
+	mcu->request[mcu->request_len++] = byte;
+	if (mcu->request_len >= 2 && mcu->request_len == request_length(mcu->request[1]))
+	{
+		process_request(mcu, now_us);
+		mcu->request_len = 0;
+	}
+}
+
+bool fake_mcu_transmit(fake_motor_mcu_t* mcu, uint32_t now_us, uint8_t* byte)
+{
+	if (mcu->tx_tail == mcu->tx_head || (int32_t)(now_us - mcu->tx[mcu->tx_tail].time_us) < 0)
+	{
+		return false;
+	}
+
+	*byte = mcu->tx[mcu->tx_tail].byte;
+	mcu->tx_tail = (uint8_t)((mcu->tx_tail + 1) % FAKE_MCU_QUEUE_SIZE);
+
+	return true;
+}
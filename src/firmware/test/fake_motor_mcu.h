@@ -0,0 +1,97 @@
+/*
+ * bbs-fw
+ *
+ * Copyright (C) Daniel Nilsson, 2022.
+ *
+ * Released under the GPL License, Version 3
+ */
+
+#ifndef _TEST_FAKE_MOTOR_MCU_H_
+#define _TEST_FAKE_MOTOR_MCU_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "intellisense.h"
+
+// Scriptable fake of the BBSHD/BBS02 motor controller MCU for host tests,
+// answers requests from bbsx/motor.c on a modelled uart link.
+//
+// Request:  0xaa, opcode, [data], checksum
+// Response: header, opcode, data (1 or 2 bytes), checksum
+// Checksum is the sum of all bytes except first and last.
+//
+// Behavior of the real MCU which is not known is modelled as:
+// * Partial request is discarded after FAKE_MCU_REQUEST_GAP_US without bytes.
+// * Requests with bad checksum are not answered.
+// * Set requests are answered with the data echoed.
+// * After power on status reports MOTOR_ERROR_POWER_RESET and targets are
+//   ignored until configured again (hello followed by max current).
+
+#define FAKE_MCU_QUEUE_SIZE			64
+#define FAKE_MCU_REQUEST_GAP_US		5000
+
+typedef struct
+{
+	uint8_t byte;
+	uint32_t time_us;	// time when last bit has arrived at receiver
+} fake_mcu_wire_byte_t;
+
+typedef struct
+{
+	// script, can be changed while running
+	uint32_t baud_rate;
+	uint8_t header;
+	uint32_t latency_min_us;			// from request received until response starts
+	uint32_t latency_max_us;
+	uint16_t drop_rx_per_mille;			// request bytes lost on the way to motor mcu
+	uint16_t drop_tx_per_mille;			// response bytes lost on the way to controller
+	uint16_t bad_checksum_per_mille;	// responses sent with corrupted checksum
+	uint16_t bad_header_per_mille;		// responses sent with corrupted header, valid checksum
+	uint16_t status;
+	uint16_t voltage_adc;
+	uint8_t current_adc;
+
+	// motor mcu state
+	bool powered;
+	bool configured;
+	uint8_t target_current;
+	uint8_t target_speed;
+	uint16_t lvc_adc;
+	uint8_t max_current_adc;
+
+	// request parser
+	uint8_t request[8];
+	uint8_t request_len;
+	uint32_t last_rx_us;
+
+	// response bytes on the wire to controller
+	fake_mcu_wire_byte_t tx[FAKE_MCU_QUEUE_SIZE];
+	uint8_t tx_head;
+	uint8_t tx_tail;
+	uint32_t tx_busy_until_us;
+
+	// statistics
+	uint32_t requests;
+	uint32_t requests_bad;
+	uint32_t responses;
+	uint32_t bytes_dropped;
+	uint32_t power_resets;
+
+	uint32_t rng;
+} fake_motor_mcu_t;
+
+void fake_mcu_init(fake_motor_mcu_t* mcu, uint32_t seed);
+
+void fake_mcu_power_off(fake_motor_mcu_t* mcu);
+void fake_mcu_power_on(fake_motor_mcu_t* mcu);
+
+// Request byte from controller has arrived, sent at given baud rate.
+void fake_mcu_receive(fake_motor_mcu_t* mcu, uint8_t byte, uint32_t baud_rate, uint32_t now_us);
+
+// Next response byte which has arrived at controller by now, false if none.
+bool fake_mcu_transmit(fake_motor_mcu_t* mcu, uint32_t now_us, uint8_t* byte);
+
+// Deterministic pseudo random number in [0, n)
+uint32_t fake_mcu_random(fake_motor_mcu_t* mcu, uint32_t n);
+
+#endif
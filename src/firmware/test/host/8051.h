@@ -0,0 +1,121 @@
+/*
+ * bbs-fw
+ *
+ * Copyright (C) Daniel Nilsson, 2022.
+ *
+ * Released under the GPL License, Version 3
+ */
+
+// Host replacement of SDCC <8051.h> for host tests, special function
+// registers are plain variables. Defined in stc15_host.c (HOST_DEFINE_SFR).
+
+#ifndef _TEST_HOST_8051_H_
+#define _TEST_HOST_8051_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#undef SFR
+#undef SBIT
+#undef SFR16
+
+#ifdef HOST_DEFINE_SFR
+	#define SFR(name, addr)			volatile unsigned char name
+	#define SBIT(name, addr, bit)	volatile bool name
+	#define SFR16(name, addr)		volatile unsigned short name
+#else
+	#define SFR(name, addr)			extern volatile unsigned char name
+	#define SBIT(name, addr, bit)	extern volatile bool name
+	#define SFR16(name, addr)		extern volatile unsigned short name
+#endif
+
+SFR(P0, 0);
+SFR(SP, 0);
+SFR(DPL, 0);
+SFR(DPH, 0);
+SFR(PCON, 0);
+SFR(TCON, 0);
+SFR(TMOD, 0);
+SFR(TL0, 0);
+SFR(TL1, 0);
+SFR(TH0, 0);
+SFR(TH1, 0);
+SFR(P1, 0);
+SFR(SCON, 0);
+SFR(SBUF, 0);
+SFR(P2, 0);
+SFR(IE, 0);
+SFR(P3, 0);
+SFR(IP, 0);
+SFR(PSW, 0);
+SFR(ACC, 0);
+SFR(B, 0);
+
+SBIT(EA, 0, 0);
+SBIT(ET0, 0, 0);
+SBIT(ET1, 0, 0);
+SBIT(EX0, 0, 0);
+SBIT(EX1, 0, 0);
+SBIT(ES, 0, 0);
+SBIT(TR0, 0, 0);
+SBIT(TR1, 0, 0);
+SBIT(TF0, 0, 0);
+SBIT(TF1, 0, 0);
+SBIT(IT0, 0, 0);
+SBIT(IT1, 0, 0);
+SBIT(IE0, 0, 0);
+SBIT(IE1, 0, 0);
+SBIT(SM0, 0, 0);
+SBIT(SM1, 0, 0);
+SBIT(SM2, 0, 0);
+SBIT(REN, 0, 0);
+SBIT(TB8, 0, 0);
+SBIT(RB8, 0, 0);
+SBIT(TI, 0, 0);
+SBIT(RI, 0, 0);
+SBIT(PT0, 0, 0);
+SBIT(PT1, 0, 0);
+SBIT(PX0, 0, 0);
+SBIT(PX1, 0, 0);
+SBIT(PS, 0, 0);
+SBIT(CY, 0, 0);
+SBIT(AC, 0, 0);
+SBIT(F0, 0, 0);
+SBIT(RS1, 0, 0);
+SBIT(RS0, 0, 0);
+SBIT(OV, 0, 0);
+SBIT(P, 0, 0);
+SBIT(P0_0, 0, 0);
+SBIT(P0_1, 0, 0);
+SBIT(P0_2, 0, 0);
+SBIT(P0_3, 0, 0);
+SBIT(P0_4, 0, 0);
+SBIT(P0_5, 0, 0);
+SBIT(P0_6, 0, 0);
+SBIT(P0_7, 0, 0);
+SBIT(P1_0, 0, 0);
+SBIT(P1_1, 0, 0);
+SBIT(P1_2, 0, 0);
+SBIT(P1_3, 0, 0);
+SBIT(P1_4, 0, 0);
+SBIT(P1_5, 0, 0);
+SBIT(P1_6, 0, 0);
+SBIT(P1_7, 0, 0);
+SBIT(P2_0, 0, 0);
+SBIT(P2_1, 0, 0);
+SBIT(P2_2, 0, 0);
+SBIT(P2_3, 0, 0);
+SBIT(P2_4, 0, 0);
+SBIT(P2_5, 0, 0);
+SBIT(P2_6, 0, 0);
+SBIT(P2_7, 0, 0);
+SBIT(P3_0, 0, 0);
+SBIT(P3_1, 0, 0);
+SBIT(P3_2, 0, 0);
+SBIT(P3_3, 0, 0);
+SBIT(P3_4, 0, 0);
+SBIT(P3_5, 0, 0);
+SBIT(P3_6, 0, 0);
+SBIT(P3_7, 0, 0);
+
+#endif
@@ -0,0 +1,78 @@
+/*
+ * bbs-fw
+ *
+ * Copyright (C) Daniel Nilsson, 2022.
+ *
+ * Released under the GPL License, Version 3
+ */
+
+// Host replacement of SDCC <stc12.h> for host tests, see 8051.h.
+
+#ifndef _TEST_HOST_STC12_H_
+#define _TEST_HOST_STC12_H_
+
+#include <8051.h>
+
+SFR(P4, 0);
+SFR(P5, 0);
+SFR(AUXR, 0);
+SFR(AUXR1, 0);
+SFR(CLK_DIV, 0);
+SFR(P0M0, 0);
+SFR(P0M1, 0);
+SFR(P1M0, 0);
+SFR(P1M1, 0);
+SFR(P2M0, 0);
+SFR(P2M1, 0);
+SFR(P3M0, 0);
+SFR(P3M1, 0);
+SFR(P4M0, 0);
+SFR(P4M1, 0);
+SFR(P5M0, 0);
+SFR(P5M1, 0);
+SFR(P1ASF, 0);
+SFR(ADC_CONTR, 0);
+SFR(ADC_RES, 0);
+SFR(ADC_RESL, 0);
+SFR(IAP_DATA, 0);
+SFR(IAP_ADDRH, 0);
+SFR(IAP_ADDRL, 0);
+SFR(IAP_CMD, 0);
+SFR(IAP_TRIG, 0);
+SFR(IAP_CONTR, 0);
+SFR(WDT_CONTR, 0);
+SFR(S2CON, 0);
+SFR(S2BUF, 0);
+SFR(IE2, 0);
+SFR(IP2, 0);
+SFR(BRT, 0);
+SFR(WAKE_CLKO, 0);
+SFR(CCON, 0);
+SFR(CMOD, 0);
+SFR(CCAPM0, 0);
+SFR(CCAPM1, 0);
+SFR(CL, 0);
+SFR(CH, 0);
+SFR(CCAP0L, 0);
+SFR(CCAP0H, 0);
+SFR(CCAP1L, 0);
+SFR(CCAP1H, 0);
+SFR(PCA_PWM0, 0);
+SFR(PCA_PWM1, 0);
+
+SBIT(P4_0, 0, 0);
+SBIT(P4_1, 0, 0);
+SBIT(P4_2, 0, 0);
+SBIT(P4_3, 0, 0);
+SBIT(P4_4, 0, 0);
+SBIT(P4_5, 0, 0);
+SBIT(P4_6, 0, 0);
+SBIT(P4_7, 0, 0);
+SBIT(P5_0, 0, 0);
+SBIT(P5_1, 0, 0);
+SBIT(P5_2, 0, 0);
+SBIT(P5_3, 0, 0);
+SBIT(P5_6, 0, 0);
+SBIT(P5_7, 0, 0);
+
+#endif
@@ -0,0 +1,202 @@
+/*
+ * bbs-fw
+ *
+ * Copyright (C) Daniel Nilsson, 2022.
+ *
+ * Released under the GPL License, Version 3
+ */
+
+#include "motor_model_tsdz2.h"
+#include "tsdz2/pins.h"
+#include "tsdz2/stm8.h"
+#include "tsdz2/stm8s/stm8s_tim1.h"
+
+#define PWM_PERIOD_S				0.000064f
+#define PWM_COMPARE_RANGE			512.0f
+
+// must match tsdz2/motor.c
+#define ADC_STEPS_PER_VOLT			(5953.0f / 512.0f)
+#define ADC_AMPS_PER_STEP			(80.0f / 512.0f)
+
+// Hall states in forward rotation, first state starts
+// at electrical angle 244 (330 degrees, default hall angle table).
+static const uint8_t hall_sequence[6] = { 4, 6, 2, 3, 1, 5 };
+#define HALL_SEQUENCE_START_ANGLE	244.0f
+
+void motor_model_init(motor_model_t* m, float battery_ocv_v)
+{
+	m->battery_ocv_v = battery_ocv_v;
+	m->battery_r_ohm = 0.15f;
+	m->bms_charge_enabled = true;
+	m->bus_capacitance_f = 0.001f;
+	m->phase_r_ohm = 0.15f;
+	m->phase_l_h = 0.00015f;
+	m->ke_v_per_erps = 0.09f;
+	m->inertia = 0.00012f;
+	m->friction = 0.0000002f;
+	m->load_torque = 0.0f;
+
+	m->brake = false;
+
+	m->bus_v = battery_ocv_v;
+	m->phase_current_a = 0.0f;
+	m->battery_current_a = 0.0f;
+	m->erps = 0.0f;
+	m->angle = 0.0f;
+	m->outputs_enabled = false;
+
+	m->max_bus_v = battery_ocv_v;
+	m->returned_energy_j = 0.0f;
+
+	// brake is active low, hall sensors at angle 0
+	motor_model_step(m);
+}
+
+static uint16_t compare_value(uint8_t high, uint8_t low)
+{
+	return ((uint16_t)high << 8) | low;
+}
+
+static float modulation_index()
+{
+	uint16_t a = compare_value(TIM1->CCR1H, TIM1->CCR1L);
+	uint16_t b = compare_value(TIM1->CCR2H, TIM1->CCR2L);
+	uint16_t c = compare_value(TIM1->CCR3H, TIM1->CCR3L);
+
+	uint16_t max = a;
+	uint16_t min = a;
+	if (b > max) max = b;
+	if (b < min) min = b;
+	if (c > max) max = c;
+	if (c < min) min = c;
+
+	return (max - min) / PWM_COMPARE_RANGE;
+}
+
+static void write_hall_sensors(uint8_t state)
+{
+	GPIOE->IDR = (GPIOE->IDR & ~GPIO_PIN_5) | ((state & 0x01) ? GPIO_PIN_5 : 0);
+	GPIOD->IDR = (GPIOD->IDR & ~GPIO_PIN_2) | ((state & 0x02) ? GPIO_PIN_2 : 0);
+	GPIOC->IDR = (GPIOC->IDR & ~GPIO_PIN_5) | ((state & 0x04) ? GPIO_PIN_5 : 0);
+}
+
+static void write_battery_current(float amps)
+{
+	// current sense is unidirectional
+	float steps = amps > 0.0f ? amps / ADC_AMPS_PER_STEP : 0.0f;
+	uint16_t adc = steps > 1023.0f ? 1023 : (uint16_t)steps;
+
+	ADC1->DB5RH = (uint8_t)(adc >> 2);
+	ADC1->DB5RL = (uint8_t)(adc & 0x03);
+}
+
+static void write_battery_voltage(uint16_t adc)
+{
+	ADC1->DB6RH = (uint8_t)(adc >> 2);
+	ADC1->DB6RL = (uint8_t)(adc & 0x03);
+}
+
+void motor_model_step(motor_model_t* m)
+{
+	const uint8_t phases = TIM1_CCER1_CC1E | TIM1_CCER1_CC1NE | TIM1_CCER1_CC2E | TIM1_CCER1_CC2NE;
+	m->outputs_enabled = (TIM1->CCER1 & phases) == phases &&
+		(TIM1->CCER2 & (TIM1_CCER2_CC3E | TIM1_CCER2_CC3NE)) == (TIM1_CCER2_CC3E | TIM1_CCER2_CC3NE);
+
+	float back_emf = m->ke_v_per_erps * m->erps;
+
+	// electrical
+	if (m->outputs_enabled)
+	{
+		float duty = modulation_index();
+		float di = (duty * m->bus_v - back_emf - m->phase_r_ohm * m->phase_current_a) / m->phase_l_h;
+		m->phase_current_a += di * PWM_PERIOD_S;
+		m->battery_current_a = duty * m->phase_current_a;
+	}
+	else if (m->phase_current_a != 0.0f || back_emf > m->bus_v)
+	{
+		// outputs off, current commutates to body diodes and returns to bus,
+		// back-emf above bus voltage is rectified
+		float diode_v = m->phase_current_a > 0.0f ? -m->bus_v : m->bus_v;
+		float last = m->phase_current_a;
+		float di = (diode_v - back_emf - m->phase_r_ohm * m->phase_current_a) / m->phase_l_h;
+		m->phase_current_a += di * PWM_PERIOD_S;
+
+		if ((last > 0.0f && m->phase_current_a < 0.0f) ||
+			(last < 0.0f && m->phase_current_a > 0.0f && back_emf <= m->bus_v))
+		{
+			m->phase_current_a = 0.0f;
+		}
+
+		m->battery_current_a = m->phase_current_a > 0.0f ? -m->phase_current_a : m->phase_current_a;
+	}
+	else
+	{
+		m->phase_current_a = 0.0f;
+		m->battery_current_a = 0.0f;
+	}
+
+	// bus capacitors, battery branch
+	float battery_branch_a = (m->battery_ocv_v - m->bus_v) / m->battery_r_ohm;
+	if (battery_branch_a < 0.0f && !m->bms_charge_enabled)
+	{
+		battery_branch_a = 0.0f;
+	}
+
+	m->bus_v += (battery_branch_a - m->battery_current_a) * PWM_PERIOD_S / m->bus_capacitance_f;
+	if (m->bus_v > m->max_bus_v)
+	{
+		m->max_bus_v = m->bus_v;
+	}
+
+	if (m->battery_current_a < 0.0f)
+	{
+		m->returned_energy_j -= m->battery_current_a * m->bus_v * PWM_PERIOD_S;
+	}
+
+	// mechanical
+	float torque = m->ke_v_per_erps * m->phase_current_a - m->friction * m->erps;
+	if (m->erps > 0.0f)
+	{
+		torque -= m->load_torque;
+	}
+
+	m->erps += torque * PWM_PERIOD_S / m->inertia;
+	if (m->erps < 0.0f)
+	{
+		// motor drives chainring through freewheel, cannot turn backwards
+		m->erps = 0.0f;
+	}
+
+	m->angle += m->erps * 256.0f * PWM_PERIOD_S;
+	while (m->angle >= 256.0f)
+	{
+		m->angle -= 256.0f;
+	}
+
+	// sensor inputs
+	float sector_angle = m->angle - HALL_SEQUENCE_START_ANGLE;
+	if (sector_angle < 0.0f)
+	{
+		sector_angle += 256.0f;
+	}
+
+	write_hall_sensors(hall_sequence[(uint8_t)(sector_angle * 6.0f / 256.0f) % 6]);
+
+	if (m->brake)
+	{
+		GET_PORT(PIN_BRAKE)->IDR &= (uint8_t)~GET_PIN(PIN_BRAKE);
+	}
+	else
+	{
+		GET_PORT(PIN_BRAKE)->IDR |= GET_PIN(PIN_BRAKE);
+	}
+
+	write_battery_current(m->battery_current_a);
+	write_battery_voltage(motor_model_adc_battery_voltage(m));
+}
+
+uint16_t motor_model_adc_battery_voltage(const motor_model_t* m)
+{
+	float steps = m->bus_v * ADC_STEPS_PER_VOLT;
+	return steps > 1023.0f ? 1023 : (uint16_t)steps;
+}
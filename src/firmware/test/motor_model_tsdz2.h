@@ -0,0 +1,65 @@
+/*
+ * bbs-fw
+ *
+ * Copyright (C) Daniel Nilsson, 2022.
+ *
+ * Released under the GPL License, Version 3
+ */
+
+#ifndef _TEST_MOTOR_MODEL_TSDZ2_H_
+#define _TEST_MOTOR_MODEL_TSDZ2_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Lumped model of TSDZ2 motor, bus capacitors and battery driven by the
+// TIM1 registers written in tsdz2/motor.c, one step per pwm cycle (64us).
+//
+// Motor is modelled as its dc equivalent: applied voltage is the spread of
+// the three phase compare values times bus voltage, back-emf and torque are
+// proportional to erps. With outputs disabled current commutates through the
+// body diodes back to the bus. Battery is an open circuit voltage behind an internal
+// resistance, a full pack with BMS charge protection active is modelled by
+// blocking current into the battery, returned energy then only charges the
+// bus capacitors.
+
+typedef struct
+{
+	// parameters
+	float battery_ocv_v;
+	float battery_r_ohm;
+	bool bms_charge_enabled;
+	float bus_capacitance_f;
+	float phase_r_ohm;
+	float phase_l_h;
+	float ke_v_per_erps;
+	float inertia;			// W*s/erps^2, kinetic energy is inertia * erps^2 / 2
+	float friction;			// W/erps^2
+	float load_torque;		// W/erps, e.g. rider pedal resistance
+
+	// inputs
+	bool brake;
+
+	// state
+	float bus_v;
+	float phase_current_a;
+	float battery_current_a;	// drawn by motor from bus, negative when returning energy
+	float erps;
+	float angle;				// electrical angle, 256 per revolution
+	bool outputs_enabled;
+
+	// statistics
+	float max_bus_v;
+	float returned_energy_j;
+} motor_model_t;
+
+void motor_model_init(motor_model_t* m, float battery_ocv_v);
+
+// Advance one pwm cycle, reads pwm outputs from TIM1 and
+// updates hall sensor, brake pin and battery current adc buffer.
+void motor_model_step(motor_model_t* m);
+
+// Battery voltage in adc steps as read by adc_get_battery_voltage.
+uint16_t motor_model_adc_battery_voltage(const motor_model_t* m);
+
+#endif
@@ -0,0 +1,572 @@
+/*
+ * bbs-fw
+ *
+ * Copyright (C) Daniel Nilsson, 2022.
+ *
+ * Released under the GPL License, Version 3
+ */
+
+// Host simulation of bbsx/motor.c communicating with a fake motor
+// controller MCU (fake_motor_mcu.c) over a modelled uart link.
+// Reports throughput of successful set/read requests and latency
+// from target current change until applied by motor controller.
+//
+// Without arguments all built in scenarios are run and checked,
+// a single scenario can be scripted from command line:
+//   sim_motor_bbsx latency=10,30 drop=5,5 checksum=10 header=10 reset=20000,300 duration=60 seed=1
+
+#include "test.h"
+#include "fake_motor_mcu.h"
+#include "motor.h"
+#include "sensors.h"
+#include "system.h"
+#include "eventlog.h"
+#include "cfgstore.h"
+#include "bbsx/uart_motor.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+TEST_DEFINE_COUNTERS();
+
+#define TICK_US						100
+#define APP_INTERVAL_MS				10
+#define RX_BUFFER_SIZE				16		// bbsx/uart.c, one slot unused
+#define CHANGES_SIZE				256
+#define RESET_SETTLE_MS				5000	// no power reset close to end of run
+
+// Latency goal from target current change until applied (bbsx/motor.c
+// COM_LATENCY_TARGET_MS). At 4800 baud a request round trip is ~21ms plus
+// 4ms gap, so the goal is only met when no read goes ahead of the change.
+// A read overdue while target current keeps changing adds one round trip.
+#define LATENCY_TARGET_MS			40
+#define LATENCY_READ_ROUND_TRIP_MS	24
+
+#define BATTERY_VOLTAGE_ADC			775		// 52.0V at 14.90 steps per volt
+#define BATTERY_VOLTAGE_X10			520
+#define BATTERY_CURRENT_ADC			69		// 10.0A
+#define BATTERY_CURRENT_X10			100
+
+typedef struct
+{
+	const char* name;
+	uint32_t latency_min_ms;
+	uint32_t latency_max_ms;
+	uint16_t drop_rx_per_mille;
+	uint16_t drop_tx_per_mille;
+	uint16_t bad_checksum_per_mille;
+	uint16_t bad_header_per_mille;
+	uint32_t reset_interval_ms;		// power reset of motor mcu, 0 for none
+	uint32_t reset_off_ms;
+	uint32_t duration_s;
+	uint32_t seed;
+
+	// checks, only for built in scenarios
+	bool expect_no_failures;
+	uint32_t max_latency_p90_ms;
+	uint32_t max_latency_ms;
+} scenario_t;
+
+static const scenario_t scenarios[] =
+{
+	//  name			latency	drop	cksum	header	reset		dur	seed	no fail	p90					max
+	{ "clean",			2, 4,	0, 0,	0,		0,		0, 0,		60,	1,		true,	LATENCY_TARGET_MS,	LATENCY_TARGET_MS + LATENCY_READ_ROUND_TRIP_MS },
+	{ "slow",			8, 16,	0, 0,	0,		0,		0, 0,		60,	2,		true,	LATENCY_TARGET_MS,	100 },
+	{ "lossy",			2, 4,	10, 10,	0,		0,		0, 0,		60,	3,		false,	LATENCY_TARGET_MS,	0 },
+	{ "corrupt",		2, 4,	0, 0,	30,		30,		0, 0,		60,	4,		false,	LATENCY_TARGET_MS,	0 },
+	{ "power_reset",	2, 4,	0, 0,	0,		0,		15000, 300,	60,	5,		false,	0,					0 },
+	{ "combined",		5, 12,	5, 5,	10,		10,		20000, 500,	60,	6,		false,	0,					0 },
+};
+
+#define SCENARIOS (sizeof(scenarios) / sizeof(scenario_t))
+
+
+// simulation state
+static uint32_t now_us;
+static fake_motor_mcu_t mcu;
+
+static uint32_t uart_baud_rate;
+static uint32_t uart_tx_free_us;
+static fake_mcu_wire_byte_t to_mcu[FAKE_MCU_QUEUE_SIZE];
+static uint8_t to_mcu_head, to_mcu_tail;
+static uint8_t rx_buf[RX_BUFFER_SIZE];
+static uint8_t rx_head, rx_tail;
+static uint32_t rx_overflows;
+
+static uint32_t event_count[256];
+static uint32_t requests_ok;
+static uint32_t requests_failed;
+static uint32_t sets_ok_reported;
+
+typedef struct
+{
+	uint8_t value;
+	uint32_t time_us;
+} change_t;
+
+static change_t changes[CHANGES_SIZE];
+static uint16_t changes_head, changes_tail;
+static uint32_t* latencies_us;
+static uint32_t latencies_count;
+static uint32_t latencies_capacity;
+
+
+// firmware dependencies
+// ---------------------------------------------
+
+config_t g_config;
+pstate_t g_pstate;
+trip_t g_trip;
+
+uint32_t system_ms()
+{
+	return now_us / 1000;
+}
+
+bool brake_is_activated()
+{
+	return false;
+}
+
+bool cfgstore_save_pstate()
+{
+	return true;
+}
+
+void eventlog_write(uint8_t evt)
+{
+	++event_count[evt];
+
+	if (evt == EVT_MSG_MOTOR_INIT_OK && event_count[evt] == 1)
+	{
+		// changes requested before motor controller first
+		// configured are not counted as latency
+		changes_tail = changes_head;
+	}
+}
+
+void eventlog_write_data(uint8_t evt, int16_t data)
+{
+	++event_count[evt];
+
+	if (evt == EVT_DATA_MOTOR_COM_REQUESTS_OK)
+	{
+		requests_ok += (uint16_t)data;
+		sets_ok_reported = event_count[EVT_DATA_TARGET_CURRENT] + event_count[EVT_DATA_TARGET_SPEED];
+	}
+	else if (evt == EVT_DATA_MOTOR_COM_REQUESTS_FAILED)
+	{
+		requests_failed += (uint16_t)data;
+	}
+}
+
+void uart_motor_open(uint32_t baudrate)
+{
+	uart_baud_rate = baudrate;
+	uart_tx_free_us = now_us;
+	to_mcu_head = to_mcu_tail = 0;
+	rx_head = rx_tail = 0;
+}
+
+void uart_motor_close()
+{
+}
+
+uint8_t uart_motor_available()
+{
+	return (uint8_t)((RX_BUFFER_SIZE + rx_head - rx_tail) % RX_BUFFER_SIZE);
+}
+
+uint8_t uart_motor_read()
+{
+	uint8_t byte = rx_buf[rx_tail];
+	rx_tail = (rx_tail + 1) % RX_BUFFER_SIZE;
+	return byte;
+}
+
+void uart_motor_write(uint8_t byte)
+{
+	if (uart_tx_free_us < now_us)
+	{
+		uart_tx_free_us = now_us;
+	}
+	uart_tx_free_us += 10000000UL / uart_baud_rate;
+
+	to_mcu[to_mcu_head].byte = byte;
+	to_mcu[to_mcu_head].time_us = uart_tx_free_us;
+	to_mcu_head = (to_mcu_head + 1) % FAKE_MCU_QUEUE_SIZE;
+}
+
+void uart_motor_flush()
+{
+}
+
+
+// latency of target current changes
+// ---------------------------------------------
+
+static void record_latency(uint32_t us)
+{
+	if (latencies_count == latencies_capacity)
+	{
+		latencies_capacity = latencies_capacity ? latencies_capacity * 2 : 1024;
+		latencies_us = realloc(latencies_us, latencies_capacity * sizeof(uint32_t));
+	}
+
+	latencies_us[latencies_count++] = us;
+}
+
+static void target_current_requested(uint8_t value)
+{
+	changes[changes_head].value = value;
+	changes[changes_head].time_us = now_us;
+	changes_head = (changes_head + 1) % CHANGES_SIZE;
+
+	if (changes_head == changes_tail)
+	{
+		// oldest change never applied, should not happen
+		changes_tail = (changes_tail + 1) % CHANGES_SIZE;
+	}
+}
+
+static void target_current_applied(uint8_t value)
+{
+	// latest change to applied value, earlier changes are superseded
+	uint16_t last = CHANGES_SIZE;
+	for (uint16_t i = changes_tail; i != changes_head; i = (i + 1) % CHANGES_SIZE)
+	{
+		if (changes[i].value == value)
+		{
+			last = i;
+		}
+	}
+
+	if (last == CHANGES_SIZE)
+	{
+		return;
+	}
+
+	uint16_t end = (last + 1) % CHANGES_SIZE;
+	for (uint16_t i = changes_tail; i != end; i = (i + 1) % CHANGES_SIZE)
+	{
+		record_latency(now_us - changes[i].time_us);
+	}
+
+	changes_tail = end;
+}
+
+static int compare_u32(const void* a, const void* b)
+{
+	uint32_t x = *(const uint32_t*)a;
+	uint32_t y = *(const uint32_t*)b;
+	return x < y ? -1 : x > y;
+}
+
+static uint32_t latency_percentile_ms(uint32_t percent)
+{
+	if (latencies_count == 0)
+	{
+		return 0;
+	}
+
+	uint32_t idx = (uint32_t)(((uint64_t)latencies_count * percent) / 100);
+	if (idx >= latencies_count)
+	{
+		idx = latencies_count - 1;
+	}
+
+	return latencies_us[idx] / 1000;
+}
+
+
+// simulation
+// ---------------------------------------------
+
+static uint8_t app_target_current(uint32_t ms)
+{
+	// ride cycle: ramp up, continuously varying assist (torque sensor),
+	// ramp down and idle
+	uint32_t phase = ms % 6000;
+
+	if (phase < 1000)
+	{
+		return (uint8_t)(phase / 10);
+	}
+	else if (phase < 3000)
+	{
+		return (uint8_t)(60 + (phase / 10) % 40);
+	}
+	else if (phase < 3500)
+	{
+		return (uint8_t)(100 - (phase - 3000) / 5);
+	}
+
+	return 0;
+}
+
+static void app_step()
+{
+	uint8_t target = app_target_current(system_ms());
+
+	if (target != motor_get_target_current())
+	{
+		target_current_requested(target);
+	}
+
+	motor_set_target_speed(100);
+	motor_set_target_current(target);
+
+	if (target > 0)
+	{
+		motor_enable();
+	}
+	else
+	{
+		motor_disable();
+	}
+}
+
+static void uart_step()
+{
+	while (to_mcu_tail != to_mcu_head && (int32_t)(now_us - to_mcu[to_mcu_tail].time_us) >= 0)
+	{
+		uint8_t current = mcu.target_current;
+
+		fake_mcu_receive(&mcu, to_mcu[to_mcu_tail].byte, uart_baud_rate, now_us);
+		to_mcu_tail = (to_mcu_tail + 1) % FAKE_MCU_QUEUE_SIZE;
+
+		if (mcu.target_current != current)
+		{
+			target_current_applied(mcu.target_current);
+		}
+	}
+
+	uint8_t byte;
+	while (fake_mcu_transmit(&mcu, now_us, &byte))
+	{
+		if (uart_baud_rate != mcu.baud_rate)
+		{
+			continue;
+		}
+
+		uint8_t next = (rx_head + 1) % RX_BUFFER_SIZE;
+		if (next == rx_tail)
+		{
+			++rx_overflows;
+			continue;
+		}
+
+		rx_buf[rx_head] = byte;
+		rx_head = next;
+	}
+}
+
+static void reset_simulation(const scenario_t* s)
+{
+	now_us = 0;
+
+	fake_mcu_init(&mcu, s->seed);
+	mcu.latency_min_us = s->latency_min_ms * 1000;
+	mcu.latency_max_us = s->latency_max_ms * 1000;
+	mcu.drop_rx_per_mille = s->drop_rx_per_mille;
+	mcu.drop_tx_per_mille = s->drop_tx_per_mille;
+	mcu.bad_checksum_per_mille = s->bad_checksum_per_mille;
+	mcu.bad_header_per_mille = s->bad_header_per_mille;
+	mcu.voltage_adc = BATTERY_VOLTAGE_ADC;
+	mcu.current_adc = BATTERY_CURRENT_ADC;
+
+	rx_overflows = 0;
+	memset(event_count, 0, sizeof(event_count));
+	requests_ok = 0;
+	requests_failed = 0;
+	sets_ok_reported = 0;
+	changes_head = changes_tail = 0;
+	latencies_count = 0;
+
+	memset(&g_config, 0, sizeof(g_config));
+	memset(&g_pstate, 0, sizeof(g_pstate));
+}
+
+static void run_scenario(const scenario_t* s, bool check)
+{
+	reset_simulation(s);
+
+	motor_init(30000, 42, 0);
+
+	uint32_t end_us = s->duration_s * 1000000UL + 500000UL;
+	uint32_t next_reset_ms = s->reset_interval_ms;
+	uint32_t power_on_ms = 0;
+	uint32_t resets = 0;
+
+	while (now_us < end_us)
+	{
+		now_us += TICK_US;
+		uint32_t ms = system_ms();
+
+		if (next_reset_ms && ms >= next_reset_ms && mcu.powered &&
+			ms + RESET_SETTLE_MS < s->duration_s * 1000UL)
+		{
+			fake_mcu_power_off(&mcu);
+			power_on_ms = ms + s->reset_off_ms;
+			next_reset_ms += s->reset_interval_ms;
+			++resets;
+		}
+		else if (!mcu.powered && ms >= power_on_ms)
+		{
+			fake_mcu_power_on(&mcu);
+		}
+
+		uart_step();
+		motor_process();
+
+		if (now_us % (APP_INTERVAL_MS * 1000) == 0)
+		{
+			app_step();
+		}
+	}
+
+	qsort(latencies_us, latencies_count, sizeof(uint32_t), compare_u32);
+
+	uint32_t sets_ok = sets_ok_reported;
+	uint32_t reads_ok = requests_ok > sets_ok ? requests_ok - sets_ok : 0;
+	uint32_t reconnects = event_count[EVT_MSG_MOTOR_RECONNECT];
+
+	printf("%-12s %7.1f %7.1f %7u %7u %6u %5u %5u %5u %5u\n",
+		s->name,
+		sets_ok / (float)s->duration_s,
+		reads_ok / (float)s->duration_s,
+		requests_failed,
+		reconnects,
+		latencies_count,
+		latency_percentile_ms(50),
+		latency_percentile_ms(90),
+		latency_percentile_ms(99),
+		latency_percentile_ms(100));
+
+	if (!check)
+	{
+		return;
+	}
+
+	// link up and readings correct at end of run
+	TEST_ASSERT(mcu.configured);
+	TEST_ASSERT(motor_get_battery_voltage_x10() == BATTERY_VOLTAGE_X10);
+	TEST_ASSERT(motor_get_battery_current_x10() == BATTERY_CURRENT_X10);
+	TEST_ASSERT(requests_ok > 0);
+	TEST_ASSERT(latencies_count > 0);
+	TEST_ASSERT(rx_overflows == 0);
+
+	if (s->expect_no_failures)
+	{
+		TEST_ASSERT(requests_failed == 0);
+		TEST_ASSERT(reconnects == 0);
+	}
+
+	if (s->max_latency_p90_ms)
+	{
+		TEST_ASSERT(latency_percentile_ms(90) <= s->max_latency_p90_ms);
+	}
+
+	if (s->max_latency_ms)
+	{
+		TEST_ASSERT(latency_percentile_ms(100) <= s->max_latency_ms);
+	}
+
+	if (s->reset_interval_ms)
+	{
+		// every power reset is detected and motor controller reconfigured
+		TEST_ASSERT(reconnects == resets);
+		TEST_ASSERT(event_count[EVT_MSG_MOTOR_INIT_OK] == resets + 1);
+	}
+}
+
+static void print_header()
+{
+	printf("%-12s %7s %7s %7s %7s %6s %23s\n",
+		"scenario", "sets/s", "reads/s", "failed", "reconn", "n", "latency ms p50/p90/p99/max");
+}
+
+static bool parse_pair(const char* arg, const char* key, uint32_t* a, uint32_t* b)
+{
+	size_t len = strlen(key);
+	if (strncmp(arg, key, len) != 0 || arg[len] != '=')
+	{
+		return false;
+	}
+
+	char* end;
+	*a = strtoul(arg + len + 1, &end, 10);
+	if (b != 0)
+	{
+		*b = *end == ',' ? strtoul(end + 1, 0, 10) : *a;
+	}
+
+	return true;
+}
+
+int main(int argc, char** argv)
+{
+	if (argc > 1)
+	{
+		scenario_t s = scenarios[0];
+		s.name = "custom";
+
+		for (int i = 1; i < argc; ++i)
+		{
+			uint32_t a, b;
+			if (parse_pair(argv[i], "latency", &a, &b))
+			{
+				s.latency_min_ms = a;
+				s.latency_max_ms = b;
+			}
+			else if (parse_pair(argv[i], "drop", &a, &b))
+			{
+				s.drop_rx_per_mille = (uint16_t)a;
+				s.drop_tx_per_mille = (uint16_t)b;
+			}
+			else if (parse_pair(argv[i], "checksum", &a, 0))
+			{
+				s.bad_checksum_per_mille = (uint16_t)a;
+			}
+			else if (parse_pair(argv[i], "header", &a, 0))
+			{
+				s.bad_header_per_mille = (uint16_t)a;
+			}
+			else if (parse_pair(argv[i], "reset", &a, &b))
+			{
+				s.reset_interval_ms = a;
+				s.reset_off_ms = b;
+			}
+			else if (parse_pair(argv[i], "duration", &a, 0))
+			{
+				s.duration_s = a;
+			}
+			else if (parse_pair(argv[i], "seed", &a, 0))
+			{
+				s.seed = a;
+			}
+			else
+			{
+				printf("unknown argument: %s\n", argv[i]);
+				return 2;
+			}
+		}
+
+		print_header();
+		run_scenario(&s, false);
+		return 0;
+	}
+
+	print_header();
+	for (uint8_t i = 0; i < SCENARIOS; ++i)
+	{
+		int before = test_failures;
+		run_scenario(&scenarios[i], true);
+		if (test_failures != before)
+		{
+			printf("FAIL %s\n", scenarios[i].name);
+		}
+	}
+
+	return TEST_RESULT();
+}
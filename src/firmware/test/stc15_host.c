@@ -0,0 +1,13 @@
+/*
+ * bbs-fw
+ *
+ * Copyright (C) Daniel Nilsson, 2022.
+ *
+ * Released under the GPL License, Version 3
+ */
+
+// Storage for special function registers when compiling
+// BBSHD/BBS02 sources for host tests.
+
+#define HOST_DEFINE_SFR
+#include "bbsx/stc15.h"
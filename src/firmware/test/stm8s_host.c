@@ -0,0 +1,55 @@
+/*
+ * bbs-fw
+ *
+ * Copyright (C) Daniel Nilsson, 2022.
+ *
+ * Released under the GPL License, Version 3
+ */
+
+#include "stm8s_host.h"
+#include <string.h>
+
+GPIO_TypeDef host_gpioa, host_gpiob, host_gpioc, host_gpiod, host_gpioe;
+TIM1_TypeDef host_tim1;
+TIM2_TypeDef host_tim2;
+TIM3_TypeDef host_tim3;
+ADC1_TypeDef host_adc1;
+FLASH_TypeDef host_flash;
+OPT_TypeDef host_opt;
+EXTI_TypeDef host_exti;
+CLK_TypeDef host_clk;
+
+int host_interrupts_disabled = 0;
+
+void host_enable_interrupts()
+{
+	host_interrupts_disabled = 0;
+}
+
+void host_disable_interrupts()
+{
+	++host_interrupts_disabled;
+}
+
+void host_reset_peripherals()
+{
+	memset((void*)&host_gpioa, 0, sizeof(host_gpioa));
+	memset((void*)&host_gpiob, 0, sizeof(host_gpiob));
+	memset((void*)&host_gpioc, 0, sizeof(host_gpioc));
+	memset((void*)&host_gpiod, 0, sizeof(host_gpiod));
+	memset((void*)&host_gpioe, 0, sizeof(host_gpioe));
+	memset((void*)&host_tim1, 0, sizeof(host_tim1));
+	memset((void*)&host_tim2, 0, sizeof(host_tim2));
+	memset((void*)&host_tim3, 0, sizeof(host_tim3));
+	memset((void*)&host_adc1, 0, sizeof(host_adc1));
+	memset((void*)&host_flash, 0, sizeof(host_flash));
+	memset((void*)&host_opt, 0, sizeof(host_opt));
+	memset((void*)&host_exti, 0, sizeof(host_exti));
+	memset((void*)&host_clk, 0, sizeof(host_clk));
+
+	// PWM N channels already enabled in option bytes
+	host_opt.OPT2 = 0x20;
+	host_flash.IAPSR = FLASH_IAPSR_DUL | FLASH_IAPSR_EOP;
+	host_clk.ICKR = CLK_ICKR_HSIRDY;
+	host_interrupts_disabled = 0;
+}
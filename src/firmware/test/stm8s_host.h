@@ -0,0 +1,93 @@
+/*
+ * bbs-fw
+ *
+ * Copyright (C) Daniel Nilsson, 2022.
+ *
+ * Released under the GPL License, Version 3
+ */
+
+#ifndef _TEST_STM8S_HOST_H_
+#define _TEST_STM8S_HOST_H_
+
+// Force included when compiling TSDZ2 sources for host tests.
+// Peripheral registers are mapped to host memory and
+// global interrupt enable/disable is recorded instead of executed.
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define __far
+#define __near
+#define __trap
+
+// stm8s.h requires a known compiler
+#define __SDCC 1
+#include "tsdz2/cpu.h"
+#include "tsdz2/stm8s/stm8s.h"
+#undef __SDCC
+
+#undef enableInterrupts
+#undef disableInterrupts
+#undef rim
+#undef sim
+#undef nop
+#undef trap
+#undef wfi
+#undef halt
+
+#include "intellisense.h"
+
+#undef enableInterrupts
+#undef disableInterrupts
+#define enableInterrupts()		host_enable_interrupts()
+#define disableInterrupts()		host_disable_interrupts()
+#define nop()
+
+extern GPIO_TypeDef host_gpioa, host_gpiob, host_gpioc, host_gpiod, host_gpioe;
+extern TIM1_TypeDef host_tim1;
+extern TIM2_TypeDef host_tim2;
+extern TIM3_TypeDef host_tim3;
+extern ADC1_TypeDef host_adc1;
+extern FLASH_TypeDef host_flash;
+extern OPT_TypeDef host_opt;
+extern EXTI_TypeDef host_exti;
+extern CLK_TypeDef host_clk;
+
+#undef GPIOA
+#undef GPIOB
+#undef GPIOC
+#undef GPIOD
+#undef GPIOE
+#undef TIM1
+#undef TIM2
+#undef TIM3
+#undef ADC1
+#undef FLASH
+#undef OPT
+#undef EXTI
+#undef CLK
+
+#define GPIOA	(&host_gpioa)
+#define GPIOB	(&host_gpiob)
+#define GPIOC	(&host_gpioc)
+#define GPIOD	(&host_gpiod)
+#define GPIOE	(&host_gpioe)
+#define TIM1	(&host_tim1)
+#define TIM2	(&host_tim2)
+#define TIM3	(&host_tim3)
+#define ADC1	(&host_adc1)
+#define FLASH	(&host_flash)
+#define OPT		(&host_opt)
+#define EXTI	(&host_exti)
+#define CLK		(&host_clk)
+
+// Nesting depth of disableInterrupts(), 0 when interrupts are enabled.
+extern int host_interrupts_disabled;
+
+void host_enable_interrupts();
+void host_disable_interrupts();
+
+// Reset all peripheral registers, option bytes are programmed (no busy wait).
+void host_reset_peripherals();
+
+#endif
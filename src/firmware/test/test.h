@@ -0,0 +1,49 @@
+/*
+ * bbs-fw
+ *
+ * Copyright (C) Daniel Nilsson, 2022.
+ *
+ * Released under the GPL License, Version 3
+ */
+
+#ifndef _TEST_TEST_H_
+#define _TEST_TEST_H_
+
+#include <stdio.h>
+
+// Minimal host test support, a test is a void function using TEST_ASSERT,
+// run with RUN_TEST from main which returns TEST_RESULT().
+
+extern int test_failures;
+extern int test_count;
+
+#define TEST_ASSERT(cond) do {												\
+		if (!(cond))														\
+		{																	\
+			printf("  FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond);		\
+			++test_failures;												\
+		}																	\
+	} while (0)
+
+#define TEST_ASSERT_RANGE(val, lo, hi) do {									\
+		long _v = (long)(val);												\
+		if (_v < (long)(lo) || _v > (long)(hi))								\
+		{																	\
+			printf("  FAIL %s:%d: %s = %ld, expected [%ld, %ld]\n",			\
+				__FILE__, __LINE__, #val, _v, (long)(lo), (long)(hi));		\
+			++test_failures;												\
+		}																	\
+	} while (0)
+
+#define RUN_TEST(fn) do {													\
+		int _before = test_failures;										\
+		++test_count;														\
+		fn();																\
+		printf("%s %s\n", test_failures == _before ? "ok  " : "FAIL", #fn);	\
+	} while (0)
+
+#define TEST_RESULT() (test_failures ? 1 : 0)
+
+#define TEST_DEFINE_COUNTERS() int test_failures = 0; int test_count = 0
+
+#endif
@@ -0,0 +1,291 @@
+/*
+ * bbs-fw
+ *
+ * Copyright (C) Daniel Nilsson, 2022.
+ *
+ * Released under the GPL License, Version 3
+ */
+
+// Host tests of tsdz2/motor.c against the motor model in motor_model_tsdz2.c.
+
+#include "test.h"
+#include "motor_model_tsdz2.h"
+#include "motor.h"
+#include "adc.h"
+#include "cfgstore.h"
+#include "eventlog.h"
+#include "fwconfig.h"
+#include "tsdz2/interrupt.h"
+#include "tsdz2/timers.h"
+#include "tsdz2/stm8s/stm8s_tim1.h"
+
+#include <string.h>
+
+TEST_DEFINE_COUNTERS();
+
+#define PWM_CYCLES_MS				15.625f
+// motor_process is called every main loop iteration
+#define MAIN_LOOP_PWM_CYCLES		4
+// brake and target current is applied by app every 10ms
+#define APP_PWM_CYCLES				156
+
+#define BATTERY_14S_FULL_V			58.8f
+#define BATTERY_14S_NOMINAL_V		50.4f
+#define LVC_V						42
+#define MAX_CURRENT_MA				18000
+
+#define BUS_CAPACITOR_RATING_V		63.0f
+#define HIGH_VOLTAGE_LIMIT_V		(HIGH_VOLTAGE_LIMIT_X100V / 100.0f)
+#define HIGH_VOLTAGE_RELEASE_V		((HIGH_VOLTAGE_LIMIT_X100V - HIGH_VOLTAGE_HYSTERESIS_X100V) / 100.0f)
+
+
+config_t g_config;
+pstate_t g_pstate;
+
+static motor_model_t model;
+static uint32_t pwm_cycles;
+static uint8_t app_target_current;
+static bool app_paused;
+static bool hvc_seen;
+static bool outputs_enabled_during_hvc;
+
+uint16_t adc_get_battery_voltage()
+{
+	return motor_model_adc_battery_voltage(&model);
+}
+
+void timer1_init_motor_pwm()
+{
+	// center of pwm range, outputs disabled
+	TIM1->CCR1H = TIM1->CCR2H = TIM1->CCR3H = 1;
+}
+
+bool cfgstore_save_pstate()
+{
+	return true;
+}
+
+void eventlog_write(uint8_t evt) {}
+void eventlog_write_data(uint8_t evt, int16_t data) {}
+
+
+static void app_step()
+{
+	if (app_paused)
+	{
+		return;
+	}
+
+	uint8_t target_current = model.brake ? 0 : app_target_current;
+
+	motor_set_target_speed(100);
+	motor_set_target_current(target_current);
+
+	if (target_current > 0)
+	{
+		motor_enable();
+	}
+	else
+	{
+		motor_disable();
+	}
+}
+
+static void simulate_ms(uint32_t ms)
+{
+	uint32_t end = pwm_cycles + (uint32_t)(ms * PWM_CYCLES_MS);
+
+	while (pwm_cycles < end)
+	{
+		isr_timer1_cmp();
+		motor_model_step(&model);
+		++pwm_cycles;
+
+		if (pwm_cycles % MAIN_LOOP_PWM_CYCLES == 0)
+		{
+			motor_process();
+
+			if (motor_status() & MOTOR_ERROR_HVC)
+			{
+				hvc_seen = true;
+				if (model.outputs_enabled)
+				{
+					outputs_enabled_during_hvc = true;
+				}
+			}
+		}
+
+		if (pwm_cycles % APP_PWM_CYCLES == 0)
+		{
+			app_step();
+		}
+	}
+}
+
+static void setup(float battery_v, bool bms_charge_enabled)
+{
+	memset(&g_config, 0, sizeof(g_config));
+	memset(&g_pstate, 0, sizeof(g_pstate));
+	host_reset_peripherals();
+
+	motor_model_init(&model, battery_v);
+	model.bms_charge_enabled = bms_charge_enabled;
+	pwm_cycles = 0;
+	app_target_current = 0;
+	app_paused = false;
+
+	motor_pre_init();
+	motor_init(MAX_CURRENT_MA, LVC_V, 0);
+
+	// coast to stop and let voltage filter settle from any previous test
+	simulate_ms(500);
+
+	hvc_seen = false;
+	outputs_enabled_during_hvc = false;
+	model.max_bus_v = model.bus_v;
+	model.returned_energy_j = 0.0f;
+}
+
+static void ride_to_speed()
+{
+	app_target_current = 100;
+	simulate_ms(3000);
+}
+
+static void brake(uint32_t ms)
+{
+	model.brake = true;
+	model.returned_energy_j = 0.0f;
+	simulate_ms(ms);
+	model.brake = false;
+}
+
+
+static void test_full_14s_pack_is_not_over_voltage()
+{
+	setup(BATTERY_14S_FULL_V, true);
+
+	TEST_ASSERT((motor_status() & MOTOR_ERROR_HVC) == 0);
+
+	ride_to_speed();
+
+	TEST_ASSERT(model.outputs_enabled);
+	TEST_ASSERT(model.erps > 300.0f);
+	TEST_ASSERT(!hvc_seen);
+}
+
+static void test_brake_returns_energy_to_battery()
+{
+	setup(BATTERY_14S_FULL_V, true);
+	ride_to_speed();
+
+	brake(500);
+
+	printf("  brake into battery: %.2f J returned, peak %.2f V\n",
+		model.returned_energy_j, model.max_bus_v);
+
+	// strongest braking may briefly reach the limit through battery resistance
+	TEST_ASSERT(model.returned_energy_j > 0.0f);
+	TEST_ASSERT(model.max_bus_v < HIGH_VOLTAGE_LIMIT_V + 1.0f);
+	TEST_ASSERT(!outputs_enabled_during_hvc);
+	TEST_ASSERT(!model.outputs_enabled);
+}
+
+static void test_brake_ramp_disables_outputs_at_zero_duty_cycle()
+{
+	// far from over voltage limit, outputs are only disabled by brake ramp
+	setup(BATTERY_14S_NOMINAL_V, true);
+	ride_to_speed();
+
+	// brake handled in isr only, app would disable motor within 10ms
+	app_paused = true;
+	brake(50);
+	app_paused = false;
+
+	TEST_ASSERT(model.returned_energy_j > 0.0f);
+	TEST_ASSERT(!hvc_seen);
+	TEST_ASSERT(!model.outputs_enabled);
+
+	// enabled again by app when brake is released
+	simulate_ms(100);
+	TEST_ASSERT(model.outputs_enabled);
+}
+
+static void test_brake_with_bms_charge_cutoff_limits_bus_voltage()
+{
+	// full pack, BMS blocks charge current so returned energy
+	// only goes into bus capacitors
+	setup(BATTERY_14S_FULL_V, false);
+	ride_to_speed();
+
+	brake(500);
+
+	printf("  brake with BMS charge cutoff: %.2f J returned, peak %.2f V\n",
+		model.returned_energy_j, model.max_bus_v);
+
+	TEST_ASSERT(hvc_seen);
+	TEST_ASSERT(!outputs_enabled_during_hvc);
+	TEST_ASSERT(model.max_bus_v < BUS_CAPACITOR_RATING_V);
+	TEST_ASSERT(!model.outputs_enabled);
+
+	// refused while over voltage
+	motor_enable();
+	simulate_ms(1);
+	TEST_ASSERT(!model.outputs_enabled);
+}
+
+static void test_over_voltage_blocks_enable_with_hysteresis()
+{
+	// e.g. charger connected while riding
+	setup(HIGH_VOLTAGE_LIMIT_V + 0.5f, true);
+
+	TEST_ASSERT(motor_status() & MOTOR_ERROR_HVC);
+
+	app_target_current = 100;
+	simulate_ms(100);
+	TEST_ASSERT(!model.outputs_enabled);
+	TEST_ASSERT(model.erps == 0.0f);
+
+	// within hysteresis band
+	model.battery_ocv_v = HIGH_VOLTAGE_RELEASE_V + 0.3f;
+	simulate_ms(100);
+	TEST_ASSERT(motor_status() & MOTOR_ERROR_HVC);
+	TEST_ASSERT(!model.outputs_enabled);
+
+	model.battery_ocv_v = HIGH_VOLTAGE_RELEASE_V - 0.5f;
+	simulate_ms(100);
+	TEST_ASSERT((motor_status() & MOTOR_ERROR_HVC) == 0);
+	TEST_ASSERT(model.outputs_enabled);
+}
+
+static void test_limit_independent_of_configured_battery_voltage()
+{
+	// display setting for a 13S pack must not block a 14S pack
+	g_config.max_battery_x100v_u16h = (uint8_t)(5460 >> 8);
+	g_config.max_battery_x100v_u16l = (uint8_t)5460;
+
+	setup(BATTERY_14S_FULL_V, true);
+	g_config.max_battery_x100v_u16h = (uint8_t)(5460 >> 8);
+	g_config.max_battery_x100v_u16l = (uint8_t)5460;
+	motor_calibrate_battery_voltage(0);
+
+	simulate_ms(100);
+	TEST_ASSERT((motor_status() & MOTOR_ERROR_HVC) == 0);
+
+	app_target_current = 100;
+	simulate_ms(100);
+	TEST_ASSERT(model.outputs_enabled);
+}
+
+
+int main()
+{
+	RUN_TEST(test_full_14s_pack_is_not_over_voltage);
+	RUN_TEST(test_brake_returns_energy_to_battery);
+	RUN_TEST(test_brake_ramp_disables_outputs_at_zero_duty_cycle);
+	RUN_TEST(test_brake_with_bms_charge_cutoff_limits_bus_voltage);
+	RUN_TEST(test_over_voltage_blocks_enable_with_hysteresis);
+	RUN_TEST(test_limit_independent_of_configured_battery_voltage);
+
+	return TEST_RESULT();
+}
@@ -0,0 +1,603 @@
+/*
+ * bbs-fw
+ *
+ * Copyright (C) Daniel Nilsson, 2022.
+ *
+ * Released under the GPL License, Version 3
+ */
+
+// Host tests and benchmark of sensors_core.c, built for BBSHD (pins sampled
+// in 100us timer interrupt) and TSDZ2 (edge interrupts with us timestamp).
+// Target interrupt handling is replicated from bbsx/sensors.c and
+// tsdz2/sensors.c, signals are generated with 10us resolution.
+
+#include "test.h"
+#include "sensors.h"
+#include "sensors_core.h"
+#include "fwconfig.h"
+
+#include <string.h>
+#include <time.h>
+
+TEST_DEFINE_COUNTERS();
+
+#define SIM_STEP_US					10
+#define MAIN_LOOP_US				1000
+
+// PAS period in us for cadence rpm
+#define PAS_PERIOD_US(rpm)			(60000000ul / PAS_PULSES_REVOLUTION / (rpm))
+
+
+// simulation state
+static uint32_t now_us;
+static uint32_t random_state;
+static uint32_t core_calls;			// calls into sensors core from interrupt context
+
+typedef struct
+{
+	uint32_t period_us;			// 0 when still
+	uint32_t base_period_us;
+	uint8_t jitter_percent;
+	bool backward;
+	uint32_t phase_us;
+	bool pas1;
+	bool pas2;
+} pedal_t;
+
+typedef struct
+{
+	uint32_t periods_us[4];		// per magnet, 0 when still
+	uint8_t magnets;
+	uint8_t idx;
+	uint32_t phase_us;
+	bool pin;
+} wheel_t;
+
+static pedal_t pedal;
+static wheel_t wheel;
+
+
+// firmware dependencies
+// ---------------------------------------------
+
+uint32_t system_ms()
+{
+	return now_us / 1000;
+}
+
+void sensors_disable_interrupts()
+{
+}
+
+void sensors_enable_interrupts()
+{
+}
+
+
+// target interrupt handling
+// ---------------------------------------------
+
+#if defined(BBSHD)
+
+static bool pas_prev1;
+static bool speed_prev_state;
+static uint16_t pas_period_counter;
+static uint16_t speed_period_counter;
+
+static void reset_target()
+{
+	pas_prev1 = false;
+	speed_prev_state = false;
+	pas_period_counter = 0;
+	speed_period_counter = 0;
+}
+
+// bbsx/sensors.c sensors_timer0_isr
+static void timer0_isr()
+{
+	if (pedal.pas1 && !pas_prev1 && (++core_calls, sensors_core_pas_edge(pedal.pas2, pas_period_counter)))
+	{
+		pas_period_counter = 0;
+	}
+	else
+	{
+		if (pas_period_counter < 65535)
+		{
+			pas_period_counter++;
+		}
+
+		if ((uint8_t)pas_period_counter == 0)
+		{
+			++core_calls;
+			sensors_core_pas_idle(pas_period_counter);
+		}
+	}
+	pas_prev1 = pedal.pas1;
+
+	if (wheel.pin && !speed_prev_state && (++core_calls, sensors_core_speed_edge(speed_period_counter)))
+	{
+		speed_period_counter = 0;
+	}
+	else
+	{
+		if (speed_period_counter < 65535)
+		{
+			speed_period_counter++;
+		}
+
+		if ((uint8_t)speed_period_counter == 0)
+		{
+			++core_calls;
+			sensors_core_speed_idle(speed_period_counter);
+		}
+	}
+	speed_prev_state = wheel.pin;
+}
+
+static void target_step(bool pas_rising, bool speed_rising)
+{
+	(void)pas_rising;
+	(void)speed_rising;
+
+	if (now_us % 100 == 0)
+	{
+		timer0_isr();
+	}
+}
+
+static void target_main_loop()
+{
+}
+
+#elif defined(TSDZ2)
+
+static uint32_t pas_last_edge_us;
+static uint32_t speed_last_edge_us;
+
+static void reset_target()
+{
+	pas_last_edge_us = 0;
+	speed_last_edge_us = 0;
+}
+
+// tsdz2/sensors.c isr_port_d/isr_port_a
+static void target_step(bool pas_rising, bool speed_rising)
+{
+	if (pas_rising)
+	{
+		++core_calls;
+		if (sensors_core_pas_edge(pedal.pas2, now_us - pas_last_edge_us))
+		{
+			pas_last_edge_us = now_us;
+		}
+	}
+
+	if (speed_rising)
+	{
+		++core_calls;
+		if (sensors_core_speed_edge(now_us - speed_last_edge_us))
+		{
+			speed_last_edge_us = now_us;
+		}
+	}
+}
+
+// tsdz2/sensors.c process_timeouts
+static void target_main_loop()
+{
+	sensors_core_pas_idle(now_us - pas_last_edge_us);
+	sensors_core_speed_idle(now_us - speed_last_edge_us);
+}
+
+#endif
+
+
+// simulation
+// ---------------------------------------------
+
+static uint32_t random_below(uint32_t n)
+{
+	random_state = random_state * 1103515245u + 12345u;
+	return (random_state >> 8) % n;
+}
+
+static uint32_t next_pedal_period()
+{
+	uint32_t period = pedal.base_period_us;
+	if (pedal.jitter_percent > 0)
+	{
+		uint32_t range = period * pedal.jitter_percent / 100;
+		period = period - range + random_below(2 * range + 1);
+	}
+
+	return period;
+}
+
+static void pedal_at(uint16_t rpm, uint8_t jitter_percent, bool backward)
+{
+	pedal.base_period_us = rpm > 0 ? PAS_PERIOD_US(rpm) : 0;
+	pedal.jitter_percent = jitter_percent;
+	pedal.backward = backward;
+
+	if (pedal.period_us == 0 && rpm > 0)
+	{
+		// start of next rising edge
+		pedal.phase_us = 0;
+		pedal.period_us = next_pedal_period();
+		pedal.pas1 = false;
+	}
+	else
+	{
+		pedal.period_us = pedal.base_period_us ? next_pedal_period() : 0;
+	}
+}
+
+static void wheel_at(uint32_t revolution_us, uint8_t magnets, uint8_t uneven_percent)
+{
+	wheel.magnets = magnets;
+	for (uint8_t i = 0; i < magnets; ++i)
+	{
+		uint32_t period = revolution_us / magnets;
+		if (magnets == 2)
+		{
+			// magnets not evenly spaced
+			period = i == 0 ? period * (100 - uneven_percent) / 100 : period * (100 + uneven_percent) / 100;
+		}
+
+		wheel.periods_us[i] = period;
+	}
+
+	if (wheel.idx >= magnets)
+	{
+		wheel.idx = 0;
+	}
+}
+
+static bool step_pedal()
+{
+	if (pedal.period_us == 0)
+	{
+		return false;
+	}
+
+	pedal.phase_us += SIM_STEP_US;
+	if (pedal.phase_us >= pedal.period_us)
+	{
+		pedal.phase_us -= pedal.period_us;
+		pedal.period_us = next_pedal_period();
+		if (pedal.period_us == 0)
+		{
+			return false;
+		}
+	}
+
+	// PAS2 is 90 degrees out of phase, low at PAS1 rising edge when pedaling forward
+	uint32_t p = pedal.period_us;
+	uint32_t offset = pedal.backward ? p / 4 : p * 3 / 4;
+	bool prev = pedal.pas1;
+
+	pedal.pas1 = pedal.phase_us < p / 2;
+	pedal.pas2 = (pedal.phase_us + offset) % p < p / 2;
+
+	return pedal.pas1 && !prev;
+}
+
+static bool step_wheel()
+{
+	uint32_t period = wheel.magnets > 0 ? wheel.periods_us[wheel.idx] : 0;
+	if (period == 0)
+	{
+		wheel.pin = false;
+		return false;
+	}
+
+	wheel.phase_us += SIM_STEP_US;
+	if (wheel.phase_us >= period)
+	{
+		wheel.phase_us -= period;
+		wheel.idx = (wheel.idx + 1) % wheel.magnets;
+	}
+
+	// reed switch closed for 2ms when magnet passes
+	bool prev = wheel.pin;
+	wheel.pin = wheel.phase_us < 2000;
+
+	return wheel.pin && !prev;
+}
+
+static void simulate_us(uint32_t us)
+{
+	uint32_t end = now_us + us;
+	while ((int32_t)(end - now_us) > 0)
+	{
+		now_us += SIM_STEP_US;
+
+		bool pas_rising = step_pedal();
+		bool speed_rising = step_wheel();
+		target_step(pas_rising, speed_rising);
+
+		if (now_us % MAIN_LOOP_US == 0)
+		{
+			target_main_loop();
+			sensors_core_process();
+		}
+	}
+}
+
+#define simulate_ms(ms) simulate_us((uint32_t)(ms) * 1000)
+
+static void setup()
+{
+	now_us = 1000000;
+	random_state = 1;
+	core_calls = 0;
+	memset(&pedal, 0, sizeof(pedal));
+	memset(&wheel, 0, sizeof(wheel));
+
+	reset_target();
+	sensors_core_init();
+	pas_set_stop_delay(1500);
+	speed_sensor_set_signals_per_rpm(1);
+}
+
+
+// tests
+// ---------------------------------------------
+
+static void test_cadence_sweep()
+{
+	static const uint16_t rpms[] = { 15, 30, 45, 60, 75, 90, 105, 120, 150 };
+
+	printf("  rpm   measured\n");
+	for (uint8_t i = 0; i < sizeof(rpms) / sizeof(rpms[0]); ++i)
+	{
+		setup();
+		pedal_at(rpms[i], 0, false);
+		simulate_ms(3000);
+
+		uint16_t cadence = pas_get_cadence_rpm_x10();
+		printf("  %3u   %5.1f\n", rpms[i], cadence / 10.0f);
+
+		// bbsx period is quantized to 100us ticks
+		TEST_ASSERT_RANGE(cadence, rpms[i] * 10 * 97 / 100, rpms[i] * 10 * 103 / 100);
+		TEST_ASSERT(pas_is_pedaling_forwards());
+		TEST_ASSERT(!pas_is_pedaling_backwards());
+	}
+}
+
+static void test_cadence_with_jitter()
+{
+	setup();
+	pedal_at(60, 15, false);
+	simulate_ms(1000);
+
+	uint32_t sum = 0;
+	uint16_t min = 0xffff, max = 0;
+	uint16_t samples = 0;
+
+	for (uint16_t i = 0; i < 400; ++i)
+	{
+		simulate_ms(10);
+		uint16_t cadence = pas_get_cadence_rpm_x10();
+		sum += cadence;
+		min = cadence < min ? cadence : min;
+		max = cadence > max ? cadence : max;
+		++samples;
+	}
+
+	printf("  60rpm +-15%%: mean %.1f min %.1f max %.1f\n", sum / 10.0f / samples, min / 10.0f, max / 10.0f);
+
+	TEST_ASSERT(min > 0);
+	TEST_ASSERT_RANGE(sum / samples, 570, 630);
+}
+
+static uint32_t measure_stop_ms(uint16_t rpm)
+{
+	setup();
+	pedal_at(rpm, 0, false);
+	simulate_ms(2000);
+	TEST_ASSERT(pas_get_cadence_rpm_x10() > 0);
+
+	// stop right after a rising edge
+	bool prev;
+	do
+	{
+		prev = pedal.pas1;
+		simulate_us(SIM_STEP_US);
+	} while (!pedal.pas1 || prev);
+	pedal_at(0, 0, false);
+
+	uint32_t start_us = now_us;
+	while (pas_get_cadence_rpm_x10() > 0 && now_us - start_us < 3000000)
+	{
+		simulate_ms(1);
+	}
+
+	return (now_us - start_us) / 1000;
+}
+
+static void test_stop_detection()
+{
+	static const uint16_t rpms[] = { 20, 60, 120 };
+
+	for (uint8_t i = 0; i < sizeof(rpms) / sizeof(rpms[0]); ++i)
+	{
+		uint32_t period_ms = PAS_PERIOD_US(rpms[i]) / 1000;
+		uint32_t expected_ms = period_ms * PAS_STOP_PERIOD_FACTOR;
+		if (expected_ms < PAS_STOP_MIN_DELAY_MS)
+		{
+			expected_ms = PAS_STOP_MIN_DELAY_MS;
+		}
+
+		uint32_t stop_ms = measure_stop_ms(rpms[i]);
+		printf("  stop at %3urpm detected after %ums (period %ums)\n", rpms[i], stop_ms, period_ms);
+
+		TEST_ASSERT_RANGE(stop_ms, period_ms, expected_ms + 5);
+	}
+}
+
+static void test_reverse_pedalling()
+{
+	setup();
+	pedal_at(60, 0, false);
+	simulate_ms(1000);
+	TEST_ASSERT(pas_is_pedaling_forwards());
+	TEST_ASSERT(pas_get_pulse_counter() >= PAS_PULSES_REVOLUTION - 1);
+
+	pedal_at(40, 0, true);
+	simulate_ms(300);
+	TEST_ASSERT(pas_is_pedaling_backwards());
+	TEST_ASSERT(!pas_is_pedaling_forwards());
+
+	// counter restarted at direction change, ~2 pulses in 300ms at 40rpm
+	TEST_ASSERT(pas_get_pulse_counter() < PAS_PULSES_REVOLUTION / 2);
+	TEST_ASSERT(pas_get_cadence_rpm_x10() > 0);
+
+	pedal_at(60, 0, false);
+	simulate_ms(300);
+	TEST_ASSERT(pas_is_pedaling_forwards());
+	TEST_ASSERT(pas_get_pulse_counter() < PAS_PULSES_REVOLUTION / 2);
+}
+
+static void test_cadence_from_standstill()
+{
+	setup();
+	TEST_ASSERT(pas_get_cadence_rpm_x10() == 0);
+
+	pedal_at(60, 0, false);
+	simulate_us(PAS_PERIOD_US(60) / 2);
+
+	// first edge has no period
+	TEST_ASSERT(pas_get_pulse_counter() == 1);
+	TEST_ASSERT(pas_get_cadence_rpm_x10() == 0);
+
+	simulate_us(PAS_PERIOD_US(60));
+	TEST_ASSERT(pas_get_pulse_counter() == 2);
+	TEST_ASSERT_RANGE(pas_get_cadence_rpm_x10(), 580, 620);
+}
+
+#if defined(TSDZ2)
+static void test_pas_glitch_rejected()
+{
+	setup();
+	pedal_at(60, 0, false);
+	simulate_ms(1000);
+
+	uint16_t counter = pas_get_pulse_counter();
+
+	// short spike on PAS1 right after rising edge
+	sensors_core_pas_edge(false, 1000);
+	simulate_ms(10);
+
+	TEST_ASSERT(pas_get_pulse_counter() == counter);
+	TEST_ASSERT_RANGE(pas_get_cadence_rpm_x10(), 580, 620);
+}
+#endif
+
+static void test_speed_sweep()
+{
+	static const uint16_t rpms[] = { 30, 60, 120, 240, 480, 720 };
+
+	for (uint8_t i = 0; i < sizeof(rpms) / sizeof(rpms[0]); ++i)
+	{
+		setup();
+		wheel_at(60000000ul / rpms[i], 1, 0);
+		simulate_ms(5000);
+
+		TEST_ASSERT(speed_sensor_is_moving());
+		TEST_ASSERT_RANGE(speed_sensor_get_rpm_x10(), rpms[i] * 10 * 98 / 100, rpms[i] * 10 * 102 / 100);
+	}
+}
+
+static void test_speed_uneven_magnets_averaged()
+{
+	setup();
+	speed_sensor_set_signals_per_rpm(2);
+	wheel_at(60000000ul / 200, 2, 20);
+	simulate_ms(2000);
+
+	uint16_t min = 0xffff, max = 0;
+	uint16_t counter = speed_sensor_get_pulse_counter();
+	for (uint16_t i = 0; i < 2000; ++i)
+	{
+		simulate_ms(1);
+		if (speed_sensor_get_pulse_counter() == counter)
+		{
+			continue;
+		}
+
+		// averaged over one revolution at each pulse
+		counter = speed_sensor_get_pulse_counter();
+		uint16_t rpm = speed_sensor_get_rpm_x10();
+		min = rpm < min ? rpm : min;
+		max = rpm > max ? rpm : max;
+	}
+
+	TEST_ASSERT_RANGE(min, 1960, 2040);
+	TEST_ASSERT_RANGE(max, 1960, 2040);
+}
+
+static void test_speed_stop()
+{
+	setup();
+	wheel_at(60000000ul / 200, 1, 0);
+	simulate_ms(2000);
+	TEST_ASSERT(speed_sensor_get_rpm_x10() > 1900);
+
+	wheel_at(0, 1, 0);
+	simulate_ms(1000);
+
+	// decays with elapsed time while no pulse
+	TEST_ASSERT(speed_sensor_get_rpm_x10() < 700);
+	TEST_ASSERT(speed_sensor_get_acceleration_rpm_x10_per_s() <= 0);
+
+	simulate_ms(2000);
+	TEST_ASSERT(!speed_sensor_is_moving());
+	TEST_ASSERT(speed_sensor_get_rpm_x10() == 0);
+}
+
+static void test_benchmark()
+{
+	setup();
+	pedal_at(90, 5, false);
+	wheel_at(60000000ul / 300, 1, 0);
+	simulate_ms(10000);
+
+	uint32_t calls_per_s = core_calls / 10;
+
+	// host time of main loop processing, only relative numbers are meaningful
+	struct timespec t0, t1;
+	const uint32_t iterations = 1000000;
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for (uint32_t i = 0; i < iterations; ++i)
+	{
+		sensors_core_process();
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	double process_ns = ((t1.tv_sec - t0.tv_sec) * 1e9 + (t1.tv_nsec - t0.tv_nsec)) / iterations;
+
+	printf("  interrupt calls into sensors core: %u/s, sensors_core_process: %.1f ns (host)\n",
+		calls_per_s, process_ns);
+
+	// edges (90rpm PAS, 300rpm wheel) plus timeout checks, not one per timer tick
+	TEST_ASSERT(calls_per_s < 200);
+}
+
+
+int main()
+{
+	RUN_TEST(test_cadence_sweep);
+	RUN_TEST(test_cadence_with_jitter);
+	RUN_TEST(test_stop_detection);
+	RUN_TEST(test_reverse_pedalling);
+	RUN_TEST(test_cadence_from_standstill);
+#if defined(TSDZ2)
+	RUN_TEST(test_pas_glitch_rejected);
+#endif
+	RUN_TEST(test_speed_sweep);
+	RUN_TEST(test_speed_uneven_magnets_averaged);
+	RUN_TEST(test_speed_stop);
+	RUN_TEST(test_benchmark);
+
+	return TEST_RESULT();
+}
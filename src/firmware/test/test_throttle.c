@@ -0,0 +1,173 @@
+/*
+ * bbs-fw
+ *
+ * Copyright (C) Daniel Nilsson, 2022.
+ *
+ * Released under the GPL License, Version 3
+ */
+
+// Host tests of throttle.c with simulated adc input.
+
+#include "test.h"
+#include "throttle.h"
+#include "adc.h"
+#include "eventlog.h"
+
+TEST_DEFINE_COUNTERS();
+
+// throttle_read is called from app_process every 5ms
+#define APP_PERIOD_MS				5
+
+#define ADC_FROM_MV(mv)				((uint16_t)((mv) * 1024ul / 5000ul))
+
+#define THROTTLE_MIN_MV				1000
+#define THROTTLE_MAX_MV				3600
+#define THROTTLE_DEADBAND_MV		50
+#define THROTTLE_FILTER_HZ			5
+
+static uint32_t now_ms;
+static uint16_t throttle_adc;
+static uint8_t response_curve[21];
+
+
+// firmware dependencies
+// ---------------------------------------------
+
+uint32_t system_ms()
+{
+	return now_ms;
+}
+
+uint16_t adc_get_throttle()
+{
+	return throttle_adc;
+}
+
+void eventlog_write(uint8_t evt)
+{
+	(void)evt;
+}
+
+void eventlog_trace(uint8_t signal, int16_t value)
+{
+	(void)signal;
+	(void)value;
+}
+
+
+// simulation
+// ---------------------------------------------
+
+static uint8_t run_ms(uint32_t ms)
+{
+	uint8_t percent = 0;
+	for (uint32_t i = 0; i < ms; i += APP_PERIOD_MS)
+	{
+		now_ms += APP_PERIOD_MS;
+		percent = throttle_read();
+	}
+
+	return percent;
+}
+
+static void setup(uint16_t adc_at_power_on)
+{
+	now_ms = 1000;
+	throttle_adc = adc_at_power_on;
+
+	for (uint8_t i = 0; i < sizeof(response_curve); ++i)
+	{
+		response_curve[i] = i * 5;
+	}
+
+	throttle_init(THROTTLE_MIN_MV, THROTTLE_MAX_MV, THROTTLE_DEADBAND_MV, THROTTLE_FILTER_HZ, response_curve);
+}
+
+
+// tests
+// ---------------------------------------------
+
+static void test_throttle_high_at_power_on_blocked()
+{
+	setup(ADC_FROM_MV(3000));
+
+	// first read must not see a low filtered value
+	now_ms += APP_PERIOD_MS;
+	throttle_read();
+	TEST_ASSERT(!throttle_ok());
+
+	run_ms(2000);
+	TEST_ASSERT(!throttle_ok());
+
+	// allowed after released below minimum
+	throttle_adc = ADC_FROM_MV(800);
+	run_ms(APP_PERIOD_MS);
+	TEST_ASSERT(throttle_ok());
+
+	throttle_adc = ADC_FROM_MV(3000);
+	TEST_ASSERT(run_ms(1000) > 0);
+	TEST_ASSERT(throttle_ok());
+}
+
+static void test_throttle_low_at_power_on()
+{
+	setup(ADC_FROM_MV(850));
+
+	TEST_ASSERT(run_ms(APP_PERIOD_MS) == 0);
+	TEST_ASSERT(throttle_ok());
+}
+
+static void test_throttle_filter_seeded()
+{
+	setup(ADC_FROM_MV(850));
+	run_ms(1000);
+
+	// no step response from zero, released throttle stays released
+	TEST_ASSERT(run_ms(1000) == 0);
+
+	// full throttle reached through filter
+	throttle_adc = ADC_FROM_MV(THROTTLE_MAX_MV + 100);
+	uint8_t percent = run_ms(APP_PERIOD_MS);
+	TEST_ASSERT(percent < 100);
+	TEST_ASSERT(run_ms(1000) == 100);
+}
+
+static void test_throttle_deadband()
+{
+	setup(ADC_FROM_MV(850));
+	run_ms(100);
+
+	// within deadband, not engaged
+	throttle_adc = ADC_FROM_MV(THROTTLE_MIN_MV + THROTTLE_DEADBAND_MV / 2);
+	TEST_ASSERT(run_ms(1000) == 0);
+
+	// engaged above deadband, held at lowest throttle until below start
+	throttle_adc = ADC_FROM_MV(THROTTLE_MIN_MV + 2 * THROTTLE_DEADBAND_MV);
+	TEST_ASSERT(run_ms(1000) > 0);
+
+	throttle_adc = ADC_FROM_MV(THROTTLE_MIN_MV + THROTTLE_DEADBAND_MV / 2);
+	TEST_ASSERT(run_ms(1000) == 1);
+
+	throttle_adc = ADC_FROM_MV(850);
+	TEST_ASSERT(run_ms(1000) == 0);
+}
+
+static void test_throttle_disconnected()
+{
+	// no throttle connected, motor is allowed without throttle
+	setup(0);
+	TEST_ASSERT(run_ms(1000) == 0);
+	TEST_ASSERT(throttle_ok());
+}
+
+
+int main()
+{
+	RUN_TEST(test_throttle_high_at_power_on_blocked);
+	RUN_TEST(test_throttle_low_at_power_on);
+	RUN_TEST(test_throttle_filter_seeded);
+	RUN_TEST(test_throttle_deadband);
+	RUN_TEST(test_throttle_disconnected);
+
+	return TEST_RESULT();
+}
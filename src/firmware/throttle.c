@@ -16,43 +16,83 @@
 
 #include <stdbool.h>
 
-static uint8_t min_voltage_adc;
-static uint8_t max_voltage_adc;
+static uint16_t min_voltage_adc;
+static uint16_t max_voltage_adc;
+static uint16_t start_voltage_adc;
+static uint8_t filter_divisor;
+static uint16_t filtered_adc_x16;
+static bool filter_started;
 
 static bool throttle_detected;
 static bool throttle_low_ok;
 static bool throttle_hard_ok;
 static uint32_t throttle_hard_limit_hit_at;
 
+// expanded from configured response curve for single lookup
+static uint8_t throttle_response_lut[101];
 
-#define LOG_THROTTLE_ADC
 
 #define ADC_VOLTAGE_MV						5000ul
+#define ADC_STEPS							1024ul
 
 #define THROTTLE_HARD_LOW_LIMIT_MV			500ul
 #define THROTTLE_HARD_HIGH_LIMIT_MV			4500ul
 
-#define THROTTLE_HARD_LOW_LIMIT_ADC			((THROTTLE_HARD_LOW_LIMIT_MV * 256) / ADC_VOLTAGE_MV) //25
-#define THROTTLE_HARD_HIGH_LIMIT_ADC		((THROTTLE_HARD_HIGH_LIMIT_MV * 256) / ADC_VOLTAGE_MV) //230
+#define THROTTLE_HARD_LOW_LIMIT_ADC			((THROTTLE_HARD_LOW_LIMIT_MV * ADC_STEPS) / ADC_VOLTAGE_MV) //102
+#define THROTTLE_HARD_HIGH_LIMIT_ADC		((THROTTLE_HARD_HIGH_LIMIT_MV * ADC_STEPS) / ADC_VOLTAGE_MV) //921
 #define THROTTLE_HARD_LIMIT_TOLERANCE_MS	100
 
-#if (THROTTLE_RESPONSE_CURVE == THROTTLE_RESPONSE_CUSTOM)
-static const uint8_t throttle_custom_map_lut[101] =
-{
-	THROTTLE_CUSTOM_MAP
-};
-#endif
+// throttle_read is called from app_process every 5ms
+#define THROTTLE_SAMPLE_RATE_HZ				200
 
 
 
-void throttle_init(uint16_t min_mv, uint16_t max_mv)
+void throttle_init(uint16_t min_mv, uint16_t max_mv, uint8_t deadband_mv, uint8_t filter_cutoff_hz, uint8_t* response_curve)
 {
-	min_voltage_adc = (uint8_t)(((uint32_t)min_mv * 256) / ADC_VOLTAGE_MV); //25 @500
-	max_voltage_adc = (uint8_t)(((uint32_t)max_mv * 256) / ADC_VOLTAGE_MV); //230 @4500
+	min_voltage_adc = (uint16_t)(((uint32_t)min_mv * ADC_STEPS) / ADC_VOLTAGE_MV); //205 @1000
+	max_voltage_adc = (uint16_t)(((uint32_t)max_mv * ADC_STEPS) / ADC_VOLTAGE_MV); //737 @3600
+
+	// throttle engages above start + deadband, releases below start
+	start_voltage_adc = min_voltage_adc + (uint16_t)(((uint32_t)deadband_mv * ADC_STEPS) / ADC_VOLTAGE_MV);
+	if (start_voltage_adc >= max_voltage_adc)
+	{
+		start_voltage_adc = min_voltage_adc;
+	}
+
+	// first order iir filter, y += (x - y) / n where n = fs / (2 * pi * fc)
+	filter_divisor = 1;
+	if (filter_cutoff_hz > 0)
+	{
+		uint16_t n = (THROTTLE_SAMPLE_RATE_HZ * 100u) / (628u * filter_cutoff_hz);
+		if (n > 1)
+		{
+			filter_divisor = (uint8_t)n;
+		}
+	}
+
+	// seeded from first sample in throttle_read
+	filtered_adc_x16 = 0;
+	filter_started = false;
+
 	throttle_detected = false;
 	throttle_low_ok = false;
 	throttle_hard_ok = true;
 	throttle_hard_limit_hit_at = 0;
+
+	// linear interpolation between curve points, 5% apart
+	for (uint8_t i = 0; i <= 100; ++i)
+	{
+		uint8_t point = i / 5;
+		uint8_t frac = i % 5;
+
+		int16_t y = response_curve[point];
+		if (frac > 0)
+		{
+			y += ((response_curve[point + 1] - y) * frac) / 5;
+		}
+
+		throttle_response_lut[i] = (uint8_t)y;
+	}
 }
 
 bool throttle_ok()
@@ -64,17 +104,10 @@ uint8_t throttle_read()
 {
 	static uint8_t throttle_percent = 0;
 
+	// hard limits are checked on unfiltered value to not delay fault detection
 	int16_t value = adc_get_throttle();
+	eventlog_trace(TRACE_THROTTLE_ADC, value);
 
-	#ifdef LOG_THROTTLE_ADC
-	static uint8_t last_logged_throttle_adc = 0;
-	if (ABS(value - last_logged_throttle_adc) >= 1)
-	{
-		last_logged_throttle_adc = value;
-		eventlog_write_data(EVT_DATA_THROTTLE_ADC, value);
-	}
-	#endif
-	
 	if (value < THROTTLE_HARD_LOW_LIMIT_ADC || value > THROTTLE_HARD_HIGH_LIMIT_ADC)
 	{
 		// allow invalid throttle input value for a number of milliseconds before reporting throttle error.
@@ -113,20 +146,30 @@ uint8_t throttle_read()
 	if (value < min_voltage_adc)
 	{
 		// throttle is considered not working until it has given a signal below minimum
-		// configured value but more than 0.
+		// configured value but more than 0, checked unfiltered since the filter output
+		// is below minimum for a while even when throttle is held open at power on.
 		throttle_low_ok = true;
+	}
 
-		// hysteresis
-		if (throttle_percent > 0)
-		{
-			value += 1;
-		}
+	// filter state is kept with 4 fractional bits to not stall on small differences
+	if (!filter_started)
+	{
+		filtered_adc_x16 = (uint16_t)value << 4;
+		filter_started = true;
+	}
+	filtered_adc_x16 += ((int16_t)((uint16_t)value << 4) - (int16_t)filtered_adc_x16) / filter_divisor;
+	value = (int16_t)(filtered_adc_x16 >> 4);
 
-		if (value < min_voltage_adc)
+	if (value < start_voltage_adc)
+	{
+		// deadband, hold at lowest throttle until released below start voltage
+		if (throttle_percent == 0 || value < min_voltage_adc)
 		{
 			throttle_percent = 0;
 			return throttle_percent;
 		}
+
+		value = start_voltage_adc;
 	}
 
 	if (value > max_voltage_adc)
@@ -134,16 +177,7 @@ uint8_t throttle_read()
 		value = max_voltage_adc;
 	}
 
-	throttle_percent = (uint8_t)MAP16(value, min_voltage_adc, max_voltage_adc, 1, 100);
-
-//#ifdef LOG_THROTTLE_ADC
-//	static uint8_t last_logged_throttle_adc = 0;
-//	if (ABS(throttle_percent - last_logged_throttle_adc) >= 1)
-//	{
-//		last_logged_throttle_adc = throttle_percent;
-//		eventlog_write_data(EVT_DATA_THROTTLE_ADC, throttle_percent);
-//	}
-//#endif
+	throttle_percent = (uint8_t)MAP32(value, start_voltage_adc, max_voltage_adc, 1, 100);
 
 	return throttle_percent;
 }
@@ -151,11 +185,5 @@ uint8_t throttle_read()
 
 uint8_t throttle_map_response(uint8_t throttle_percent)
 {
-#if (THROTTLE_RESPONSE_CURVE == THROTTLE_RESPONSE_QUADRATIC)
-	return (uint8_t)(((uint16_t)throttle_percent * throttle_percent) / 100);
-#elif (THROTTLE_RESPONSE_CURVE == THROTTLE_RESPONSE_CUSTOM)
-	return throttle_custom_map_lut[throttle_percent];
-#else
-	return throttle_percent;
-#endif
+	return throttle_response_lut[throttle_percent];
 }
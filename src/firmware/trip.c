@@ -0,0 +1,248 @@
+/*
+ * bbs-fw
+ *
+ * Copyright (C) Daniel Nilsson, 2022.
+ *
+ * Released under the GPL License, Version 3
+ */
+
+#include "trip.h"
+#include "app.h"
+#include "battery.h"
+#include "motor.h"
+#include "sensors.h"
+#include "system.h"
+#include "util.h"
+#include "cfgstore.h"
+#include "fwconfig.h"
+
+static uint16_t wheel_circumference_mm;
+static uint32_t next_sample_ms;
+static uint16_t last_speed_pulses;
+
+static uint16_t distance_mm;
+static uint32_t energy_ws_x1000;
+static uint16_t charge_mas;
+static uint16_t motor_on_ms;
+
+static uint32_t segment_start_distance_m;
+static uint32_t segment_start_energy_wh_x10;
+
+static uint32_t last_saved_odometer_m;
+static uint32_t last_saved_motor_on_s;
+static uint16_t power_down_voltage_x10;
+static bool power_down_saved;
+
+/*
+Energy consumed and distance travelled are integrated in fixed point and
+accumulated in the persisted trip state (see cfgstore.h).
+
+For every TRIP_CONSUMPTION_SEGMENT_M travelled the energy consumption of that
+segment is computed and fed into an exponential filter giving a rolling
+Wh/km estimate over the last few kilometers. Remaining range is computed
+from this estimate and remaining battery energy given by coulomb counting.
+
+Odometer, motor on time, charge and energy totals as well as trip max
+speed and temperature are tracked in the same trip state.
+
+To keep eeprom writes at a minimum trip state is only saved when the bike
+is stopped with brake applied and enough has changed since last save, or
+when battery voltage drops as the battery is switched off.
+*/
+
+static void process_segment()
+{
+	uint32_t segment_m = g_trip.distance_m - segment_start_distance_m;
+	if (segment_m < TRIP_CONSUMPTION_SEGMENT_M)
+	{
+		return;
+	}
+
+	// Wh x10 / km = (Wh x10) * 1000 / m
+	uint32_t segment_wh_x10 = g_trip.energy_wh_x10 - segment_start_energy_wh_x10;
+	int32_t segment_wh_km_x10 = (int32_t)((segment_wh_x10 * 1000) / segment_m);
+	int32_t consumption_wh_km_x10 = g_trip.consumption_wh_km_x10;
+
+	g_trip.consumption_wh_km_x10 = (uint16_t)EXPONENTIAL_FILTER(
+		consumption_wh_km_x10, segment_wh_km_x10, TRIP_CONSUMPTION_FILTER_SEGMENTS);
+
+	segment_start_distance_m = g_trip.distance_m;
+	segment_start_energy_wh_x10 = g_trip.energy_wh_x10;
+}
+
+static void save(bool power_down)
+{
+	last_saved_odometer_m = g_trip.odometer_m;
+	last_saved_motor_on_s = g_trip.motor_on_s;
+	cfgstore_save_trip(power_down);
+}
+
+static void process_save()
+{
+	uint32_t distance_m = g_trip.odometer_m - last_saved_odometer_m;
+	uint32_t motor_on_s = g_trip.motor_on_s - last_saved_motor_on_s;
+
+	uint16_t voltage_x10 = motor_get_battery_voltage_x10();
+	if (voltage_x10 > 0 && voltage_x10 < power_down_voltage_x10)
+	{
+		if (!power_down_saved)
+		{
+			power_down_saved = true;
+			if (distance_m > 0 || motor_on_s > 0)
+			{
+				save(true);
+			}
+		}
+
+		return;
+	}
+
+	power_down_saved = false;
+
+	if (!brake_is_activated() || speed_sensor_is_moving() || motor_get_target_current() > 0)
+	{
+		return;
+	}
+
+	if (distance_m >= TRIP_SAVE_DISTANCE_M || motor_on_s >= TRIP_SAVE_MOTOR_ON_S)
+	{
+		save(false);
+	}
+}
+
+static void process_statistics()
+{
+	uint16_t current_x10 = motor_get_battery_current_x10();
+
+	// A x10 during 100ms gives mAs
+	charge_mas += current_x10 * (TRIP_SAMPLE_INTERVAL_MS / 10);
+	while (charge_mas >= 3600)
+	{
+		charge_mas -= 3600;
+		g_trip.total_charge_mah++;
+	}
+
+	if (motor_get_target_current() > 0)
+	{
+		motor_on_ms += TRIP_SAMPLE_INTERVAL_MS;
+		if (motor_on_ms >= 1000)
+		{
+			motor_on_ms -= 1000;
+			g_trip.motor_on_s++;
+		}
+	}
+
+	// rpm x10 * mm * 60 / 10^6 gives km/h x10
+	uint16_t speed_kph_x10 = (uint16_t)(((uint32_t)speed_sensor_get_rpm_x10() * wheel_circumference_mm * 6) / 100000ul);
+	if (speed_kph_x10 > g_trip.max_speed_kph_x10)
+	{
+		g_trip.max_speed_kph_x10 = speed_kph_x10;
+	}
+
+	uint8_t temperature = app_get_temperature();
+	if (temperature > g_trip.max_temperature_c)
+	{
+		g_trip.max_temperature_c = temperature;
+	}
+}
+
+void trip_init()
+{
+	// 2 * pi * (inch x10 / 2) * 2.54 mm
+	wheel_circumference_mm = (uint16_t)((EXPAND_U16(g_config.wheel_size_inch_x10_u16h, g_config.wheel_size_inch_x10_u16l) * 798ul) / 100);
+
+	next_sample_ms = 0;
+	last_speed_pulses = speed_sensor_get_pulse_counter();
+
+	distance_mm = 0;
+	energy_ws_x1000 = 0;
+	charge_mas = 0;
+	motor_on_ms = 0;
+
+	segment_start_distance_m = g_trip.distance_m;
+	segment_start_energy_wh_x10 = g_trip.energy_wh_x10;
+
+	last_saved_odometer_m = g_trip.odometer_m;
+	last_saved_motor_on_s = g_trip.motor_on_s;
+	power_down_voltage_x10 = g_config.low_cut_off_v * TRIP_POWER_DOWN_VOLTAGE_PERCENT / 10;
+	power_down_saved = false;
+}
+
+bool trip_reset()
+{
+	g_trip.distance_m = 0;
+	g_trip.energy_wh_x10 = 0;
+	g_trip.max_speed_kph_x10 = 0;
+	g_trip.max_temperature_c = 0;
+
+	segment_start_distance_m = 0;
+	segment_start_energy_wh_x10 = 0;
+
+	last_saved_odometer_m = g_trip.odometer_m;
+	last_saved_motor_on_s = g_trip.motor_on_s;
+
+	return cfgstore_save_trip(false);
+}
+
+void trip_process()
+{
+	if (next_sample_ms == 0)
+	{
+		// first call, start schedule from now
+		next_sample_ms = system_ms();
+	}
+
+	if (system_ms() < next_sample_ms)
+	{
+		return;
+	}
+
+	// Fixed sample schedule, each sample accounts for exactly one interval.
+	// Rescheduling from now would lose the time main loop was late.
+	next_sample_ms += TRIP_SAMPLE_INTERVAL_MS;
+
+	// V x10 * A x10 during 100ms gives Ws x1000
+	energy_ws_x1000 += (uint32_t)motor_get_battery_voltage_x10() * motor_get_battery_current_x10() * TRIP_SAMPLE_INTERVAL_MS / 100;
+	while (energy_ws_x1000 >= 360000ul)
+	{
+		// 0.1Wh = 360Ws
+		energy_ws_x1000 -= 360000ul;
+		g_trip.energy_wh_x10++;
+		g_trip.total_energy_wh_x10++;
+	}
+
+	uint16_t pulses = speed_sensor_get_pulse_counter();
+	uint16_t new_pulses = pulses - last_speed_pulses;
+	last_speed_pulses = pulses;
+
+	if (new_pulses > 0 && g_config.speed_sensor_signals > 0)
+	{
+		distance_mm += (uint16_t)(((uint32_t)new_pulses * wheel_circumference_mm) / g_config.speed_sensor_signals);
+		while (distance_mm >= 1000)
+		{
+			distance_mm -= 1000;
+			g_trip.distance_m++;
+			g_trip.odometer_m++;
+		}
+
+		process_segment();
+	}
+
+	process_statistics();
+	process_save();
+}
+
+uint16_t trip_get_consumption_wh_km_x10()
+{
+	return g_trip.consumption_wh_km_x10;
+}
+
+uint16_t trip_get_range_km()
+{
+	if (g_trip.consumption_wh_km_x10 == 0)
+	{
+		return 0;
+	}
+
+	return (uint16_t)(((uint32_t)battery_get_remaining_wh() * 10) / g_trip.consumption_wh_km_x10);
+}
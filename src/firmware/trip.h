@@ -0,0 +1,27 @@
+/*
+ * bbs-fw
+ *
+ * Copyright (C) Daniel Nilsson, 2022.
+ *
+ * Released under the GPL License, Version 3
+ */
+
+#ifndef _TRIP_H_
+#define _TRIP_H_
+
+#include "intellisense.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+void trip_init();
+void trip_process();
+
+// Reset trip totals (not odometer and lifetime totals) and save.
+bool trip_reset();
+
+uint16_t trip_get_consumption_wh_km_x10();
+
+// Estimated remaining range, 0 if battery capacity is not configured.
+uint16_t trip_get_range_km();
+
+#endif
@@ -14,11 +14,18 @@
 #include "tsdz2/stm8s/stm8s.h"
 
 
-static volatile uint8_t adc_throttle;
+// throttle is averaged over a number of scan conversions
+#define THROTTLE_OVERSAMPLING_SHIFT		4 // 16x
+
+static volatile uint16_t adc_throttle;
 static volatile uint16_t adc_battery_voltage;
 static volatile uint16_t adc_torque;
 
+static uint16_t adc_throttle_sum;
+static uint8_t adc_throttle_samples;
+
 // cached variables read from voltatile uint16_t vars while ADC1 interrupt disabled
+static uint16_t adc_throttle_cache;
 static uint16_t adc_battery_voltage_cache;
 static uint16_t adc_torque_cache;
 
@@ -34,10 +41,10 @@ void adc_init()
 	// adc configuration (except ADC1->CR1) is overwritten in motor.c/isr_timer1_cmp
 	// which triggeres the conversion.
 	//
-	// The motor control interrupt routines performs single mode
-	// adc conversion of battery current, reads the result and
-	// then starts buffered scan mode conversion of all adc channels
-	// with end of conversion interrupt enabled which is handled here.
+	// The motor control interrupt routine starts buffered scan mode
+	// conversion of all adc channels with end of conversion interrupt
+	// enabled which is handled here. Battery current (channel 5) is
+	// read directly from the data buffer by the motor control isr.
 
 	ADC1->CR1 = ADC1_PRESSEL_FCPU_D2;
 	ADC1->CR2 = ADC1_ALIGN_LEFT;
@@ -58,16 +65,17 @@ void adc_process()
 	// Have to disable interrupts globally since ADC1->CSR register
 	// is manipulated from motor control isr. Very short time, should have no effect.
 	disableInterrupts();
+	adc_throttle_cache = adc_throttle;
 	adc_battery_voltage_cache = adc_battery_voltage; // adc_battery_voltage;
 	adc_torque_cache = adc_torque;
 	enableInterrupts();
 }
 
 
-uint8_t adc_get_throttle()
+uint16_t adc_get_throttle()
 {
-	// atomic read
-	return adc_throttle;
+	// 10 bit resolution
+	return adc_throttle_cache;
 }
 
 uint16_t adc_get_torque()
@@ -102,12 +110,20 @@ void isr_adc1(void) __interrupt(ITC_IRQ_ADC1)
 
 		// scan mode reads are setup to be left aligned in motor isr
 
-		// update cached values
-		adc_throttle = ADC1->DB7RH; // only 8bit resolution used
-
 		// must read in high -> low order according to data sheet
 		uint8_t high, low;
 
+		// read throttle
+		high = ADC1->DB7RH;
+		low = ADC1->DB7RL;
+		adc_throttle_sum += (uint16_t)high << 2 | low;
+		if (++adc_throttle_samples == (1 << THROTTLE_OVERSAMPLING_SHIFT))
+		{
+			adc_throttle = adc_throttle_sum >> THROTTLE_OVERSAMPLING_SHIFT;
+			adc_throttle_sum = 0;
+			adc_throttle_samples = 0;
+		}
+
 		// read torque
 		high = ADC1->DB4RH;
 		low = ADC1->DB4RL;
@@ -23,7 +23,8 @@ void eeprom_init()
 
 bool eeprom_select_page(int page)
 {
-	if (page >= 0 && page < 2)
+	// STM8S105 has 1kB data eeprom
+	if (page >= 0 && page < 4)
 	{
 		selected_address = EEPROM_START_ADDRESS + (page * 256);
 		return true;
@@ -14,7 +14,9 @@
 
 void isr_timer1_cmp(void) __interrupt(ITC_IRQ_TIM1_CAPCOM); // motor.c
 void isr_timer3_ovf(void) __interrupt(ITC_IRQ_TIM3_OVF);	// system.c
-void isr_timer4_ovf(void) __interrupt(ITC_IRQ_TIM4_OVF);	// sensors.c
+
+void isr_port_a(void) __interrupt(ITC_IRQ_PORTA);			// sensors.c
+void isr_port_d(void) __interrupt(ITC_IRQ_PORTD);			// sensors.c
 
 void isr_adc1(void) __interrupt(ITC_IRQ_ADC1);				// adc.c
 
@@ -14,6 +14,7 @@
 #include "system.h"
 #include "uart.h"
 #include "eventlog.h"
+#include "cfgstore.h"
 #include "util.h"
 #include "adc.h"
 #include "tsdz2/cpu.h"
@@ -53,6 +54,21 @@
 #define PWM_DUTY_CYCLE_RAMP_UP_INVERSE_STEP		24
 #define PWM_DUTY_CYCLE_RAMP_DOWN_INVERSE_STEP	28
 
+// Braking
+// ------------------------------------------
+// Brake lever sets duty cycle ramp down in isr, ramping down with outputs enabled
+// decelerates the motor electrically and returns energy to the battery.
+// Outputs are disabled when duty cycle reaches zero.
+// TSDZ2 drives the chainring through a freewheel so only the motor itself
+// is braked, not the wheel.
+#define MOTOR_BRAKE_MODE_COAST					0	// disable outputs immediately
+#define MOTOR_BRAKE_MODE_RAMP					1	// ramp down duty cycle
+
+#define MOTOR_BRAKE_MODE						MOTOR_BRAKE_MODE_RAMP
+
+// Braking strength in ramp mode, pwm cycles per duty cycle step (0 is strongest)
+#define PWM_DUTY_CYCLE_BRAKE_INVERSE_STEP		0
+
 // This value should be near 0.
 // You can try to tune with the whell on the air, full throttle and look at batttery current: adjust for lower battery current
 #define MOTOR_ROTOR_OFFSET_ANGLE				11
@@ -66,6 +82,10 @@
 #define PWM_DUTY_CYCLE_MAX						254
 #define PWM_DUTY_CYCLE_MIN						20
 
+// Electrical revolution period (in pwm cycles) at which the erps limits above are passed,
+// allows the isr to compare the measured period directly instead of dividing to erps.
+#define PWM_CYCLES_COUNTER_START_INTERPOLATION	(PWM_CYCLES_SECOND / (MOTOR_ROTOR_ERPS_START_INTERPOLATION_60_DEGREES + 1))
+
 #define MOTOR_ROTOR_ANGLE_90					(63  + MOTOR_ROTOR_OFFSET_ANGLE)
 #define MOTOR_ROTOR_ANGLE_150					(106 + MOTOR_ROTOR_OFFSET_ANGLE)
 #define MOTOR_ROTOR_ANGLE_210					(148 + MOTOR_ROTOR_OFFSET_ANGLE)
@@ -76,6 +96,24 @@
 // motor maximum rotation
 // 700 is equal to 124 cadence, as TSDZ2 has a reduction ratio of 41.8
 #define MAX_MOTOR_SPEED_ERPS					700 
+#define PWM_CYCLES_COUNTER_MAX_MOTOR_SPEED		(PWM_CYCLES_SECOND / (MAX_MOTOR_SPEED_ERPS + 1))
+
+// Hall sensor calibration
+// ------------------------------------------
+// Field is rotated open loop one svm table step every N pwm cycles,
+// 16 => 256 * 16 * 64us = 262ms per electrical revolution.
+#define HALL_CALIBRATION_ANGLE_STEP_PERIODS		16
+// Electrical revolutions to record, first revolution is skipped to let rotor settle.
+#define HALL_CALIBRATION_REVOLUTIONS			8
+#define HALL_CALIBRATION_PWM_DUTY_CYCLE_MAX		40
+// 5A phase current, 0.156A per adc step
+#define HALL_CALIBRATION_ADC_PHASE_CURRENT_MAX	32
+// Rotor aligns with the open loop field which is 90 degrees advanced
+// from the svm table index (table is -90 degree preadjusted).
+#define HALL_CALIBRATION_ANGLE_OFFSET			64
+// Allowed deviation from 60 degrees between hall transitions
+#define HALL_CALIBRATION_MAX_ANGLE_ERROR		12
+#define HALL_CALIBRATION_ANGLE_60_DEGREES		43
 
 // Set how often the motor speed limit controller runs in the isr
 #define SPEED_CONTROLLER_CHECK_PERIODS			2000
@@ -92,6 +130,23 @@
 
 #define ADC_10BIT_STEPS_PER_VOLT_X512			5953
 
+// Battery current sampling
+// ------------------------------------------
+// Current is converted as channel 5 of the buffered scan conversion started
+// first thing in the motor isr and read from the data buffer in the next isr.
+// TIM1 compare interrupt fires when counting down, sample point is moved
+// earlier (higher value) to compensate for conversion of channels 0-4
+// (5 * 14 adc clocks, fADC = fCPU / 2 => 140 timer ticks).
+#define ADC_CURRENT_SAMPLE_TIMING				285		// hand adjusted, middle of DC link current pulses
+#define ADC_CURRENT_SAMPLE_SCAN_DELAY			140
+
+// Sample point adjustment (timer ticks x256) per duty cycle step,
+// allows tracking the center of the current pulse as it widens with duty cycle.
+#define ADC_CURRENT_SAMPLE_TIMING_DUTY_X256		0
+
+// Number of pwm cycles (2^n) to average battery current samples over
+#define ADC_CURRENT_OVERSAMPLING_SHIFT			1
+
 
 // filter coefficients
 #define BATTERY_CURRENT_FILTER_COEFFICIENT		2
@@ -145,14 +200,28 @@ static const uint8_t sin_table[SIN_TABLE_LEN] =
 #define CONTROL_STATE_PREPARE			1
 #define CONTROL_STATE_START				2
 #define CONTROL_STATE_RUNNING			3
+#define CONTROL_STATE_HALL_CALIBRATION_START	4
+#define CONTROL_STATE_HALL_CALIBRATION	5
 
 
 static volatile uint8_t control_state = CONTROL_STATE_DISABLE;
 static volatile bool is_lvc_triggered = false;
+static volatile bool is_hvc_triggered = false;
 static volatile bool hall_sensor_error = false;
 
-// not atomic, protected by disabling interrupt while read in compute_foc_angle
-static volatile uint16_t speed_erps = 0; 
+// electrical revolution period measured in isr, speed_erps is calculated from it in main loop.
+// not atomic, protected by disabling interrupt while read in compute_speed_erps
+static volatile uint16_t pwm_cycles_counter_total = 0xffff;
+static volatile bool pwm_cycles_counter_total_updated = false;
+
+// interpolation angle increment per pwm cycle (x256), calculated in main loop.
+// not atomic, protected by disabling interrupt while written in compute_speed_erps
+static volatile uint16_t interpolation_angle_step_x256 = 0;
+
+// duty cycle to restart from when motor is enabled while rotating
+static volatile uint8_t pwm_duty_cycle_restart = 0;
+
+static uint16_t speed_erps = 0;
 
 // current reading saved in 8 bits for atomic access, not expected to exceed 255 (40A)
 static volatile uint8_t adc_battery_current = 0;	
@@ -164,8 +233,32 @@ static volatile uint8_t foc_angle = 0;
 static volatile uint8_t pwm_duty_cycle = 0;
 static volatile uint8_t pwm_duty_cycle_target = 0;
 
+// rotor angle for each hall sensor state, index is hall state (1-6).
+// only written from main loop when motor is disabled.
+static volatile uint8_t hall_angle_table[8] =
+{
+	0,
+	(uint8_t)MOTOR_ROTOR_ANGLE_210,
+	(uint8_t)MOTOR_ROTOR_ANGLE_90,
+	(uint8_t)MOTOR_ROTOR_ANGLE_150,
+	(uint8_t)MOTOR_ROTOR_ANGLE_330,
+	(uint8_t)MOTOR_ROTOR_ANGLE_270,
+	(uint8_t)MOTOR_ROTOR_ANGLE_30,
+	0
+};
+
+// hall calibration, accumulated in isr, evaluated in main loop when finished
+static volatile uint8_t hall_calibration_state = MOTOR_HALL_CALIBRATION_IDLE;
+static volatile bool hall_calibration_finished = false;
+static uint8_t hall_calibration_first_angle[8];
+static int16_t hall_calibration_angle_sum[8];
+static uint8_t hall_calibration_samples[8];
+
 // calculated constant limits (from config)
 static uint16_t adc_low_voltage_limit = 0;
+static uint16_t adc_high_voltage_limit = 0;
+static uint16_t adc_high_voltage_hysteresis = 0;
+static uint8_t adc_high_voltage_limit_8bit = 0xff;
 static uint8_t adc_battery_max_current = 0;
 static uint8_t adc_phase_max_current = 0;
 
@@ -228,6 +321,14 @@ static void flash_opt2_afr5()
 	}
 }
 
+static void compute_voltage_limits()
+{
+	adc_low_voltage_limit = (uint16_t)((((uint32_t)lvc_x10V) * adc_steps_per_volt_x512) / 5120);
+	adc_high_voltage_limit = (uint16_t)((((uint32_t)HIGH_VOLTAGE_LIMIT_X100V) * adc_steps_per_volt_x512) / 51200);
+	adc_high_voltage_hysteresis = (uint16_t)((((uint32_t)HIGH_VOLTAGE_HYSTERESIS_X100V) * adc_steps_per_volt_x512) / 51200);
+	adc_high_voltage_limit_8bit = (uint8_t)(adc_high_voltage_limit >> 2);
+}
+
 static void read_battery_voltage()
 {
 	// low pass filter the voltage readed value, to avoid possible fast spikes/noise
@@ -236,6 +337,15 @@ static void read_battery_voltage()
 	adc_battery_voltage_filtered = adc_battery_voltage_accumulated >> BATTERY_VOLTAGE_FILTER_COEFFICIENT;
 
 	is_lvc_triggered = (adc_battery_voltage_filtered < adc_low_voltage_limit);
+
+	if (adc_battery_voltage_filtered > adc_high_voltage_limit)
+	{
+		is_hvc_triggered = true;
+	}
+	else if (adc_battery_voltage_filtered < adc_high_voltage_limit - adc_high_voltage_hysteresis)
+	{
+		is_hvc_triggered = false;
+	}
 }
 
 static void read_battery_current()
@@ -272,6 +382,149 @@ static uint8_t asin_table(uint8_t inverted_angle_x128)
 	return index--;
 }
 
+static void update_current_sample_timing()
+{
+	static uint8_t last_duty_cycle = 0xff;
+
+	uint8_t duty_cycle = pwm_duty_cycle;
+	if (duty_cycle == last_duty_cycle)
+	{
+		return;
+	}
+
+	last_duty_cycle = duty_cycle;
+
+	int32_t timing = ADC_CURRENT_SAMPLE_TIMING + ADC_CURRENT_SAMPLE_SCAN_DELAY +
+		(((int32_t)duty_cycle * ADC_CURRENT_SAMPLE_TIMING_DUTY_X256) >> 8);
+	if (timing < 1)
+	{
+		timing = 1;
+	}
+	else if (timing > 510)
+	{
+		timing = 510;
+	}
+
+	TIM1->IER &= ~(uint8_t)TIM1_IT_CC4;
+	TIM1->CCR4H = (uint8_t)(timing >> 8);
+	TIM1->CCR4L = (uint8_t)timing;
+	TIM1->IER |= TIM1_IT_CC4;
+}
+
+static void compute_speed_erps()
+{
+	if (!pwm_cycles_counter_total_updated)
+	{
+		return;
+	}
+
+	TIM1->IER &= ~(uint8_t)TIM1_IT_CC4;
+	uint16_t period = pwm_cycles_counter_total;
+	pwm_cycles_counter_total_updated = false;
+	TIM1->IER |= TIM1_IT_CC4;
+
+	// period is never 0, counted from 1 in isr
+	speed_erps = PWM_CYCLES_SECOND / period;
+
+	// Interpolation angle (256 is one electrical revolution) is calculated in isr
+	// by multiplying pwm cycles since last hall transition with this step.
+	uint16_t angle_step_x256 = period > 1 ? (uint16_t)(0x10000UL / period) : 0xffff;
+
+	// Restart from duty cycle mapped from erps.
+	// This is probably not the correct way to do this, but
+	// it seems to work reasonably well. VESC tracks back-emf
+	// to calculate duty cyle to restart from...
+	uint8_t duty_cycle_restart = 0;
+	if (speed_erps > 0)
+	{
+		uint16_t erps = speed_erps < MAX_MOTOR_SPEED_ERPS ? speed_erps : MAX_MOTOR_SPEED_ERPS;
+		duty_cycle_restart = (uint8_t)MAP32(erps, 0, MAX_MOTOR_SPEED_ERPS, PWM_DUTY_CYCLE_MIN, PWM_DUTY_CYCLE_MAX);
+	}
+
+	TIM1->IER &= ~(uint8_t)TIM1_IT_CC4;
+	interpolation_angle_step_x256 = angle_step_x256;
+	pwm_duty_cycle_restart = duty_cycle_restart;
+	TIM1->IER |= TIM1_IT_CC4;
+}
+
+static void set_hall_angle_table(uint8_t* angles)
+{
+	TIM1->IER &= ~(uint8_t)TIM1_IT_CC4;
+	for (uint8_t i = 0; i < MOTOR_HALL_STATES; ++i)
+	{
+		hall_angle_table[i + 1] = angles[i];
+	}
+	TIM1->IER |= TIM1_IT_CC4;
+}
+
+static void process_hall_calibration()
+{
+	if (!hall_calibration_finished)
+	{
+		return;
+	}
+
+	hall_calibration_finished = false;
+
+	uint8_t angles[MOTOR_HALL_STATES];
+	bool ok = hall_calibration_state == MOTOR_HALL_CALIBRATION_RUNNING;
+
+	for (uint8_t i = 0; ok && i < MOTOR_HALL_STATES; ++i)
+	{
+		uint8_t state = i + 1;
+		if (hall_calibration_samples[state] == 0)
+		{
+			ok = false;
+			break;
+		}
+
+		angles[i] = (uint8_t)(hall_calibration_first_angle[state] +
+			(int8_t)(hall_calibration_angle_sum[state] / hall_calibration_samples[state]) +
+			HALL_CALIBRATION_ANGLE_OFFSET);
+	}
+
+	// each hall state must be followed by another one about 60 degrees later,
+	// this also verifies that all six states are distinct.
+	for (uint8_t i = 0; ok && i < MOTOR_HALL_STATES; ++i)
+	{
+		uint8_t next = 0xff;
+		for (uint8_t j = 0; j < MOTOR_HALL_STATES; ++j)
+		{
+			uint8_t diff = angles[j] - angles[i];
+			if (j != i && diff < next)
+			{
+				next = diff;
+			}
+		}
+
+		if (next < HALL_CALIBRATION_ANGLE_60_DEGREES - HALL_CALIBRATION_MAX_ANGLE_ERROR ||
+			next > HALL_CALIBRATION_ANGLE_60_DEGREES + HALL_CALIBRATION_MAX_ANGLE_ERROR)
+		{
+			ok = false;
+		}
+	}
+
+	if (ok)
+	{
+		for (uint8_t i = 0; i < MOTOR_HALL_STATES; ++i)
+		{
+			g_pstate.hall_angles[i] = angles[i];
+			eventlog_write_data(EVT_DATA_HALL_CALIBRATION, ((int16_t)(i + 1) << 8) | angles[i]);
+		}
+
+		g_pstate.hall_calibrated = 1;
+		set_hall_angle_table(angles);
+		ok = cfgstore_save_pstate();
+	}
+
+	if (!ok)
+	{
+		eventlog_write(EVT_ERROR_HALL_CALIBRATION);
+	}
+
+	hall_calibration_state = ok ? MOTOR_HALL_CALIBRATION_OK : MOTOR_HALL_CALIBRATION_FAILED;
+}
+
 static void compute_foc_angle()
 {
 	uint16_t ui16_temp;
@@ -307,10 +560,7 @@ static void compute_foc_angle()
 
 	// calc W angular velocity: erps * 6.3
 	// 101 = 6.3 * 16
-	TIM1->IER &= ~(uint8_t)TIM1_IT_CC4;
-	ui16_temp = speed_erps;
-	TIM1->IER |= TIM1_IT_CC4;
-	w_angular_velocity_x16 = ui16_temp * 101;
+	w_angular_velocity_x16 = speed_erps * 101;
 
 	// ---------------------------------------------------------------------------------------------------------------------
 	// 36 V motor: L = 76uH
@@ -381,10 +631,16 @@ void motor_init(uint16_t max_current_mA, uint8_t lvc_V, int16_t adc_calib_volt_s
 		((((uint32_t)MAX_MOTOR_PHASE_CURRENT_AMPS_X10) * 512) / 10) / ADC_10BIT_CURRENT_PER_ADC_STEP_X512
 	);
 
-	adc_low_voltage_limit = (uint16_t)((((uint32_t)lvc_V) * adc_steps_per_volt_x512) / 512);
+	compute_voltage_limits();
+
+	if (g_pstate.hall_calibrated)
+	{
+		set_hall_angle_table(g_pstate.hall_angles);
+	}
 
 	flash_opt2_afr5();
 	timer1_init_motor_pwm();
+	update_current_sample_timing();
 	motor_disable();
 }
 
@@ -393,13 +649,16 @@ void motor_process()
 	read_battery_voltage();
 	read_battery_current();
 	read_phase_current();
+	update_current_sample_timing();
+	compute_speed_erps();
 	compute_foc_angle();
+	process_hall_calibration();
 }
 
 
 void motor_enable()
 {
-	if (control_state == CONTROL_STATE_DISABLE)
+	if (control_state == CONTROL_STATE_DISABLE && !is_hvc_triggered)
 	{
 		control_state = CONTROL_STATE_PREPARE;
 	}
@@ -407,7 +666,11 @@ void motor_enable()
 
 void motor_disable()
 {
-	control_state = CONTROL_STATE_DISABLE;
+	// hall calibration is ended from isr
+	if (control_state < CONTROL_STATE_HALL_CALIBRATION_START)
+	{
+		control_state = CONTROL_STATE_DISABLE;
+	}
 }
 
 uint16_t motor_status()
@@ -421,6 +684,9 @@ uint16_t motor_status()
 	if (is_lvc_triggered)
 		status |= MOTOR_ERROR_LVC;
 
+	if (is_hvc_triggered)
+		status |= MOTOR_ERROR_HVC;
+
 	if (status != last_status)
 	{
 		last_status = status;
@@ -497,12 +763,44 @@ int16_t motor_calibrate_battery_voltage(uint16_t actual_voltage_x100)
 		diff = 0;
 	}
 
+	compute_voltage_limits();
+
 	eventlog_write_data(EVT_DATA_CALIBRATE_VOLTAGE, adc_steps_per_volt_x512);
 
 	return diff;
 }
 
 
+bool motor_start_hall_calibration()
+{
+	if (control_state != CONTROL_STATE_DISABLE || pwm_duty_cycle != 0 || speed_erps != 0 ||
+		hall_calibration_state == MOTOR_HALL_CALIBRATION_RUNNING)
+	{
+		return false;
+	}
+
+	for (uint8_t i = 0; i < 8; ++i)
+	{
+		hall_calibration_first_angle[i] = 0;
+		hall_calibration_angle_sum[i] = 0;
+		hall_calibration_samples[i] = 0;
+	}
+
+	hall_calibration_finished = false;
+	hall_calibration_state = MOTOR_HALL_CALIBRATION_RUNNING;
+	control_state = CONTROL_STATE_HALL_CALIBRATION_START;
+
+	eventlog_write(EVT_MSG_HALL_CALIBRATION_STARTED);
+
+	return true;
+}
+
+uint8_t motor_get_hall_calibration_state()
+{
+	return hall_calibration_state;
+}
+
+
 uint16_t motor_get_battery_lvc_x10()
 {
 	return lvc_x10V;
@@ -518,6 +816,17 @@ uint16_t motor_get_battery_voltage_x10()
 	return (uint16_t)(((uint32_t)adc_battery_voltage_filtered * 5120) / adc_steps_per_volt_x512);
 }
 
+void motor_set_limiting_active(bool active)
+{
+	// readings are always sampled by this firmware
+}
+
+uint16_t motor_get_com_errors(uint8_t counter)
+{
+	// no separate motor controller mcu
+	return 0;
+}
+
 
 // state variables only used by isr
 // ---------------------------------------------
@@ -528,10 +837,10 @@ static uint8_t commutation_type = BLOCK_COMMUTATION;
 
 static uint16_t pwm_duty_cycle_ramp_up_counter = 0;
 static uint16_t pwm_duty_cycle_ramp_down_counter = 0;
+static uint16_t pwm_duty_cycle_brake_counter = 0;
 
 static uint16_t pwm_cycles_counter = 1;
 static uint16_t pwm_cycles_counter_6 = 1;
-static uint16_t pwm_cycles_counter_total = 0xffff;
 
 static uint16_t adc_current_ramp_up_counter = 0;
 static uint8_t current_controller_counter = 0;
@@ -539,6 +848,16 @@ static uint16_t speed_controller_counter = 0;
 
 static uint8_t adc_battery_ramp_max_current = 0;
 
+#if ADC_CURRENT_OVERSAMPLING_SHIFT > 0
+static uint8_t adc_current_samples[1 << ADC_CURRENT_OVERSAMPLING_SHIFT];
+static uint8_t adc_current_sample_index = 0;
+static uint16_t adc_current_samples_sum = 0;
+#endif
+
+static uint8_t hall_calibration_angle = 0;
+static uint8_t hall_calibration_step_counter = 0;
+static uint8_t hall_calibration_revolutions = 0;
+
 // Measures did with a 24V Q85 328 RPM motor, rotating motor backwards by hand:
 // Hall sensor A positive to negative transition | BEMF phase B at max value / top of sinewave
 // Hall sensor B positive to negative transition | BEMF phase A at max value / top of sinewave
@@ -548,25 +867,51 @@ static uint8_t adc_battery_ramp_max_current = 0;
 // Measured on 2022-12-04, the interrupt code takes about 45% of the total 64us
 void isr_timer1_cmp(void) __interrupt(ITC_IRQ_TIM1_CAPCOM)
 {
-	// read battery current adc value, should happen at middle of the pwm duty cycle
-	// no scan, align data right since we are only interested in the 8 lsb.
-	ADC1->CR2 = (ADC1_ALIGN_RIGHT);
+	// Battery current from the scan conversion started in previous isr,
+	// finished long before now. Must read in high -> low order according to data sheet.
+	uint8_t adc_current_high = ADC1->DB5RH;
+	uint8_t adc_current_low = ADC1->DB5RL;
+
+	// Battery voltage from same scan conversion (8 msb), unfiltered check trips
+	// over voltage protection without main loop delay, bus voltage can rise
+	// within a few pwm cycles when energy is returned while braking.
+	// Released from main loop with hysteresis on filtered voltage.
+	if (ADC1->DB6RH > adc_high_voltage_limit_8bit)
+	{
+		is_hvc_triggered = true;
+	}
+
+	// trigger adc conversion of all channels (scan conversion, buffered)
+	// as early as possible to have a fixed delay to the current sample point,
+	// scan conversion will finish before this motor control interrupt will be run next time
+	// 
+	// enable scan, align left
+	ADC1->CR2 = (ADC1_ALIGN_LEFT | ADC1_CR2_SCAN);
 
-	// disable eoc interrupt, clear EOC flag and select channel 5 (current sense)
-	ADC1->CSR = 0x05;
+	// clear EOC flag, enable eoc interrupt, scan read all channel 0-7
+	ADC1->CSR = (ADC1_CSR_EOCIE | 0x07);
 
-	// perform single mode ADC1 conversion
+	// start adc scan mode conversion
 	ADC1->CR1 |= ADC1_CR1_ADON;
-	while (!(ADC1->CSR & ADC1_CSR_EOC));
 
 	// adc current reading is truncated to 8bit since that allows a 
 	// range of up to 40A which it is not expected to be surpassed.
-	// check of 8bit overflow and save result, flag is used to limit
-	// current in isr if overflow for some reason would occur.
-	uint8_t adc_battery_current_ovf = ADC1->DRH;
+	// check of 8bit overflow (left aligned, 2 msb of high byte), flag is used
+	// to limit current in isr if overflow for some reason would occur.
+	uint8_t adc_battery_current_ovf = adc_current_high & 0xc0;
+	uint8_t adc_current_sample = (uint8_t)(adc_current_high << 2) | (adc_current_low & 0x03);
+
+#if ADC_CURRENT_OVERSAMPLING_SHIFT > 0
+	adc_current_samples_sum -= adc_current_samples[adc_current_sample_index];
+	adc_current_samples_sum += adc_current_sample;
+	adc_current_samples[adc_current_sample_index] = adc_current_sample;
+	adc_current_sample_index = (adc_current_sample_index + 1) & ((1 << ADC_CURRENT_OVERSAMPLING_SHIFT) - 1);
 
 	// atomic write (uint8), current is not expected to exceed adc 255 (40A)
-	adc_battery_current = ADC1->DRL;
+	adc_battery_current = (uint8_t)(adc_current_samples_sum >> ADC_CURRENT_OVERSAMPLING_SHIFT);
+#else
+	adc_battery_current = adc_current_sample;
+#endif
 
 	switch (control_state)
 	{
@@ -577,22 +922,30 @@ void isr_timer1_cmp(void) __interrupt(ITC_IRQ_TIM1_CAPCOM)
 		TIM1->CCER2 &= ~(uint8_t)(TIM1_CCER2_CC3E | TIM1_CCER2_CC3NE);	// OC3
 		break;
 	case CONTROL_STATE_PREPARE:
-		if (speed_erps > 0)
+		if (pwm_duty_cycle_restart > 0)
 		{
-			// Restart from duty cycle mapped from erps.
-			// This is probably not the correct way to do this, but
-			// it seems to work reasonably well. VESC tracks back-emf
-			// to calculate duty cyle to restart from...
-			pwm_duty_cycle = (uint8_t)MAP32(speed_erps, 0, MAX_MOTOR_SPEED_ERPS, PWM_DUTY_CYCLE_MIN, PWM_DUTY_CYCLE_MAX);
-		}	
+			pwm_duty_cycle = pwm_duty_cycle_restart;
+		}
 		control_state = CONTROL_STATE_START;
 		break;
 	case CONTROL_STATE_START:
+	case CONTROL_STATE_HALL_CALIBRATION_START:
 		// enable outputs
 		TIM1->CCER1 |= (uint8_t)(TIM1_CCER1_CC1E | TIM1_CCER1_CC1NE); 	// OC1
 		TIM1->CCER1 |= (uint8_t)(TIM1_CCER1_CC2E | TIM1_CCER1_CC2NE);	// OC2
 		TIM1->CCER2 |= (uint8_t)(TIM1_CCER2_CC3E | TIM1_CCER2_CC3NE);	// OC3
-		control_state = CONTROL_STATE_RUNNING;
+
+		if (control_state == CONTROL_STATE_HALL_CALIBRATION_START)
+		{
+			hall_calibration_angle = 0;
+			hall_calibration_step_counter = 0;
+			hall_calibration_revolutions = 0;
+			control_state = CONTROL_STATE_HALL_CALIBRATION;
+		}
+		else
+		{
+			control_state = CONTROL_STATE_RUNNING;
+		}
 		break;
 	default:
 		break;
@@ -609,23 +962,9 @@ void isr_timer1_cmp(void) __interrupt(ITC_IRQ_TIM1_CAPCOM)
 		adc_phase_current = 0;
 	}
 
-	// trigger adc conversion of all channels (scan conversion, buffered)
-	// adc scan mode conversion will finish before
-	// this motor control interrupt will be run next time
-	// 
-	// enable scan, align left
-	ADC1->CR2 = (ADC1_ALIGN_LEFT | ADC1_CR2_SCAN);
-
-	// clear EOC flag, enable eoc interrupt, scan read all channel 0-7
-	ADC1->CSR = (ADC1_CSR_EOCIE | 0x07);
-
-	// start adc scan mode conversion
-	ADC1->CR1 |= ADC1_CR1_ADON;
-
-
 	// read hall sensor signals
 	// find the motor rotor absolute angle
-	// calc motor speed in erps (speed_erps)
+	// measure electrical revolution period (speed_erps is calculated from it in main loop)
 
 	// read hall sensors signal pins and mask other pins
 	// hall sensors sequence with motor forward rotation: 4, 6, 2, 3, 1, 5
@@ -639,75 +978,63 @@ void isr_timer1_cmp(void) __interrupt(ITC_IRQ_TIM1_CAPCOM)
 	{
 		hall_sensors_state_last = hall_sensors_state;
 
-		switch (hall_sensors_state)
+		if (hall_sensors_state == 0 || hall_sensors_state == 7)
 		{
-		case 3:
-			rotor_absolute_angle = (uint8_t)MOTOR_ROTOR_ANGLE_150;
-			break;
-
-		case 1:
-			if (half_erps_flag == 1)
-			{
-				half_erps_flag = 0;
-				pwm_cycles_counter_total = pwm_cycles_counter;
-				pwm_cycles_counter = 1;
+			// invalid hall sensor signal
+			hall_sensor_error = true;
+			return;
+		}
 
-				if (pwm_cycles_counter_total > 0)
-				{
-					// This division takes 4.4us
-					speed_erps = PWM_CYCLES_SECOND / pwm_cycles_counter_total;
-				}
-				else
-				{
-					speed_erps = PWM_CYCLES_SECOND;
-				}
+		// Speed is measured from transitions into state 1, half way (state 6) must
+		// be passed before. Opposite hall state is always the bitwise complement.
+		if (hall_sensors_state == 6)
+		{
+			half_erps_flag = 1;
+		}
+		else if (hall_sensors_state == 1 && half_erps_flag == 1)
+		{
+			half_erps_flag = 0;
+			pwm_cycles_counter_total = pwm_cycles_counter;
+			pwm_cycles_counter_total_updated = true;
+			pwm_cycles_counter = 1;
 
-				// update motor commutation state based on motor speed
-				if (speed_erps > MOTOR_ROTOR_ERPS_START_INTERPOLATION_60_DEGREES)
+			// update motor commutation state based on motor speed
+			if (pwm_cycles_counter_total <= PWM_CYCLES_COUNTER_START_INTERPOLATION)
+			{
+				if (commutation_type == BLOCK_COMMUTATION)
 				{
-					if (commutation_type == BLOCK_COMMUTATION)
-					{
-						commutation_type = SINEWAVE_INTERPOLATION_60_DEGREES;
-					}
+					commutation_type = SINEWAVE_INTERPOLATION_60_DEGREES;
 				}
-				else
+			}
+			else
+			{
+				if (commutation_type == SINEWAVE_INTERPOLATION_60_DEGREES)
 				{
-					if (commutation_type == SINEWAVE_INTERPOLATION_60_DEGREES)
-					{
-						commutation_type = BLOCK_COMMUTATION;
-						foc_angle = 0;
-					}
+					commutation_type = BLOCK_COMMUTATION;
+					foc_angle = 0;
 				}
 			}
+		}
 
-			rotor_absolute_angle = (uint8_t)MOTOR_ROTOR_ANGLE_210;
-			break;
-
-		case 5:
-			rotor_absolute_angle = (uint8_t)MOTOR_ROTOR_ANGLE_270;
-			break;
-
-		case 4:
-			rotor_absolute_angle = (uint8_t)MOTOR_ROTOR_ANGLE_330;
-			break;
-
-		case 6:
-			half_erps_flag = 1;
-
-			rotor_absolute_angle = (uint8_t)MOTOR_ROTOR_ANGLE_30;
-			break;
+		// BEMF is always 90 degrees advanced over motor rotor position degree zero
+		// and on hall sensor C blue wire, signal transition from positive to negative (state 2),
+		// phase B BEMF is at max value (measured on osciloscope by rotating the motor)
+		rotor_absolute_angle = hall_angle_table[hall_sensors_state];
 
-			// BEMF is always 90 degrees advanced over motor rotor position degree zero
-			// and here (hall sensor C blue wire, signal transition from positive to negative),
-			// phase B BEMF is at max value (measured on osciloscope by rotating the motor)
-		case 2:
-			rotor_absolute_angle = (uint8_t)MOTOR_ROTOR_ANGLE_90;
-			break;
+		// record open loop angle on hall transitions, rotor settles during first revolution
+		if (control_state == CONTROL_STATE_HALL_CALIBRATION && hall_calibration_revolutions > 0)
+		{
+			if (hall_calibration_samples[hall_sensors_state] == 0)
+			{
+				hall_calibration_first_angle[hall_sensors_state] = hall_calibration_angle;
+			}
 
-		default:
-			// invalid hall sensor signal
-			hall_sensor_error = true;
-			return;
+			if (hall_calibration_samples[hall_sensors_state] < 0xff)
+			{
+				hall_calibration_angle_sum[hall_sensors_state] +=
+					(int8_t)(hall_calibration_angle - hall_calibration_first_angle[hall_sensors_state]);
+				++hall_calibration_samples[hall_sensors_state];
+			}
 		}
 
 		hall_sensor_error = false;
@@ -725,8 +1052,8 @@ void isr_timer1_cmp(void) __interrupt(ITC_IRQ_TIM1_CAPCOM)
 		pwm_cycles_counter = 1; // don't put to 0 to avoid 0 divisions
 		pwm_cycles_counter_6 = 1;
 		half_erps_flag = 0;
-		speed_erps = 0;
 		pwm_cycles_counter_total = 0xffff;
+		pwm_cycles_counter_total_updated = true;
 		foc_angle = 0;
 		commutation_type = BLOCK_COMMUTATION;
 		hall_sensors_state_last = 0; // this way we force execution of hall sensors code next time
@@ -740,9 +1067,10 @@ void isr_timer1_cmp(void) __interrupt(ITC_IRQ_TIM1_CAPCOM)
 	// calculate the interpolation angle (and it doesn't work when motor starts and at very low speeds)
 	if (commutation_type == SINEWAVE_INTERPOLATION_60_DEGREES)
 	{
-		// division by 0: motor_pwm_cycles_counter_total should never be 0
-		// TODO: verifiy if (motor_pwm_cycles_counter_6 << 8) do not overflow
-		uint8_t interpolation_angle = (pwm_cycles_counter_6 << 8) / pwm_cycles_counter_total; // this operations take 4.4us
+		// angle step is the reciprocal of the revolution period calculated in main loop,
+		// avoids a 16bit division here. Product only wraps if no hall transition was
+		// seen for a full electrical revolution, same as the division did before.
+		uint8_t interpolation_angle = (uint8_t)((uint16_t)(pwm_cycles_counter_6 * interpolation_angle_step_x256) >> 8);
 		svm_table_index += interpolation_angle;
 	}
 #endif
@@ -759,11 +1087,86 @@ void isr_timer1_cmp(void) __interrupt(ITC_IRQ_TIM1_CAPCOM)
 	++current_controller_counter;
 	++speed_controller_counter;
 
-	if	(
+	if (control_state == CONTROL_STATE_HALL_CALIBRATION)
+	{
+		// abort on brake or hall sensor error (isr returns early on invalid state)
+		if (GET_PIN_INPUT_STATE(PIN_BRAKE) == 0 || hall_sensor_error)
+		{
+			hall_calibration_state = MOTOR_HALL_CALIBRATION_FAILED;
+			hall_calibration_finished = true;
+			control_state = CONTROL_STATE_DISABLE;
+		}
+		else if (++hall_calibration_step_counter >= HALL_CALIBRATION_ANGLE_STEP_PERIODS)
+		{
+			hall_calibration_step_counter = 0;
+			if (++hall_calibration_angle == 0 && ++hall_calibration_revolutions > HALL_CALIBRATION_REVOLUTIONS)
+			{
+				hall_calibration_finished = true;
+				control_state = CONTROL_STATE_DISABLE;
+			}
+		}
+
+		// open loop field rotation
+		svm_table_index = hall_calibration_angle;
+
+		// keep motor phase current low
+		if (adc_battery_current_ovf || adc_phase_current > HALL_CALIBRATION_ADC_PHASE_CURRENT_MAX)
+		{
+			if (pwm_duty_cycle)
+			{
+				--pwm_duty_cycle;
+			}
+		}
+		else if (pwm_duty_cycle < HALL_CALIBRATION_PWM_DUTY_CYCLE_MAX)
+		{
+			if (pwm_duty_cycle_ramp_up_counter++ >= PWM_DUTY_CYCLE_RAMP_UP_INVERSE_STEP)
+			{
+				pwm_duty_cycle_ramp_up_counter = 0;
+				++pwm_duty_cycle;
+			}
+		}
+	}
+	else if (
+			is_hvc_triggered
+#if MOTOR_BRAKE_MODE == MOTOR_BRAKE_MODE_COAST
+			|| (GET_PIN_INPUT_STATE(PIN_BRAKE) == 0) //active low
+#endif
+		)
+	{
+		// stop returning energy to battery, disable outputs now since
+		// zero duty cycle with outputs enabled would short the phases
+		TIM1->CCER1 &= ~(uint8_t)(TIM1_CCER1_CC1E | TIM1_CCER1_CC1NE);	// OC1
+		TIM1->CCER1 &= ~(uint8_t)(TIM1_CCER1_CC2E | TIM1_CCER1_CC2NE);	// OC2
+		TIM1->CCER2 &= ~(uint8_t)(TIM1_CCER2_CC3E | TIM1_CCER2_CC3NE);	// OC3
+
+		pwm_duty_cycle = 0;
+		if (control_state != CONTROL_STATE_DISABLE)
+		{
+			control_state = CONTROL_STATE_DISABLE;
+		}
+	}
+	else if (GET_PIN_INPUT_STATE(PIN_BRAKE) == 0) //active low
+	{
+		if (pwm_duty_cycle && pwm_duty_cycle_brake_counter++ >= PWM_DUTY_CYCLE_BRAKE_INVERSE_STEP)
+		{
+			pwm_duty_cycle_brake_counter = 0;
+			--pwm_duty_cycle;
+		}
+
+		if (pwm_duty_cycle == 0)
+		{
+			// ramp down done, disable outputs since zero duty cycle
+			// with outputs enabled would short the phases
+			TIM1->CCER1 &= ~(uint8_t)(TIM1_CCER1_CC1E | TIM1_CCER1_CC1NE);	// OC1
+			TIM1->CCER1 &= ~(uint8_t)(TIM1_CCER1_CC2E | TIM1_CCER1_CC2NE);	// OC2
+			TIM1->CCER2 &= ~(uint8_t)(TIM1_CCER2_CC3E | TIM1_CCER2_CC3NE);	// OC3
+			control_state = CONTROL_STATE_DISABLE;
+		}
+	}
+	else if	(
 			control_state == CONTROL_STATE_DISABLE ||
 			is_lvc_triggered ||
-			(pwm_duty_cycle_target == 0) ||
-			(GET_PIN_INPUT_STATE(PIN_BRAKE) == 0) //active low
+			(pwm_duty_cycle_target == 0)
 		)
 	{
 		if (pwm_duty_cycle)
@@ -792,7 +1195,7 @@ void isr_timer1_cmp(void) __interrupt(ITC_IRQ_TIM1_CAPCOM)
 	}
 	else if (
 		speed_controller_counter > SPEED_CONTROLLER_CHECK_PERIODS && // test about every 100ms
-		speed_erps > MAX_MOTOR_SPEED_ERPS
+		pwm_cycles_counter_total <= PWM_CYCLES_COUNTER_MAX_MOTOR_SPEED
 	)
 	{
 		if (pwm_duty_cycle)
@@ -7,159 +7,84 @@
  */
 
 #include "sensors.h"
+#include "sensors_core.h"
 #include "intellisense.h"
 #include "fwconfig.h"
+#include "system.h"
 #include "tsdz2/interrupt.h"
-#include "tsdz2/timers.h"
 #include "tsdz2/stm8.h"
 #include "tsdz2/pins.h"
-#include "tsdz2/stm8s/stm8s_tim4.h"
+#include "tsdz2/stm8s/stm8s_exti.h"
 
-// interrupt runs at 100us interval, see timer4 setup in timers.c
+// PAS and speed sensor are edge triggered through port external interrupts,
+// ticks are us from system timer, edges are decoded in sensors_core.c.
 
-// :TODO: this file contains a lot of duplicated code from bbsx version, try to share code
+static volatile uint32_t pas_last_edge_us;
+static volatile uint32_t speed_last_edge_us;
 
-#define PAS_SENSOR_NUM_SIGNALS			PAS_PULSES_REVOLUTION
-#define PAS_SENSOR_MIN_PULSE_MS_X10		50	// 500rpm limit
-
-#define SPEED_SENSOR_MIN_PULSE_MS_X10	500
-#define SPEED_SENSOR_TIMEOUT_MS_X10		25000
-
-
-static volatile uint16_t pas_pulse_counter;
-static volatile bool pas_direction_backward;
-static volatile uint16_t pas_period_length;	// pulse length counted in interrupt frequency (100us)
-static uint16_t pas_period_counter;
-static bool pas_prev1;
-static bool pas_prev2;
-static uint16_t pas_stop_delay_periods;
-
-static volatile uint16_t speed_ticks_period_length; // pulse length counted in interrupt frequency (100us)
-static uint16_t speed_period_counter;
-static bool speed_prev_state;
-static uint8_t speed_ticks_per_rpm;
+// nesting depth of sensors_disable_interrupts
+static uint8_t sensors_interrupts_disabled;
 
 extern void torque_sensor_init();
 extern void torque_sensor_process();
 
+static void process_timeouts();
+
 void sensors_init()
 {
-	pas_period_counter = 0;
-	pas_pulse_counter = 0;
-	pas_direction_backward = false;
-	pas_period_length = 0;
-	pas_stop_delay_periods = 1500;
-	speed_period_counter = 0;
-	speed_ticks_period_length = 0;
-	speed_prev_state = false;
-	speed_ticks_per_rpm = 1;
-
-	// pins do not have external interrupt, use timer0 to evaluate state frequently
+	pas_last_edge_us = 0;
+	speed_last_edge_us = 0;
+	sensors_interrupts_disabled = 0;
+
+	sensors_core_init();
+
 	SET_PIN_INPUT(PIN_PAS1);
 	SET_PIN_INPUT(PIN_PAS2);
 	SET_PIN_INPUT(PIN_SPEED_SENSOR);
 	SET_PIN_INPUT_PULLUP(PIN_BRAKE);
 
-	pas_prev1 = GET_PIN_INPUT_STATE(PIN_PAS1);
-	pas_prev2 = GET_PIN_INPUT_STATE(PIN_PAS2);
-
 	torque_sensor_init();
 	torque_sensor_process();
 
-	timer4_init_sensors();
+	// sensitivity can only be configured with interrupts disabled
+	disableInterrupts();
+
+	EXTI->CR1 &= (uint8_t)~(EXTI_CR1_PDIS | EXTI_CR1_PAIS);
+	EXTI->CR1 |= (uint8_t)(EXTI_SENSITIVITY_RISE_ONLY << 6) | (uint8_t)EXTI_SENSITIVITY_RISE_ONLY;
+
+	// enable external interrupt on PAS1 (port D) and speed sensor (port A)
+	GET_PORT(PIN_PAS1)->CR2 |= GET_PIN(PIN_PAS1);
+	GET_PORT(PIN_SPEED_SENSOR)->CR2 |= GET_PIN(PIN_SPEED_SENSOR);
+
+	enableInterrupts();
 }
 
 void sensors_process()
 {
+	process_timeouts();
+	sensors_core_process();
 	torque_sensor_process();
 }
 
-
-void pas_set_stop_delay(uint16_t delay_ms)
+// Only the PAS and speed sensor port interrupts are masked, motor control
+// interrupts must not be delayed. Port interrupts are not latched while
+// masked, sections are kept to a few instructions to not miss edges.
+void sensors_disable_interrupts()
 {
-	pas_stop_delay_periods = delay_ms * 10;
-}
-
-uint16_t pas_get_cadence_rpm_x10()
-{
-	uint16_t tmp;
-	TIM4->IER &= ~TIM4_IT_UPDATE; // disable timer4 interrupt
-	tmp = pas_period_length;
-	TIM4->IER |= TIM4_IT_UPDATE;
-
-	if (tmp > 0)
-	{
-		return (uint16_t)((6000000ul / PAS_SENSOR_NUM_SIGNALS) / tmp);
-	}
-	else
+	if (sensors_interrupts_disabled++ == 0)
 	{
-		return 0;
+		GET_PORT(PIN_PAS1)->CR2 &= (uint8_t)~GET_PIN(PIN_PAS1);
+		GET_PORT(PIN_SPEED_SENSOR)->CR2 &= (uint8_t)~GET_PIN(PIN_SPEED_SENSOR);
 	}
 }
 
-uint16_t pas_get_pulse_counter()
-{
-	uint16_t tmp;
-	TIM4->IER &= ~TIM4_IT_UPDATE; // disable timer4 interrupts
-	tmp = pas_pulse_counter;
-	TIM4->IER |= TIM4_IT_UPDATE;
-
-	return tmp;
-}
-
-bool pas_is_pedaling_forwards()
-{
-	uint16_t period_length;
-	uint8_t direction_backward;
-	TIM4->IER &= ~TIM4_IT_UPDATE; // disable timer4 interrupts
-	period_length = pas_period_length;
-	direction_backward = pas_direction_backward;
-	TIM4->IER |= TIM4_IT_UPDATE;
-
-	// atomic read operation, no need to disable timer interrupt
-	return period_length > 0 && !direction_backward;
-}
-
-bool pas_is_pedaling_backwards()
-{
-	uint16_t period_length;
-	uint8_t direction_backward;
-	TIM4->IER &= ~TIM4_IT_UPDATE; // disable timer4 interrupts
-	period_length = pas_period_length;
-	direction_backward = pas_direction_backward;
-	TIM4->IER |= TIM4_IT_UPDATE;
-
-	return (period_length > 0) && direction_backward;
-}
-
-void speed_sensor_set_signals_per_rpm(uint8_t num_signals)
-{
-	speed_ticks_per_rpm = num_signals;
-}
-
-bool speed_sensor_is_moving()
-{
-	uint16_t tmp;
-	TIM4->IER &= ~TIM4_IT_UPDATE; // disable timer4 interrupts
-	tmp = speed_ticks_period_length;
-	TIM4->IER |= TIM4_IT_UPDATE;
-
-	return tmp > 0;
-}
-
-uint16_t speed_sensor_get_rpm_x10()
+void sensors_enable_interrupts()
 {
-	uint16_t tmp;
-	TIM4->IER &= ~TIM4_IT_UPDATE; // disable timer4 interrupts
-	tmp = speed_ticks_period_length;
-	TIM4->IER |= TIM4_IT_UPDATE;
-
-	if (tmp > 0)
+	if (--sensors_interrupts_disabled == 0)
 	{
-		return 6000000ul / tmp / speed_ticks_per_rpm;
+		GET_PORT(PIN_PAS1)->CR2 |= GET_PIN(PIN_PAS1);
+		GET_PORT(PIN_SPEED_SENSOR)->CR2 |= GET_PIN(PIN_SPEED_SENSOR);
 	}
-
-	return 0;
 }
 
 
@@ -185,95 +110,44 @@ bool shift_sensor_is_activated()
 }
 
 
-void isr_timer4_ovf(void) __interrupt(ITC_IRQ_TIM4_OVF)
+static void process_timeouts()
 {
-	// clear interrupt bit
-	TIM4->SR1 &= (uint8_t)(~TIM4_IT_UPDATE);
+	uint32_t pas_last_us, speed_last_us;
+
+	sensors_disable_interrupts();
+	pas_last_us = pas_last_edge_us;
+	speed_last_us = speed_last_edge_us;
+	sensors_enable_interrupts();
+
+	// Time is taken after the edge snapshot so that elapsed is never negative.
+	// An edge arriving after the snapshot can only make elapsed too long, which
+	// matters only when already close to timeout where the edge would have been
+	// the first after stop anyway.
+	uint32_t now = system_us();
+
+	sensors_core_pas_idle(now - pas_last_us);
+	sensors_core_speed_idle(now - speed_last_us);
+}
 
-	// Pas
+
+void isr_port_d(void) __interrupt(ITC_IRQ_PORTD)
+{
+	uint32_t now = system_us();
+
+	// Rising edge on PAS1 (only pin with interrupt enabled on port D)
+	if (sensors_core_pas_edge(GET_PIN_INPUT_STATE(PIN_PAS2), now - pas_last_edge_us))
 	{
-		bool pas1 = GET_PIN_INPUT_STATE(PIN_PAS1);
-		bool pas2 = GET_PIN_INPUT_STATE(PIN_PAS2);
-
-		if (pas1 && !pas_prev1 /* && pas_period_counter > PAS_SENSOR_MIN_PULSE_MS_X10 */)
-		{
-			pas_pulse_counter++;
-
-			if (pas_direction_backward != pas2)
-			{
-				pas_direction_backward = pas2;
-
-				// Reset pas pulse counter if pedal direction is changed,
-				// this variable counts the number of pulses since start of pedaling session.
-				pas_pulse_counter = 0;
-			}
-
-			if (pas_period_counter > 0)
-			{
-				if (pas_period_counter <= pas_stop_delay_periods)
-				{
-					pas_period_length = pas_period_counter; // save in order to be able to calculate rpm when needed
-				}
-				else
-				{
-					pas_period_length = 0;
-				}
-
-				pas_period_counter = 0;
-			}
-		}
-		else
-		{
-			// Do not allow wraparound or computed pedaling cadence will wrong after pedals has been still.
-			if (pas_period_counter < 65535)
-			{
-				pas_period_counter++;
-			}
-
-			if (pas_period_length > 0 && pas_period_counter > pas_stop_delay_periods)
-			{
-				pas_period_length = 0;
-				pas_pulse_counter = 0;
-				pas_direction_backward = false;
-			}
-		}
-
-		pas_prev1 = pas1;
-		pas_prev2 = pas2;
+		pas_last_edge_us = now;
 	}
+}
 
+void isr_port_a(void) __interrupt(ITC_IRQ_PORTA)
+{
+	uint32_t now = system_us();
 
-	// Speed sensor
+	// Rising edge on speed sensor (only pin with interrupt enabled on port A)
+	if (sensors_core_speed_edge(now - speed_last_edge_us))
 	{
-		bool spd = GET_PIN_INPUT_STATE(PIN_SPEED_SENSOR);
-
-		if (spd && !speed_prev_state && speed_period_counter > SPEED_SENSOR_MIN_PULSE_MS_X10)
-		{
-			if (speed_period_counter <= SPEED_SENSOR_TIMEOUT_MS_X10)
-			{
-				speed_ticks_period_length = speed_period_counter;
-			}
-			else
-			{
-				speed_ticks_period_length = 0;
-			}
-
-			speed_period_counter = 0;
-		}
-		else
-		{
-			// Do not allow wraparound or computed speed will wrong after bike has been still.
-			if (speed_period_counter < 65535)
-			{
-				speed_period_counter++;
-			}
-
-			if (speed_ticks_period_length > 0 && speed_period_counter > SPEED_SENSOR_TIMEOUT_MS_X10)
-			{
-				speed_ticks_period_length = 0;
-			}
-		}
-
-		speed_prev_state = spd;
+		speed_last_edge_us = now;
 	}
 }
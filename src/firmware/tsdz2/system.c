@@ -44,6 +44,31 @@ uint32_t system_ms()
 	return val;
 }
 
+uint32_t system_us()
+{
+	uint32_t ms;
+	uint16_t cnt;
+	uint8_t ier = TIM3->IER;
+
+	TIM3->IER &= ~(TIM3_IT_UPDATE); // disable timer3 interrupt
+	ms = _ms;
+
+	// high byte must be read first, low byte is latched
+	cnt = (uint16_t)TIM3->CNTRH << 8;
+	cnt |= TIM3->CNTRL;
+
+	// overflow not yet handled by interrupt
+	if ((TIM3->SR1 & TIM3_IT_UPDATE) && cnt < 8000)
+	{
+		ms++;
+	}
+
+	TIM3->IER = ier;
+
+	// timer3 counts at 16MHz and reloads every 1ms
+	return ms * 1000 + (cnt >> 4);
+}
+
 void system_delay_ms(uint16_t ms)
 {
 	if (!ms)
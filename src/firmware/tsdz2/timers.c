@@ -13,12 +13,10 @@
 #include "tsdz2/stm8s/stm8s_tim1.h"
 #include "tsdz2/stm8s/stm8s_tim2.h"
 #include "tsdz2/stm8s/stm8s_tim3.h"
-#include "tsdz2/stm8s/stm8s_tim4.h"
 
 #define TIM1_AUTO_RELOAD_PERIOD			511
 #define TIM2_AUTO_RELOAD_PERIOD			159		// 20us
 #define TIM3_AUTO_RELOAD_PERIOD			15999	// 1ms
-#define TIM4_AUTO_RELOAD_PERIOD			99		// 100us
 
 
 void timers_init()
@@ -110,11 +108,10 @@ void timer1_init_motor_pwm()
 
 	TIM1->OISR &= (uint8_t)(~TIM1_OISR_OIS4);
 
-	// timming for interrupt firing (hand adjusted)
-	const uint16_t Timing = 285;
-
-	TIM1->CCR4H = (uint8_t)(Timing >> 8);
-	TIM1->CCR4L = (uint8_t)Timing;
+	// timing for interrupt firing is set from motor.c
+	// since it depends on adc scan order and duty cycle
+	TIM1->CCR4H = 0;
+	TIM1->CCR4L = 0;
 
 	// hardware needs a dead time of 1us
 	//	16, // DTG = 0; dead time in 62.5 ns steps; 1us/62.5ns = 16
@@ -183,25 +180,3 @@ void timer3_init_system()
 	// TIM3 enable
 	TIM3->CR1 |= TIM3_CR1_CEN;
 }
-
-void timer4_init_sensors()
-{
-	// enable timer4 clock source
-	CLK->PCKENR1 |= CLK_PCKENR1_TIM4;
-
-	// set period
-	TIM4->PSCR = TIM4_PRESCALER_16;
-	TIM4->ARR = TIM4_AUTO_RELOAD_PERIOD;
-
-	// clear counter
-	TIM4->CNTR = 0;
-
-	// enable TIM4 interrupt
-	TIM4->IER |= TIM4_IT_UPDATE;
-
-	// clear interrupt pending bit
-	TIM4->SR1 &= ~TIM4_IT_UPDATE;
-
-	// TIM4 enable
-	TIM4->CR1 |= TIM4_CR1_CEN;
-}
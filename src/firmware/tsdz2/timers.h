@@ -13,6 +13,5 @@
 void timer1_init_motor_pwm();
 void timer2_init_torque_sensor_pwm();
 void timer3_init_system();
-void timer4_init_sensors();
 
 #endif
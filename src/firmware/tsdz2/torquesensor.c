@@ -11,6 +11,8 @@
 #include "adc.h"
 #include "util.h"
 #include "eventlog.h"
+#include "cfgstore.h"
+#include "fwconfig.h"
 #include "tsdz2/stm8.h"
 #include "tsdz2/pins.h"
 #include "tsdz2/stm8s/stm8s_adc1.h"
@@ -20,23 +22,25 @@
 #define AUTO_BIAS_START_TIME_MS		2000
 #define AUTO_BIAS_DURATION_MS		3000
 
-// Hard coded default torque sensor calibration table for now
+// Bias is tracked in background when pedals and wheel has been still
+// for a full window. Window is rejected if readings are not stable,
+// or if bias would increase more than allowed (e.g. foot resting on pedal).
+// A decrease is always accepted since startup bias is the max reading.
+#define BIAS_TRACK_WINDOW_MS			4000
+#define BIAS_TRACK_MAX_SPREAD_STEPS		6
+#define BIAS_TRACK_MAX_INCREASE_STEPS	15
+
+// Default torque sensor calibration table, used until calibrated.
 //
 // Torque sensor readings on different TSDZ2 differs by a lot.
-// This table is therefore not perfect for every motor but
-// it will have to be good enough for now.
-//
-// Default firmware has no way to calibrate, no idea if calibrations
-// is done at factory though.
-//
-// Consider adding manual calibration though config tool at some point.
-// Until then, sensitivity can be set using torque amplification factor,
-// which works well enough even if response will potentially not be linear.
+// This table is therefore not perfect for every motor, calibration
+// can be done from the config tool by placing known weights on the pedal.
+// Calibrated table is stored in pstate.
 
-#define TORQUE_SENSOR_LUT_SIZE 8
+#define DEFAULT_TORQUE_SENSOR_LUT_SIZE 8
 
 typedef struct { uint8_t adc; uint16_t nm_x100; } torque_lut_t;
-static const torque_lut_t torque_sensor_lut[TORQUE_SENSOR_LUT_SIZE] =
+static const torque_lut_t default_torque_sensor_lut[DEFAULT_TORQUE_SENSOR_LUT_SIZE] =
 {
 	// (adc value - bias), (Nm x 100) 
 	{ 0,   0     },	// 0kg
@@ -49,41 +53,230 @@ static const torque_lut_t torque_sensor_lut[TORQUE_SENSOR_LUT_SIZE] =
 	{ 224, 17511 }	// 105kg
 };
 
+// active calibration table, adc steps above bias
+static uint8_t lut_size;
+static uint16_t lut_adc[TORQUE_CALIBRATION_POINTS];
+static uint16_t lut_nm_x100[TORQUE_CALIBRATION_POINTS];
+
+static uint16_t torque_nm_x100 = 0;
+
+static bool adc_bias_set = false;
+static uint16_t adc_bias_steps = 0;
+
+static uint32_t bias_track_start_ms = 0;
+static uint16_t bias_track_min = 0;
+static uint16_t bias_track_max = 0;
+
+// slow filtered reading used when recording calibration points
+static uint16_t adc_filtered_x16 = 0;
+
+// mean torque of each completed pas pulse, newest at pulse_torque_idx
+static uint16_t pulse_torque_nm_x100[PAS_PULSES_REVOLUTION];
+static uint8_t pulse_torque_idx = 0;
+static uint8_t pulse_torque_count = 0;
+
+// accumulated samples of pas pulse in progress
+static uint16_t last_pas_pulse_counter = 0;
+static uint32_t pulse_sum_nm_x100 = 0;
+static uint16_t pulse_samples = 0;
+
+static uint16_t torque_revolution_nm_x100 = 0;
+static uint16_t torque_half_revolution_nm_x100 = 0;
+static uint16_t torque_revolution_peak_nm_x100 = 0;
+
+
+static void load_lut()
+{
+	if (g_pstate.torque_calibration_points >= 2 &&
+		g_pstate.torque_calibration_points <= TORQUE_CALIBRATION_POINTS)
+	{
+		lut_size = g_pstate.torque_calibration_points;
+		for (uint8_t i = 0; i < lut_size; ++i)
+		{
+			lut_adc[i] = g_pstate.torque_calibration_adc[i];
+			lut_nm_x100[i] = g_pstate.torque_calibration_nm_x100[i];
+		}
+	}
+	else
+	{
+		lut_size = DEFAULT_TORQUE_SENSOR_LUT_SIZE;
+		for (uint8_t i = 0; i < lut_size; ++i)
+		{
+			lut_adc[i] = default_torque_sensor_lut[i].adc;
+			lut_nm_x100[i] = default_torque_sensor_lut[i].nm_x100;
+		}
+	}
+}
+
 static uint16_t torque_adc_to_nm_x100(uint16_t torque_adc)
 {
 	// interpolate in lookup table
 
-	if (torque_adc < torque_sensor_lut[0].adc)
+	if (torque_adc < lut_adc[0])
 	{
 		// use minimum value
-		return torque_sensor_lut[0].nm_x100;
+		return lut_nm_x100[0];
 	}
-	else if (torque_adc > torque_sensor_lut[TORQUE_SENSOR_LUT_SIZE - 1].adc)
+	else if (torque_adc > lut_adc[lut_size - 1])
 	{
 		// use maximum value
-		return torque_sensor_lut[TORQUE_SENSOR_LUT_SIZE - 1].nm_x100;
+		return lut_nm_x100[lut_size - 1];
 	}
 
 	uint8_t i = 0;
-	for (i = 0; i < TORQUE_SENSOR_LUT_SIZE - 1; i++)
+	for (i = 0; i < lut_size - 1; i++)
 	{
-		if (torque_sensor_lut[i + 1].adc > torque_adc)
+		if (lut_adc[i + 1] > torque_adc)
 		{
 			break;
 		}
 	}
 
+	if (i == lut_size - 1)
+	{
+		// exactly at last point
+		return lut_nm_x100[i];
+	}
+
 	return (uint16_t)MAP32(torque_adc,
-		torque_sensor_lut[i].adc,
-		torque_sensor_lut[i + 1].adc,
-		torque_sensor_lut[i].nm_x100,
-		torque_sensor_lut[i + 1].nm_x100);
+		lut_adc[i],
+		lut_adc[i + 1],
+		lut_nm_x100[i],
+		lut_nm_x100[i + 1]);
 }
 
-static uint16_t torque_nm_x100 = 0;
 
-static bool adc_bias_set = false;
-static uint16_t adc_bias_steps = 0;
+static void process_pulse_average()
+{
+	uint16_t pulse_counter = pas_get_pulse_counter();
+
+	if (!pas_is_pedaling_forwards())
+	{
+		pulse_torque_count = 0;
+		pulse_sum_nm_x100 = 0;
+		pulse_samples = 0;
+		last_pas_pulse_counter = pulse_counter;
+
+		torque_revolution_nm_x100 = torque_nm_x100;
+		torque_half_revolution_nm_x100 = torque_nm_x100;
+		torque_revolution_peak_nm_x100 = torque_nm_x100;
+		return;
+	}
+
+	if (pulse_counter != last_pas_pulse_counter)
+	{
+		last_pas_pulse_counter = pulse_counter;
+
+		if (pulse_samples > 0)
+		{
+			pulse_torque_idx = (pulse_torque_idx + 1) % PAS_PULSES_REVOLUTION;
+			pulse_torque_nm_x100[pulse_torque_idx] = (uint16_t)(pulse_sum_nm_x100 / pulse_samples);
+
+			if (pulse_torque_count < PAS_PULSES_REVOLUTION)
+			{
+				pulse_torque_count++;
+			}
+		}
+
+		pulse_sum_nm_x100 = 0;
+		pulse_samples = 0;
+	}
+
+	// very slow pedaling, keep mean of pulse in progress without overflow
+	if (pulse_samples == 0xffff)
+	{
+		pulse_sum_nm_x100 /= 2;
+		pulse_samples /= 2;
+	}
+
+	pulse_sum_nm_x100 += torque_nm_x100;
+	pulse_samples++;
+
+	// pulse in progress is included in window to bound latency at low cadence
+	uint16_t current = (uint16_t)(pulse_sum_nm_x100 / pulse_samples);
+	uint32_t revolution_sum = current;
+	uint32_t half_revolution_sum = current;
+	uint16_t peak = current;
+	uint8_t revolution_n = 1;
+	uint8_t half_revolution_n = 1;
+
+	uint8_t idx = pulse_torque_idx;
+	for (uint8_t i = 0; i < pulse_torque_count && i < PAS_PULSES_REVOLUTION - 1; ++i)
+	{
+		uint16_t value = pulse_torque_nm_x100[idx];
+
+		revolution_sum += value;
+		revolution_n++;
+
+		if (i < (PAS_PULSES_REVOLUTION / 2) - 1)
+		{
+			half_revolution_sum += value;
+			half_revolution_n++;
+		}
+
+		if (value > peak)
+		{
+			peak = value;
+		}
+
+		idx = idx > 0 ? idx - 1 : PAS_PULSES_REVOLUTION - 1;
+	}
+
+	torque_revolution_nm_x100 = (uint16_t)(revolution_sum / revolution_n);
+	torque_half_revolution_nm_x100 = (uint16_t)(half_revolution_sum / half_revolution_n);
+	torque_revolution_peak_nm_x100 = peak;
+}
+
+
+static void process_bias_tracking(uint16_t adc_val)
+{
+	uint32_t now = system_ms();
+
+	if (pas_is_pedaling_forwards() || pas_is_pedaling_backwards() || speed_sensor_is_moving())
+	{
+		bias_track_start_ms = 0;
+		return;
+	}
+
+	if (bias_track_start_ms == 0)
+	{
+		bias_track_start_ms = now;
+		bias_track_min = adc_val;
+		bias_track_max = adc_val;
+		return;
+	}
+
+	if (adc_val < bias_track_min)
+	{
+		bias_track_min = adc_val;
+	}
+	if (adc_val > bias_track_max)
+	{
+		bias_track_max = adc_val;
+	}
+
+	if (bias_track_max - bias_track_min > BIAS_TRACK_MAX_SPREAD_STEPS)
+	{
+		// unstable, pedal is probably touched, restart window
+		bias_track_start_ms = 0;
+		return;
+	}
+
+	if (now - bias_track_start_ms < BIAS_TRACK_WINDOW_MS)
+	{
+		return;
+	}
+
+	// use max reading in window as bias, same as at startup
+	if (bias_track_max != adc_bias_steps &&
+		bias_track_max <= adc_bias_steps + BIAS_TRACK_MAX_INCREASE_STEPS)
+	{
+		eventlog_write_data(EVT_DATA_TORQUE_BIAS_DRIFT, (int16_t)bias_track_max - (int16_t)adc_bias_steps);
+		adc_bias_steps = bias_track_max;
+	}
+
+	bias_track_start_ms = 0;
+}
 
 
 void torque_sensor_init()
@@ -92,6 +285,8 @@ void torque_sensor_init()
 
 	timer2_init_torque_sensor_pwm();
 
+	load_lut();
+
 	// some delay for torque sensor to power on
 	system_delay_ms(50);
 }
@@ -101,6 +296,9 @@ void torque_sensor_process()
 	if (adc_bias_set)
 	{
 		uint16_t adc_val = adc_get_torque();
+		eventlog_trace(TRACE_TORQUE_ADC, adc_val);
+		process_bias_tracking(adc_val);
+
 		if (adc_val > adc_bias_steps)
 		{
 			adc_val -= adc_bias_steps;
@@ -110,9 +308,10 @@ void torque_sensor_process()
 			adc_val = 0;
 		}
 
-		// IDEA: Find max over pedal revolution period and use sin average (0.637)?
-		// Doesn't seem to be needed, hw filtering seems to be very slow and should average just fine
+		adc_filtered_x16 += ((int16_t)(adc_val << 4) - (int16_t)adc_filtered_x16) / 16;
+
 		torque_nm_x100 = torque_adc_to_nm_x100(adc_val);
+		process_pulse_average();
 	}
 	else
 	{
@@ -143,7 +342,55 @@ uint16_t torque_sensor_get_nm_x100()
 	return torque_nm_x100;
 }
 
+uint16_t torque_sensor_get_revolution_nm_x100()
+{
+	return torque_revolution_nm_x100;
+}
+
+uint16_t torque_sensor_get_half_revolution_nm_x100()
+{
+	return torque_half_revolution_nm_x100;
+}
+
+uint16_t torque_sensor_get_revolution_peak_nm_x100()
+{
+	return torque_revolution_peak_nm_x100;
+}
+
 bool torque_sensor_ok()
 {
 	return !adc_bias_set || adc_bias_steps > 50;
 }
+
+bool torque_sensor_calibrate(uint8_t index, uint16_t nm_x100)
+{
+	if (index == TORQUE_CALIBRATION_RESET)
+	{
+		g_pstate.torque_calibration_points = 0;
+		load_lut();
+		return true;
+	}
+
+	// points are recorded in order, recording index 0 starts a new calibration
+	if (!adc_bias_set || index >= TORQUE_CALIBRATION_POINTS || index > g_pstate.torque_calibration_points)
+	{
+		return false;
+	}
+
+	uint16_t adc = adc_filtered_x16 >> 4;
+	if (index > 0 &&
+		(adc <= g_pstate.torque_calibration_adc[index - 1] ||
+		nm_x100 <= g_pstate.torque_calibration_nm_x100[index - 1]))
+	{
+		return false;
+	}
+
+	g_pstate.torque_calibration_adc[index] = adc;
+	g_pstate.torque_calibration_nm_x100[index] = nm_x100;
+	g_pstate.torque_calibration_points = index + 1;
+
+	load_lut();
+	eventlog_write_data(EVT_DATA_TORQUE_CALIBRATION, ((int16_t)index << 12) | adc);
+
+	return true;
+}
@@ -44,11 +44,18 @@ namespace BBSFW.Model
 		private const int OPCODE_READ_FW_VERSION =		0x01;
 		private const int OPCODE_READ_EVTLOG_ENABLE =	0x02;
 		private const int OPCODE_READ_CONFIG =			0x03;
+		private const int OPCODE_READ_STATUS =			0x04;
+		private const int OPCODE_READ_HALL_CALIBRATION = 0x05;
+		private const int OPCODE_READ_TRIP =			0x06;
 
 		private const int OPCODE_WRITE_EVTLOG_ENABLE =	0xf0;
 		private const int OPCODE_WRITE_CONFIG =			0xf1;
 		private const int OPCODE_WRITE_RESET_CONFIG =	0xf2;
 		private const int OPCODE_WRITE_ADC_VOLTAGE_CALIBRATION = 0xf3;
+		private const int OPCODE_WRITE_START_HALL_CALIBRATION = 0xf4;
+		private const int OPCODE_WRITE_TORQUE_CALIBRATION = 0xf7;
+
+		public const int TorqueCalibrationReset = 0xff;
 
 		private const int Keep = 0;
 		private const int Discard = -1;
@@ -63,9 +70,14 @@ namespace BBSFW.Model
 
 
 		private CompletionQueue<Configuration> _readConfigCq = new CompletionQueue<Configuration>();
+		private CompletionQueue<ControllerStatus> _readStatusCq = new CompletionQueue<ControllerStatus>();
+		private CompletionQueue<TripData> _readTripCq = new CompletionQueue<TripData>();
+		private CompletionQueue<HallCalibration> _readHallCalibrationCq = new CompletionQueue<HallCalibration>();
 		private CompletionQueue<bool> _writeConfigCq = new CompletionQueue<bool>();
 		private CompletionQueue<bool> _writeResetConfigCq = new CompletionQueue<bool>();
 		private CompletionQueue<bool> _writeVoltageCalibrationCq = new CompletionQueue<bool>();
+		private CompletionQueue<bool> _writeTorqueCalibrationCq = new CompletionQueue<bool>();
+		private CompletionQueue<bool> _writeStartHallCalibrationCq = new CompletionQueue<bool>();
 
 
 		private int ConfigVersion = 0;
@@ -168,6 +180,24 @@ namespace BBSFW.Model
 			return await _readConfigCq.WaitResponse(timeout);
 		}
 
+		public async Task<RequestResult<ControllerStatus>> ReadStatus(TimeSpan timeout)
+		{
+			SendReadRequest(OPCODE_READ_STATUS);
+			return await _readStatusCq.WaitResponse(timeout);
+		}
+
+		public async Task<RequestResult<TripData>> ReadTrip(TimeSpan timeout)
+		{
+			SendReadRequest(OPCODE_READ_TRIP);
+			return await _readTripCq.WaitResponse(timeout);
+		}
+
+		public async Task<RequestResult<HallCalibration>> ReadHallCalibration(TimeSpan timeout)
+		{
+			SendReadRequest(OPCODE_READ_HALL_CALIBRATION);
+			return await _readHallCalibrationCq.WaitResponse(timeout);
+		}
+
 		public async Task<RequestResult<bool>> WriteConfiguration(Configuration configuration, TimeSpan timeout)
 		{
 			SendWriteConfigRequest(configuration);
@@ -186,6 +216,19 @@ namespace BBSFW.Model
 			return await _writeVoltageCalibrationCq.WaitResponse(timeout);
 		}
 
+		public async Task<RequestResult<bool>> CalibrateTorqueSensorPoint(int index, float torqueNm, TimeSpan timeout)
+		{
+			SendWriteTorqueCalibration(index, torqueNm);
+			return await _writeTorqueCalibrationCq.WaitResponse(timeout);
+		}
+
+		// Calibration runs in background on controller, poll result with ReadHallCalibration.
+		public async Task<RequestResult<bool>> StartHallCalibration(TimeSpan timeout)
+		{
+			SendWriteStartHallCalibration();
+			return await _writeStartHallCalibrationCq.WaitResponse(timeout);
+		}
+
 
 		private void OnDataReceived(object sender, SerialDataReceivedEventArgs e)
 		{
@@ -297,6 +340,12 @@ namespace BBSFW.Model
 				return ProcessReadResponseEvtlogEnable();
 			case OPCODE_READ_CONFIG:
 				return ProcessReadResponseConfig();
+			case OPCODE_READ_STATUS:
+				return ProcessReadResponseStatus();
+			case OPCODE_READ_TRIP:
+				return ProcessReadResponseTrip();
+			case OPCODE_READ_HALL_CALIBRATION:
+				return ProcessReadResponseHallCalibration();
 			}
 
 			return -1;
@@ -411,6 +460,15 @@ namespace BBSFW.Model
 					case 5:
 						cfg.ParseFromBufferV5(_rxBuffer.Skip(4).Take(Configuration.GetByteSize(version)).ToArray());
 						break;
+					case 6:
+						cfg.ParseFromBufferV6(_rxBuffer.Skip(4).Take(Configuration.GetByteSize(version)).ToArray());
+						break;
+					case 7:
+						cfg.ParseFromBufferV7(_rxBuffer.Skip(4).Take(Configuration.GetByteSize(version)).ToArray());
+						break;
+					case 8:
+						cfg.ParseFromBufferV8(_rxBuffer.Skip(4).Take(Configuration.GetByteSize(version)).ToArray());
+						break;
 				}
 
 				_readConfigCq.Complete(cfg);
@@ -424,6 +482,90 @@ namespace BBSFW.Model
 		}
 
 
+		private int ProcessReadResponseStatus()
+		{
+			if (!IsReadResponseComplete())
+			{
+				return Keep;
+			}
+
+			var data = GetReadResponseData();
+			var status = new ControllerStatus();
+			if (data != null && status.ParseFromBuffer(data))
+			{
+				_readStatusCq.Complete(status);
+			}
+
+			return GetReadResponseSize();
+		}
+
+		private int ProcessReadResponseTrip()
+		{
+			if (!IsReadResponseComplete())
+			{
+				return Keep;
+			}
+
+			var data = GetReadResponseData();
+			var trip = new TripData();
+			if (data != null && trip.ParseFromBuffer(data))
+			{
+				_readTripCq.Complete(trip);
+			}
+
+			return GetReadResponseSize();
+		}
+
+		private int ProcessReadResponseHallCalibration()
+		{
+			const int MessageSize = 2 + HallCalibration.ByteSize + 1;
+
+			if (_rxBuffer.Count < MessageSize)
+			{
+				return Keep;
+			}
+
+			if (ComputeChecksum(_rxBuffer, MessageSize - 1) == _rxBuffer[MessageSize - 1])
+			{
+				var calibration = new HallCalibration();
+				if (calibration.ParseFromBuffer(_rxBuffer.Skip(2).Take(HallCalibration.ByteSize).ToArray()))
+				{
+					_readHallCalibrationCq.Complete(calibration);
+				}
+			}
+			else
+			{
+				System.Diagnostics.Debug.WriteLine("Hall calibration read response has mismatching checksum, discarding.");
+			}
+
+			return MessageSize;
+		}
+
+		// Read response with length field: type, opcode, length, data, checksum.
+		private int GetReadResponseSize()
+		{
+			return 3 + _rxBuffer[2] + 1;
+		}
+
+		private bool IsReadResponseComplete()
+		{
+			return _rxBuffer.Count > 2 && _rxBuffer.Count >= GetReadResponseSize();
+		}
+
+		// Data of complete read response, null if checksum mismatch.
+		private byte[] GetReadResponseData()
+		{
+			int size = GetReadResponseSize();
+			if (ComputeChecksum(_rxBuffer, size - 1) != _rxBuffer[size - 1])
+			{
+				System.Diagnostics.Debug.WriteLine("Read response has mismatching checksum, discarding.");
+				return null;
+			}
+
+			return _rxBuffer.Skip(3).Take(_rxBuffer[2]).ToArray();
+		}
+
+
 		private int ProcessWriteResponse()
 		{
 			if (_rxBuffer.Count < 2)
@@ -441,6 +583,10 @@ namespace BBSFW.Model
 					return ProcessWriteResponseResetConfig();
 				case OPCODE_WRITE_ADC_VOLTAGE_CALIBRATION:
 					return ProcessWriteResponseVoltageCalibration();
+				case OPCODE_WRITE_START_HALL_CALIBRATION:
+					return ProcessWriteResponseStartHallCalibration();
+				case OPCODE_WRITE_TORQUE_CALIBRATION:
+					return ProcessWriteResponseTorqueCalibration();
 			}
 
 			return Discard;
@@ -502,6 +648,34 @@ namespace BBSFW.Model
 			return MessageSize;
 		}
 
+		private int ProcessWriteResponseTorqueCalibration()
+		{
+			const int MessageSize = 7;
+
+			if (_rxBuffer.Count < MessageSize)
+			{
+				return Keep;
+			}
+
+			_writeTorqueCalibrationCq.Complete(_rxBuffer[3] != 0);
+
+			return MessageSize;
+		}
+
+		private int ProcessWriteResponseStartHallCalibration()
+		{
+			const int MessageSize = 4;
+
+			if (_rxBuffer.Count < MessageSize)
+			{
+				return Keep;
+			}
+
+			_writeStartHallCalibrationCq.Complete(_rxBuffer[2] != 0);
+
+			return MessageSize;
+		}
+
 		private int ProcessEventLogEntry()
 		{
 			if (_rxBuffer[0] == EVENT_LOG_ENTRY)
@@ -616,6 +790,31 @@ namespace BBSFW.Model
 			_port.Write(buf.ToArray(), 0, buf.Count);
 		}
 
+		private void SendWriteTorqueCalibration(int index, float torqueNm)
+		{
+			uint nm_x100 = (uint)Math.Round(torqueNm * 100);
+
+			var buf = new List<byte>();
+			buf.Add(REQUEST_TYPE_WRITE);
+			buf.Add(OPCODE_WRITE_TORQUE_CALIBRATION);
+			buf.Add((byte)index);
+			buf.Add((byte)(nm_x100 >> 8));
+			buf.Add((byte)nm_x100);
+			buf.Add(ComputeChecksum(buf, buf.Count));
+
+			_port.Write(buf.ToArray(), 0, buf.Count);
+		}
+
+		private void SendWriteStartHallCalibration()
+		{
+			var buf = new List<byte>();
+			buf.Add(REQUEST_TYPE_WRITE);
+			buf.Add(OPCODE_WRITE_START_HALL_CALIBRATION);
+			buf.Add(ComputeChecksum(buf, buf.Count));
+
+			_port.Write(buf.ToArray(), 0, buf.Count);
+		}
+
 		private bool SetupConnection(TimeSpan timeout)
 		{
 			var start = DateTime.Now;
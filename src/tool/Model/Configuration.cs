@@ -11,7 +11,7 @@ namespace BBSFW.Model
 	[XmlRoot("BBSFW", Namespace ="https://github.com/danielnilsson9/bbs-fw")]
 	public class Configuration
 	{
-		public const int CurrentVersion = 5;
+		public const int CurrentVersion = 8;
 		public const int MinVersion = 1;
 		public const int MaxVersion = CurrentVersion;
 
@@ -20,6 +20,11 @@ namespace BBSFW.Model
 		public const int ByteSizeV3 = 149;
 		public const int ByteSizeV4 = 152;
 		public const int ByteSizeV5 = 154;
+		public const int ByteSizeV6 = 156;
+		public const int ByteSizeV7 = 177;
+		public const int ByteSizeV8 = 179;
+
+		public const int ThrottleResponseCurvePoints = 21;
 
 		public enum Feature
 		{
@@ -43,6 +48,12 @@ namespace BBSFW.Model
 					return ByteSizeV4;
 				case 5:
 					return ByteSizeV5;
+				case 6:
+					return ByteSizeV6;
+				case 7:
+					return ByteSizeV7;
+				case 8:
+					return ByteSizeV8;
 			}
 
 			return 0;
@@ -163,6 +174,7 @@ namespace BBSFW.Model
 		public float MaxBatteryVolts;
 		public uint LowCutoffVolts;
 		public uint MaxSpeedKph;
+		public float BatteryCapacityAh;
 
 		// externals
 		public bool UseSpeedSensor;
@@ -191,6 +203,8 @@ namespace BBSFW.Model
 		public uint ThrottleStartPercent;
 		public ThrottleGlobalSpeedLimitOptions ThrottleGlobalSpeedLimit;
 		public uint ThrottleGlobalSpeedLimitPercent;
+		public uint ThrottleDeadbandMillivolts;
+		public uint ThrottleFilterCutoffHz;
 
 		// shift interrupt options
 		public uint ShiftInterruptDuration;
@@ -206,6 +220,9 @@ namespace BBSFW.Model
 		public AssistLevel[] StandardAssistLevels = new AssistLevel[10];
 		public AssistLevel[] SportAssistLevels = new AssistLevel[10];
 
+		// throttle response curve, current percent at 0%, 5%, ..., 100% throttle
+		public uint[] ThrottleResponseCurve = new uint[ThrottleResponseCurvePoints];
+
 		public Configuration() : this(BbsfwConnection.Controller.Unknown)
 		{ }
 
@@ -218,6 +235,7 @@ namespace BBSFW.Model
 			CurrentRampAmpsSecond = 0;
 			MaxBatteryVolts = 0;
 			LowCutoffVolts = 0;
+			BatteryCapacityAh = 0;
 
 			UseSpeedSensor = false;
 			UseShiftSensor = false;
@@ -242,6 +260,8 @@ namespace BBSFW.Model
 			ThrottleStartPercent = 0;
 			ThrottleGlobalSpeedLimit = ThrottleGlobalSpeedLimitOptions.Disabled;
 			ThrottleGlobalSpeedLimitPercent = 0;
+			ThrottleDeadbandMillivolts = 0;
+			ThrottleFilterCutoffHz = 0;
 
 			ShiftInterruptDuration = 0;
 			ShiftInterruptCurrentThresholdPercent = 0;
@@ -260,6 +280,25 @@ namespace BBSFW.Model
 			{
 				SportAssistLevels[i] = new AssistLevel();
 			}
+
+			SetDefaultThrottleResponseCurve();
+		}
+
+		public void SetDefaultThrottleResponseCurve()
+		{
+			// same as default curve in firmware, y = pow(x / 100.0, 1.5) * 100.0
+			for (int i = 0; i < ThrottleResponseCurve.Length; ++i)
+			{
+				double x = i / (double)(ThrottleResponseCurve.Length - 1);
+				ThrottleResponseCurve[i] = (uint)Math.Round(Math.Pow(x, 1.5) * 100.0);
+			}
+		}
+
+		public void SetDefaultThrottleFilter()
+		{
+			// same as firmware defaults
+			ThrottleDeadbandMillivolts = 50;
+			ThrottleFilterCutoffHz = 5;
 		}
 
 		public bool IsFeatureSupported(Feature feature)
@@ -339,6 +378,9 @@ namespace BBSFW.Model
 			}
 
 			// apply default settings for non existing options in version
+			SetDefaultThrottleResponseCurve();
+			SetDefaultThrottleFilter();
+			BatteryCapacityAh = 0f;
 			MaxBatteryVolts = 0f;
 			UseTemperatureSensor = TemperatureSensor.All;
 			WalkModeDataDisplay = WalkModeData.Speed;
@@ -419,6 +461,9 @@ namespace BBSFW.Model
 			}
 
 			// apply default settings for non existing options in version
+			SetDefaultThrottleResponseCurve();
+			SetDefaultThrottleFilter();
+			BatteryCapacityAh = 0f;
 			PasKeepCurrentPercent = 100;
 			PasKeepCurrentCadenceRpm = 255;
 			UseShiftSensor = true;
@@ -501,6 +546,9 @@ namespace BBSFW.Model
 			}
 
 			// apply default settings for non existing options in version
+			SetDefaultThrottleResponseCurve();
+			SetDefaultThrottleFilter();
+			BatteryCapacityAh = 0f;
 			LightsMode = LightsModeOptions.Default;
 			ThrottleGlobalSpeedLimit = ThrottleGlobalSpeedLimitOptions.Disabled;
 			ThrottleGlobalSpeedLimitPercent = 100;
@@ -579,6 +627,9 @@ namespace BBSFW.Model
 			}
 
 			// apply default settings for non existing options in version
+			SetDefaultThrottleResponseCurve();
+			SetDefaultThrottleFilter();
+			BatteryCapacityAh = 0f;
 			UsePretension = false;
 			PretensionSpeedCutoffKph = 0;
 
@@ -655,6 +706,253 @@ namespace BBSFW.Model
 				}
 			}
 
+			// apply default settings for non existing options in version
+			SetDefaultThrottleResponseCurve();
+			SetDefaultThrottleFilter();
+			BatteryCapacityAh = 0f;
+
+			return true;
+		}
+
+		public bool ParseFromBufferV6(byte[] buffer)
+		{
+			if (buffer.Length != ByteSizeV6)
+			{
+				return false;
+			}
+
+			using (var s = new MemoryStream(buffer))
+			{
+				var br = new BinaryReader(s);
+
+				UseFreedomUnits = br.ReadBoolean();
+
+				MaxCurrentAmps = br.ReadByte();
+				CurrentRampAmpsSecond = br.ReadByte();
+				MaxBatteryVolts = br.ReadUInt16() / 100f;
+				LowCutoffVolts = br.ReadByte();
+				MaxSpeedKph = br.ReadByte();
+				BatteryCapacityAh = br.ReadUInt16() / 10f;
+
+				UseSpeedSensor = br.ReadBoolean();
+				UseShiftSensor = br.ReadBoolean();
+				UsePushWalk = br.ReadBoolean();
+				UseTemperatureSensor = (TemperatureSensor)br.ReadByte();
+				LightsMode = (LightsModeOptions)br.ReadByte();
+				UsePretension = br.ReadBoolean();
+				PretensionSpeedCutoffKph = br.ReadByte();
+
+				WheelSizeInch = br.ReadUInt16() / 10f;
+				NumWheelSensorSignals = br.ReadByte();
+
+				PasStartDelayPulses = br.ReadByte();
+				PasStopDelayMilliseconds = br.ReadByte() * 10u;
+				PasKeepCurrentPercent = br.ReadByte();
+				PasKeepCurrentCadenceRpm = br.ReadByte();
+
+				ThrottleStartMillivolts = br.ReadUInt16();
+				ThrottleEndMillivolts = br.ReadUInt16();
+				ThrottleStartPercent = br.ReadByte();
+				ThrottleGlobalSpeedLimit = (ThrottleGlobalSpeedLimitOptions)br.ReadByte();
+				ThrottleGlobalSpeedLimitPercent = br.ReadByte();
+
+				ShiftInterruptDuration = br.ReadUInt16();
+				ShiftInterruptCurrentThresholdPercent = br.ReadByte();
+
+				WalkModeDataDisplay = (WalkModeData)br.ReadByte();
+
+				AssistModeSelection = (AssistModeSelect)br.ReadByte();
+				AssistStartupLevel = br.ReadByte();
+
+				for (int i = 0; i < StandardAssistLevels.Length; ++i)
+				{
+					StandardAssistLevels[i].Type = (AssistFlagsType)br.ReadByte();
+					StandardAssistLevels[i].MaxCurrentPercent = br.ReadByte();
+					StandardAssistLevels[i].MaxThrottlePercent = br.ReadByte();
+					StandardAssistLevels[i].MaxCadencePercent = br.ReadByte();
+					StandardAssistLevels[i].MaxSpeedPercent = br.ReadByte();
+					StandardAssistLevels[i].TorqueAmplificationFactor = br.ReadByte() / 10f;
+				}
+
+				for (int i = 0; i < SportAssistLevels.Length; ++i)
+				{
+					SportAssistLevels[i].Type = (AssistFlagsType)br.ReadByte();
+					SportAssistLevels[i].MaxCurrentPercent = br.ReadByte();
+					SportAssistLevels[i].MaxThrottlePercent = br.ReadByte();
+					SportAssistLevels[i].MaxCadencePercent = br.ReadByte();
+					SportAssistLevels[i].MaxSpeedPercent = br.ReadByte();
+					SportAssistLevels[i].TorqueAmplificationFactor = br.ReadByte() / 10f;
+				}
+			}
+
+			// apply default settings for non existing options in version
+			SetDefaultThrottleResponseCurve();
+			SetDefaultThrottleFilter();
+
+			return true;
+		}
+
+		public bool ParseFromBufferV7(byte[] buffer)
+		{
+			if (buffer.Length != ByteSizeV7)
+			{
+				return false;
+			}
+
+			using (var s = new MemoryStream(buffer))
+			{
+				var br = new BinaryReader(s);
+
+				UseFreedomUnits = br.ReadBoolean();
+
+				MaxCurrentAmps = br.ReadByte();
+				CurrentRampAmpsSecond = br.ReadByte();
+				MaxBatteryVolts = br.ReadUInt16() / 100f;
+				LowCutoffVolts = br.ReadByte();
+				MaxSpeedKph = br.ReadByte();
+				BatteryCapacityAh = br.ReadUInt16() / 10f;
+
+				UseSpeedSensor = br.ReadBoolean();
+				UseShiftSensor = br.ReadBoolean();
+				UsePushWalk = br.ReadBoolean();
+				UseTemperatureSensor = (TemperatureSensor)br.ReadByte();
+				LightsMode = (LightsModeOptions)br.ReadByte();
+				UsePretension = br.ReadBoolean();
+				PretensionSpeedCutoffKph = br.ReadByte();
+
+				WheelSizeInch = br.ReadUInt16() / 10f;
+				NumWheelSensorSignals = br.ReadByte();
+
+				PasStartDelayPulses = br.ReadByte();
+				PasStopDelayMilliseconds = br.ReadByte() * 10u;
+				PasKeepCurrentPercent = br.ReadByte();
+				PasKeepCurrentCadenceRpm = br.ReadByte();
+
+				ThrottleStartMillivolts = br.ReadUInt16();
+				ThrottleEndMillivolts = br.ReadUInt16();
+				ThrottleStartPercent = br.ReadByte();
+				ThrottleGlobalSpeedLimit = (ThrottleGlobalSpeedLimitOptions)br.ReadByte();
+				ThrottleGlobalSpeedLimitPercent = br.ReadByte();
+
+				ShiftInterruptDuration = br.ReadUInt16();
+				ShiftInterruptCurrentThresholdPercent = br.ReadByte();
+
+				WalkModeDataDisplay = (WalkModeData)br.ReadByte();
+
+				AssistModeSelection = (AssistModeSelect)br.ReadByte();
+				AssistStartupLevel = br.ReadByte();
+
+				for (int i = 0; i < StandardAssistLevels.Length; ++i)
+				{
+					StandardAssistLevels[i].Type = (AssistFlagsType)br.ReadByte();
+					StandardAssistLevels[i].MaxCurrentPercent = br.ReadByte();
+					StandardAssistLevels[i].MaxThrottlePercent = br.ReadByte();
+					StandardAssistLevels[i].MaxCadencePercent = br.ReadByte();
+					StandardAssistLevels[i].MaxSpeedPercent = br.ReadByte();
+					StandardAssistLevels[i].TorqueAmplificationFactor = br.ReadByte() / 10f;
+				}
+
+				for (int i = 0; i < SportAssistLevels.Length; ++i)
+				{
+					SportAssistLevels[i].Type = (AssistFlagsType)br.ReadByte();
+					SportAssistLevels[i].MaxCurrentPercent = br.ReadByte();
+					SportAssistLevels[i].MaxThrottlePercent = br.ReadByte();
+					SportAssistLevels[i].MaxCadencePercent = br.ReadByte();
+					SportAssistLevels[i].MaxSpeedPercent = br.ReadByte();
+					SportAssistLevels[i].TorqueAmplificationFactor = br.ReadByte() / 10f;
+				}
+
+				for (int i = 0; i < ThrottleResponseCurve.Length; ++i)
+				{
+					ThrottleResponseCurve[i] = br.ReadByte();
+				}
+			}
+
+			// apply default settings for non existing options in version
+			SetDefaultThrottleFilter();
+
+			return true;
+		}
+
+		public bool ParseFromBufferV8(byte[] buffer)
+		{
+			if (buffer.Length != ByteSizeV8)
+			{
+				return false;
+			}
+
+			using (var s = new MemoryStream(buffer))
+			{
+				var br = new BinaryReader(s);
+
+				UseFreedomUnits = br.ReadBoolean();
+
+				MaxCurrentAmps = br.ReadByte();
+				CurrentRampAmpsSecond = br.ReadByte();
+				MaxBatteryVolts = br.ReadUInt16() / 100f;
+				LowCutoffVolts = br.ReadByte();
+				MaxSpeedKph = br.ReadByte();
+				BatteryCapacityAh = br.ReadUInt16() / 10f;
+
+				UseSpeedSensor = br.ReadBoolean();
+				UseShiftSensor = br.ReadBoolean();
+				UsePushWalk = br.ReadBoolean();
+				UseTemperatureSensor = (TemperatureSensor)br.ReadByte();
+				LightsMode = (LightsModeOptions)br.ReadByte();
+				UsePretension = br.ReadBoolean();
+				PretensionSpeedCutoffKph = br.ReadByte();
+
+				WheelSizeInch = br.ReadUInt16() / 10f;
+				NumWheelSensorSignals = br.ReadByte();
+
+				PasStartDelayPulses = br.ReadByte();
+				PasStopDelayMilliseconds = br.ReadByte() * 10u;
+				PasKeepCurrentPercent = br.ReadByte();
+				PasKeepCurrentCadenceRpm = br.ReadByte();
+
+				ThrottleStartMillivolts = br.ReadUInt16();
+				ThrottleEndMillivolts = br.ReadUInt16();
+				ThrottleStartPercent = br.ReadByte();
+				ThrottleGlobalSpeedLimit = (ThrottleGlobalSpeedLimitOptions)br.ReadByte();
+				ThrottleGlobalSpeedLimitPercent = br.ReadByte();
+
+				ShiftInterruptDuration = br.ReadUInt16();
+				ShiftInterruptCurrentThresholdPercent = br.ReadByte();
+
+				WalkModeDataDisplay = (WalkModeData)br.ReadByte();
+
+				AssistModeSelection = (AssistModeSelect)br.ReadByte();
+				AssistStartupLevel = br.ReadByte();
+
+				for (int i = 0; i < StandardAssistLevels.Length; ++i)
+				{
+					StandardAssistLevels[i].Type = (AssistFlagsType)br.ReadByte();
+					StandardAssistLevels[i].MaxCurrentPercent = br.ReadByte();
+					StandardAssistLevels[i].MaxThrottlePercent = br.ReadByte();
+					StandardAssistLevels[i].MaxCadencePercent = br.ReadByte();
+					StandardAssistLevels[i].MaxSpeedPercent = br.ReadByte();
+					StandardAssistLevels[i].TorqueAmplificationFactor = br.ReadByte() / 10f;
+				}
+
+				for (int i = 0; i < SportAssistLevels.Length; ++i)
+				{
+					SportAssistLevels[i].Type = (AssistFlagsType)br.ReadByte();
+					SportAssistLevels[i].MaxCurrentPercent = br.ReadByte();
+					SportAssistLevels[i].MaxThrottlePercent = br.ReadByte();
+					SportAssistLevels[i].MaxCadencePercent = br.ReadByte();
+					SportAssistLevels[i].MaxSpeedPercent = br.ReadByte();
+					SportAssistLevels[i].TorqueAmplificationFactor = br.ReadByte() / 10f;
+				}
+
+				for (int i = 0; i < ThrottleResponseCurve.Length; ++i)
+				{
+					ThrottleResponseCurve[i] = br.ReadByte();
+				}
+
+				ThrottleDeadbandMillivolts = br.ReadByte();
+				ThrottleFilterCutoffHz = br.ReadByte();
+			}
+
 			return true;
 		}
 
@@ -671,6 +969,7 @@ namespace BBSFW.Model
 				bw.Write((UInt16)(MaxBatteryVolts * 100));
 				bw.Write((byte)LowCutoffVolts);
 				bw.Write((byte)MaxSpeedKph);
+				bw.Write((UInt16)Math.Round(BatteryCapacityAh * 10));
 
 				bw.Write(UseSpeedSensor);
 				bw.Write(UseShiftSensor);
@@ -722,6 +1021,14 @@ namespace BBSFW.Model
 					bw.Write((byte)Math.Round(SportAssistLevels[i].TorqueAmplificationFactor * 10));
 				}
 
+				for (int i = 0; i < ThrottleResponseCurve.Length; ++i)
+				{
+					bw.Write((byte)ThrottleResponseCurve[i]);
+				}
+
+				bw.Write((byte)ThrottleDeadbandMillivolts);
+				bw.Write((byte)ThrottleFilterCutoffHz);
+
 				return s.ToArray();
 			}
 		}
@@ -735,6 +1042,7 @@ namespace BBSFW.Model
 			CurrentRampAmpsSecond = cfg.CurrentRampAmpsSecond;
 			MaxBatteryVolts = cfg.MaxBatteryVolts;
 			LowCutoffVolts = cfg.LowCutoffVolts;
+			BatteryCapacityAh = cfg.BatteryCapacityAh;
 			UseSpeedSensor = cfg.UseSpeedSensor;
 			UseShiftSensor = cfg.UseShiftSensor;
 			UsePushWalk = cfg.UsePushWalk;
@@ -754,6 +1062,8 @@ namespace BBSFW.Model
 			ThrottleStartPercent = cfg.ThrottleStartPercent;
 			ThrottleGlobalSpeedLimit = cfg.ThrottleGlobalSpeedLimit;
 			ThrottleGlobalSpeedLimitPercent = cfg.ThrottleGlobalSpeedLimitPercent;
+			ThrottleDeadbandMillivolts = cfg.ThrottleDeadbandMillivolts;
+			ThrottleFilterCutoffHz = cfg.ThrottleFilterCutoffHz;
 			ShiftInterruptDuration = cfg.ShiftInterruptDuration;
 			ShiftInterruptCurrentThresholdPercent = cfg.ShiftInterruptCurrentThresholdPercent;
 			WalkModeDataDisplay = cfg.WalkModeDataDisplay;
@@ -779,6 +1089,11 @@ namespace BBSFW.Model
 				SportAssistLevels[i].MaxSpeedPercent = cfg.SportAssistLevels[i].MaxSpeedPercent;
 				SportAssistLevels[i].TorqueAmplificationFactor = cfg.SportAssistLevels[i].TorqueAmplificationFactor;
 			}
+
+			for (int i = 0; i < Math.Min(cfg.ThrottleResponseCurve.Length, ThrottleResponseCurve.Length); ++i)
+			{
+				ThrottleResponseCurve[i] = cfg.ThrottleResponseCurve[i];
+			}
 		}
 
 		public void ReadFromFile(string filepath)
@@ -808,6 +1123,7 @@ namespace BBSFW.Model
 			ValidateLimits(CurrentRampAmpsSecond, 1, 255, "Current Ramp (A/s)");
 			ValidateLimits((uint)MaxBatteryVolts, 1, 100, "Max Battery Voltage (V)");
 			ValidateLimits(LowCutoffVolts, 1, 100, "Low Voltage Cut Off (V)");
+			ValidateLimits((uint)BatteryCapacityAh, 0, 100, "Battery Capacity (Ah)");
 
 			ValidateLimits((uint)WheelSizeInch, 10, 40, "Wheel Size (inch)");
 			ValidateLimits(NumWheelSensorSignals, 1, 10, "Wheel Sensor Signals");
@@ -823,6 +1139,18 @@ namespace BBSFW.Model
 			ValidateLimits(ThrottleEndMillivolts, 2500, 5000, "Throttle End (mV)");
 			ValidateLimits(ThrottleStartPercent, 0, 100, "Throttle Start (%)");
 			ValidateLimits(ThrottleGlobalSpeedLimitPercent, 0, 100, "Throttle Global Speed Limit (%)");
+			ValidateLimits(ThrottleDeadbandMillivolts, 0, 250, "Throttle Deadband (mV)");
+			ValidateLimits(ThrottleFilterCutoffHz, 0, 50, "Throttle Filter Cutoff (Hz)");
+
+			if (ThrottleResponseCurve.Length != ThrottleResponseCurvePoints)
+			{
+				throw new Exception("Throttle Response Curve must have " + ThrottleResponseCurvePoints + " points.");
+			}
+
+			for (int i = 0; i < ThrottleResponseCurve.Length; ++i)
+			{
+				ValidateLimits(ThrottleResponseCurve[i], 0, 100, $"Throttle Response Curve (Point {i})");
+			}
 
 			ValidateLimits(ShiftInterruptDuration, 50, 2000, "Shift Interrupt Duration (ms)");
 			ValidateLimits(ShiftInterruptCurrentThresholdPercent, 0, 100, "Shift Interrupt Current Threshold (%)");
@@ -0,0 +1,60 @@
+using System;
+
+namespace BBSFW.Model
+{
+	// Live status read from controller, multi byte values are big endian.
+	// Fields are only ever appended by firmware, extra bytes are ignored.
+	public class ControllerStatus
+	{
+		public const int MotorComErrorCounters = 7;
+		public const int MinByteSize = 10 + 2 * MotorComErrorCounters;
+
+		public int MotorStatusFlags { get; private set; }
+		public int AppStatusCode { get; private set; }
+		public int BatteryPercent { get; private set; }
+		public float BatteryVolts { get; private set; }
+		public float BatteryAmps { get; private set; }
+
+		// target current, target speed, read status, read current,
+		// read voltage, connect, skipped bytes
+		public int[] MotorComErrors { get; private set; } = new int[MotorComErrorCounters];
+
+		// 0 if no temperature sensor
+		public int TemperatureC { get; private set; }
+		public int PredictedTemperatureC { get; private set; }
+
+
+		public bool ParseFromBuffer(byte[] buffer)
+		{
+			if (buffer.Length < MinByteSize)
+			{
+				return false;
+			}
+
+			int idx = 0;
+
+			MotorStatusFlags = ReadU16(buffer, ref idx);
+			AppStatusCode = buffer[idx++];
+			BatteryPercent = buffer[idx++];
+			BatteryVolts = ReadU16(buffer, ref idx) / 10f;
+			BatteryAmps = ReadU16(buffer, ref idx) / 10f;
+
+			for (int i = 0; i < MotorComErrorCounters; ++i)
+			{
+				MotorComErrors[i] = ReadU16(buffer, ref idx);
+			}
+
+			TemperatureC = buffer[idx++];
+			PredictedTemperatureC = buffer[idx++];
+
+			return true;
+		}
+
+		private static int ReadU16(byte[] buffer, ref int idx)
+		{
+			int value = buffer[idx] << 8 | buffer[idx + 1];
+			idx += 2;
+			return value;
+		}
+	}
+}
@@ -18,6 +18,8 @@ namespace BBSFW.Model
 		private const int EVT_MSG_PSTATE_READ_DONE =			8;
 		private const int EVT_MSG_PSTATE_WRITE_BEGIN =			9;
 		private const int EVT_MSG_PSTATE_WRITE_DONE =			10;
+		private const int EVT_MSG_HALL_CALIBRATION_STARTED =	11;
+		private const int EVT_MSG_MOTOR_RECONNECT =				12;
 
 		private const int EVT_ERROR_INIT_MOTOR =				64;
 		private const int EVT_ERROR_CHANGE_TARGET_SPEED =		65;
@@ -36,6 +38,7 @@ namespace BBSFW.Model
 		private const int EVT_ERROR_WATCHDOG_TRIGGERED =		77;
 		private const int EVT_ERROR_EXTCOM_CHECKSUM =			78;
 		private const int EVT_ERROR_EXTCOM_DISCARD =			79;
+		private const int EVT_ERROR_HALL_CALIBRATION =			80;
 
 		private const int EVT_DATA_TARGET_CURRENT =				128;
 		private const int EVT_DATA_TARGET_SPEED =				129;
@@ -58,6 +61,19 @@ namespace BBSFW.Model
 		private const int EVT_DATA_VOLTAGE_CALIBRATION =		146;
 		private const int EVT_DATA_TORQUE_ADC =					147;
 		private const int EVT_DATA_TORQUE_ADC_CALIBRATED =		148;
+		private const int EVT_DATA_HALL_CALIBRATION =			149;
+		private const int EVT_DATA_MOTOR_COM_ROUND_TRIP =		150;
+		private const int EVT_DATA_MOTOR_COM_LATENCY =		151;
+		private const int EVT_DATA_MOTOR_BAUD_RATE =			152;
+		private const int EVT_DATA_MOTOR_COM_REQUESTS_OK =		153;
+		private const int EVT_DATA_MOTOR_COM_REQUESTS_FAILED =	154;
+		private const int EVT_DATA_MOTOR_COM_LATENCY_SLOW =		155;
+		private const int EVT_DATA_BATTERY_RESISTANCE =			156;
+		private const int EVT_DATA_TEMPERATURE_PREDICTED =		157;
+		private const int EVT_DATA_CADENCE_RPM =				158;
+		private const int EVT_DATA_WHEEL_SPEED_RPM =			159;
+		private const int EVT_DATA_TORQUE_CALIBRATION =			160;
+		private const int EVT_DATA_TORQUE_BIAS_DRIFT =			161;
 
 
 		public enum LogLevel
@@ -118,6 +134,11 @@ namespace BBSFW.Model
 					return "Writing persisted stated to eeprom.";
 				case EVT_MSG_PSTATE_WRITE_DONE:
 					return "Persisted state successfully written to eeprom.";
+				case EVT_MSG_HALL_CALIBRATION_STARTED:
+					return "Hall sensor calibration started, rotating motor.";
+				case EVT_MSG_MOTOR_RECONNECT:
+					Level = LogLevel.Warning;
+					return "Lost connection to motor controller, reconnecting.";
 
 				case EVT_ERROR_INIT_MOTOR:
 					return "Failed to perform motor controller initialization.";
@@ -151,6 +172,8 @@ namespace BBSFW.Model
 					return "Message received with invalid checksum.";
 				case EVT_ERROR_EXTCOM_DISCARD:
 					return "Invalid message received on serial port, discarded.";
+				case EVT_ERROR_HALL_CALIBRATION:
+					return "Hall sensor calibration failed, check hall sensors and that motor can rotate freely.";
 
 				case EVT_DATA_TARGET_CURRENT:
 					return $"Motor target current changed to {_data}%.";
@@ -234,6 +257,33 @@ namespace BBSFW.Model
 					return $"Torque adc, value={_data}.";
 				case EVT_DATA_TORQUE_ADC_CALIBRATED:
 					return $"Torque sensor calibrated, adc_bias={_data}.";
+				case EVT_DATA_HALL_CALIBRATION:
+					return $"Hall sensor calibrated, state={_data >> 8}, angle={_data & 0xff}.";
+				case EVT_DATA_MOTOR_COM_ROUND_TRIP:
+					return $"Motor controller communication, round trip={_data}ms.";
+				case EVT_DATA_MOTOR_COM_LATENCY:
+					return $"Motor controller communication, max target current latency={_data}ms.";
+				case EVT_DATA_MOTOR_BAUD_RATE:
+					return $"Motor controller communication, baud rate={_data}.";
+				case EVT_DATA_MOTOR_COM_REQUESTS_OK:
+					return $"Motor controller communication, successful requests={_data} (10s).";
+				case EVT_DATA_MOTOR_COM_REQUESTS_FAILED:
+					Level = LogLevel.Warning;
+					return $"Motor controller communication, failed requests={_data} (10s).";
+				case EVT_DATA_MOTOR_COM_LATENCY_SLOW:
+					return $"Motor controller communication, target current changes slower than 40ms={_data} (10s).";
+				case EVT_DATA_BATTERY_RESISTANCE:
+					return $"Battery internal resistance estimate={_data}mOhm.";
+				case EVT_DATA_TEMPERATURE_PREDICTED:
+					return $"Predicted winding temperature={(sbyte)_data.Value}C.";
+				case EVT_DATA_CADENCE_RPM:
+					return $"Cadence, value={_data / 10f}rpm.";
+				case EVT_DATA_WHEEL_SPEED_RPM:
+					return $"Wheel speed, value={_data / 10f}rpm.";
+				case EVT_DATA_TORQUE_CALIBRATION:
+					return $"Torque sensor calibration point recorded, index={_data >> 12}, adc={_data & 0xfff}.";
+				case EVT_DATA_TORQUE_BIAS_DRIFT:
+					return $"Torque sensor bias updated, drift={_data} adc steps.";
 			}
 
 			if (_data.HasValue)
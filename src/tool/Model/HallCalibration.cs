@@ -0,0 +1,47 @@
+using System;
+
+namespace BBSFW.Model
+{
+	// Hall sensor calibration state and stored rotor angles read from controller (TSDZ2).
+	public class HallCalibration
+	{
+		public enum CalibrationState
+		{
+			Idle = 0,
+			Running = 1,
+			Ok = 2,
+			Failed = 3
+		}
+
+		public const int HallStates = 6;
+		public const int ByteSize = 2 + HallStates;
+
+		public CalibrationState State { get; private set; }
+
+		// false if default angles are used
+		public bool IsCalibrated { get; private set; }
+
+		// rotor angle in degrees for hall state 1 to 6
+		public float[] AnglesDegrees { get; private set; } = new float[HallStates];
+
+
+		public bool ParseFromBuffer(byte[] buffer)
+		{
+			if (buffer.Length < ByteSize)
+			{
+				return false;
+			}
+
+			State = (CalibrationState)buffer[0];
+			IsCalibrated = buffer[1] != 0;
+
+			for (int i = 0; i < HallStates; ++i)
+			{
+				// 256 steps per electrical revolution
+				AnglesDegrees[i] = buffer[2 + i] * 360f / 256f;
+			}
+
+			return true;
+		}
+	}
+}
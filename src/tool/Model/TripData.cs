@@ -0,0 +1,64 @@
+using System;
+
+namespace BBSFW.Model
+{
+	// Trip statistics read from controller, multi byte values are big endian.
+	// Fields are only ever appended by firmware, extra bytes are ignored.
+	public class TripData
+	{
+		public const int MinByteSize = 31;
+
+		public uint OdometerMeters { get; private set; }
+		public uint MotorOnSeconds { get; private set; }
+		public uint TotalChargeMah { get; private set; }
+		public float TotalEnergyWh { get; private set; }
+
+		public uint DistanceMeters { get; private set; }
+		public float EnergyWh { get; private set; }
+		public float MaxSpeedKph { get; private set; }
+		public int MaxTemperatureC { get; private set; }
+		public float ConsumptionWhKm { get; private set; }
+
+		// 0 if battery capacity is not configured
+		public int RangeKm { get; private set; }
+
+
+		public bool ParseFromBuffer(byte[] buffer)
+		{
+			if (buffer.Length < MinByteSize)
+			{
+				return false;
+			}
+
+			int idx = 0;
+
+			OdometerMeters = ReadU32(buffer, ref idx);
+			MotorOnSeconds = ReadU32(buffer, ref idx);
+			TotalChargeMah = ReadU32(buffer, ref idx);
+			TotalEnergyWh = ReadU32(buffer, ref idx) / 10f;
+
+			DistanceMeters = ReadU32(buffer, ref idx);
+			EnergyWh = ReadU32(buffer, ref idx) / 10f;
+			MaxSpeedKph = ReadU16(buffer, ref idx) / 10f;
+			MaxTemperatureC = buffer[idx++];
+			ConsumptionWhKm = ReadU16(buffer, ref idx) / 10f;
+			RangeKm = ReadU16(buffer, ref idx);
+
+			return true;
+		}
+
+		private static int ReadU16(byte[] buffer, ref int idx)
+		{
+			int value = buffer[idx] << 8 | buffer[idx + 1];
+			idx += 2;
+			return value;
+		}
+
+		private static uint ReadU32(byte[] buffer, ref int idx)
+		{
+			uint value = (uint)ReadU16(buffer, ref idx) << 16;
+			value |= (uint)ReadU16(buffer, ref idx);
+			return value;
+		}
+	}
+}
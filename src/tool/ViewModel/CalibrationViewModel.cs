@@ -1,5 +1,9 @@
+using BBSFW.Model;
 using BBSFW.ViewModel.Base;
 using System;
+using System.Globalization;
+using System.Linq;
+using System.Threading.Tasks;
 using System.Windows;
 using System.Windows.Input;
 
@@ -7,6 +11,10 @@ namespace BBSFW.ViewModel
 {
 	public class CalibrationViewModel : ObservableObject
 	{
+		private const int MaxTorqueCalibrationPoints = 8;
+		private const float StandardGravity = 9.81f;
+		private const int HallCalibrationTimeoutSeconds = 15;
+
 		private ConnectionViewModel _connectionVm;
 
 		private float _batteryStatusVolts;
@@ -38,6 +46,50 @@ namespace BBSFW.ViewModel
 		}
 
 
+		private string _torqueCalibrationWeightsKg = "0, 5, 10, 20, 40";
+		public string TorqueCalibrationWeightsKg
+		{
+			get { return _torqueCalibrationWeightsKg; }
+			set
+			{
+				if (_torqueCalibrationWeightsKg != value)
+				{
+					_torqueCalibrationWeightsKg = value;
+					OnPropertyChanged(nameof(TorqueCalibrationWeightsKg));
+				}
+			}
+		}
+
+		private uint _crankLengthMm = 170;
+		public uint CrankLengthMm
+		{
+			get { return _crankLengthMm; }
+			set
+			{
+				if (_crankLengthMm != value)
+				{
+					_crankLengthMm = value;
+					OnPropertyChanged(nameof(CrankLengthMm));
+				}
+			}
+		}
+
+
+		private string _hallCalibrationStatus = "";
+		public string HallCalibrationStatus
+		{
+			get { return _hallCalibrationStatus; }
+			set
+			{
+				if (_hallCalibrationStatus != value)
+				{
+					_hallCalibrationStatus = value;
+					OnPropertyChanged(nameof(HallCalibrationStatus));
+				}
+			}
+		}
+
+
 		public ICommand SaveVoltageCommand
 		{
 			get { return new DelegateCommand(OnSaveVoltageCalibration); }
@@ -48,6 +100,26 @@ namespace BBSFW.ViewModel
 			get { return new DelegateCommand(OnResetVoltageCalibration); }
 		}
 
+		public ICommand CalibrateTorqueCommand
+		{
+			get { return new DelegateCommand(OnCalibrateTorqueSensor); }
+		}
+
+		public ICommand ResetTorqueCommand
+		{
+			get { return new DelegateCommand(OnResetTorqueCalibration); }
+		}
+
+		public ICommand CalibrateHallSensorsCommand
+		{
+			get { return new DelegateCommand(OnCalibrateHallSensors); }
+		}
+
+		public ICommand ReadHallCalibrationCommand
+		{
+			get { return new DelegateCommand(OnReadHallCalibration); }
+		}
+
 
 		public CalibrationViewModel(ConnectionViewModel connectionVm)
 		{
@@ -113,5 +185,203 @@ namespace BBSFW.ViewModel
 			}
 		}
 
+		private bool CheckTsdz2Connected(string notSupportedMessage)
+		{
+			if (!_connectionVm.IsConnected)
+			{
+				MessageBox.Show("Not Connected!", "Error", MessageBoxButton.OK, MessageBoxImage.Error);
+				return false;
+			}
+
+			if (_connectionVm.GetConnection().ControllerType != BbsfwConnection.Controller.TSDZ2)
+			{
+				MessageBox.Show(notSupportedMessage, "Error", MessageBoxButton.OK, MessageBoxImage.Error);
+				return false;
+			}
+
+			return true;
+		}
+
+		private bool CheckTorqueCalibrationSupported()
+		{
+			return CheckTsdz2Connected("Connected controller has no torque sensor.");
+		}
+
+		private async void OnCalibrateTorqueSensor()
+		{
+			if (!CheckTorqueCalibrationSupported())
+			{
+				return;
+			}
+
+			float[] weights;
+			try
+			{
+				weights = TorqueCalibrationWeightsKg
+					.Split(new[] { ',' }, StringSplitOptions.RemoveEmptyEntries)
+					.Select((e) => float.Parse(e.Trim(), CultureInfo.InvariantCulture))
+					.ToArray();
+			}
+			catch (FormatException)
+			{
+				MessageBox.Show("Calibration weights must be a comma separated list of numbers.", "Error", MessageBoxButton.OK, MessageBoxImage.Error);
+				return;
+			}
+
+			if (weights.Length < 2 || weights.Length > MaxTorqueCalibrationPoints)
+			{
+				MessageBox.Show($"Between 2 and {MaxTorqueCalibrationPoints} calibration weights are required.", "Error", MessageBoxButton.OK, MessageBoxImage.Error);
+				return;
+			}
+
+			for (int i = 1; i < weights.Length; ++i)
+			{
+				if (weights[i] <= weights[i - 1])
+				{
+					MessageBox.Show("Calibration weights must be in increasing order.", "Error", MessageBoxButton.OK, MessageBoxImage.Error);
+					return;
+				}
+			}
+
+			if (CrankLengthMm < 100 || CrankLengthMm > 250)
+			{
+				MessageBox.Show("Crank Length must be in range [100, 250]", "Error", MessageBoxButton.OK, MessageBoxImage.Error);
+				return;
+			}
+
+			for (int i = 0; i < weights.Length; ++i)
+			{
+				var prompt = weights[i] > 0 ?
+					$"Place {weights[i]} kg on the pedal with the crank horizontal and pointing forward. Press OK when the weight is resting steady on the pedal." :
+					"Remove all weight from the pedals. Press OK when the pedals are not touched.";
+
+				if (MessageBox.Show(prompt, $"Torque Calibration ({i + 1}/{weights.Length})", MessageBoxButton.OKCancel, MessageBoxImage.Information) != MessageBoxResult.OK)
+				{
+					MessageBox.Show("Torque calibration aborted, default calibration will be used until completed.", "Aborted", MessageBoxButton.OK, MessageBoxImage.Warning);
+					return;
+				}
+
+				float torqueNm = weights[i] * StandardGravity * CrankLengthMm / 1000f;
+
+				var res = await _connectionVm.GetConnection().CalibrateTorqueSensorPoint(i, torqueNm, TimeSpan.FromSeconds(3));
+				if (res.Timeout)
+				{
+					MessageBox.Show("Failed to record torque calibration point, timeout occured.", "Error", MessageBoxButton.OK, MessageBoxImage.Error);
+					return;
+				}
+				else if (!res.Result)
+				{
+					MessageBox.Show("Failed to record torque calibration point, sensor reading must increase with weight. Check log.", "Error", MessageBoxButton.OK, MessageBoxImage.Error);
+					return;
+				}
+			}
+
+			MessageBox.Show("Torque sensor calibration saved!", "Success", MessageBoxButton.OK, MessageBoxImage.Information);
+		}
+
+		private async void OnResetTorqueCalibration()
+		{
+			if (!CheckTorqueCalibrationSupported())
+			{
+				return;
+			}
+
+			var res = await _connectionVm.GetConnection().CalibrateTorqueSensorPoint(BbsfwConnection.TorqueCalibrationReset, 0f, TimeSpan.FromSeconds(3));
+			if (!res.Timeout)
+			{
+				if (res.Result)
+				{
+					MessageBox.Show("Torque calibration reset!", "Success", MessageBoxButton.OK, MessageBoxImage.Information);
+				}
+				else
+				{
+					MessageBox.Show("Failed to reset torque calibration, check log.", "Error", MessageBoxButton.OK, MessageBoxImage.Error);
+				}
+			}
+			else
+			{
+				MessageBox.Show("Failed to reset torque calibration, timeout occured.", "Error", MessageBoxButton.OK, MessageBoxImage.Error);
+			}
+		}
+
+
+		private static string FormatHallCalibration(HallCalibration calibration)
+		{
+			var angles = String.Join(", ", calibration.AnglesDegrees.Select((e) => e.ToString("0", CultureInfo.InvariantCulture)));
+			return (calibration.IsCalibrated ? "Calibrated" : "Default") + " angles (deg): " + angles;
+		}
+
+		private async void OnReadHallCalibration()
+		{
+			if (!CheckTsdz2Connected("Hall sensor calibration is only supported on TSDZ2."))
+			{
+				return;
+			}
+
+			var res = await _connectionVm.GetConnection().ReadHallCalibration(TimeSpan.FromSeconds(3));
+			if (res.Timeout)
+			{
+				MessageBox.Show("Failed to read hall sensor calibration, timeout occured.", "Error", MessageBoxButton.OK, MessageBoxImage.Error);
+				return;
+			}
+
+			HallCalibrationStatus = FormatHallCalibration(res.Result);
+		}
+
+		private async void OnCalibrateHallSensors()
+		{
+			if (!CheckTsdz2Connected("Hall sensor calibration is only supported on TSDZ2."))
+			{
+				return;
+			}
+
+			if (MessageBox.Show("The motor will rotate slowly for a few seconds. Make sure the pedals and chain are free to move and do not touch the pedals or brake levers. Press OK to start.",
+				"Hall Sensor Calibration", MessageBoxButton.OKCancel, MessageBoxImage.Information) != MessageBoxResult.OK)
+			{
+				return;
+			}
+
+			var start = await _connectionVm.GetConnection().StartHallCalibration(TimeSpan.FromSeconds(3));
+			if (start.Timeout)
+			{
+				MessageBox.Show("Failed to start hall sensor calibration, timeout occured.", "Error", MessageBoxButton.OK, MessageBoxImage.Error);
+				return;
+			}
+			else if (!start.Result)
+			{
+				MessageBox.Show("Failed to start hall sensor calibration, motor must be stopped. Check log.", "Error", MessageBoxButton.OK, MessageBoxImage.Error);
+				return;
+			}
+
+			HallCalibrationStatus = "Calibrating...";
+
+			// runs in background on controller, poll until finished
+			var end = DateTime.Now + TimeSpan.FromSeconds(HallCalibrationTimeoutSeconds);
+			while (DateTime.Now < end)
+			{
+				await Task.Delay(500);
+
+				var res = await _connectionVm.GetConnection().ReadHallCalibration(TimeSpan.FromSeconds(3));
+				if (res.Timeout || res.Result.State == HallCalibration.CalibrationState.Running)
+				{
+					continue;
+				}
+
+				HallCalibrationStatus = FormatHallCalibration(res.Result);
+
+				if (res.Result.State == HallCalibration.CalibrationState.Ok)
+				{
+					MessageBox.Show("Hall sensor calibration saved!", "Success", MessageBoxButton.OK, MessageBoxImage.Information);
+				}
+				else
+				{
+					MessageBox.Show("Hall sensor calibration failed, previous calibration is kept. Check log.", "Error", MessageBoxButton.OK, MessageBoxImage.Error);
+				}
+				return;
+			}
+
+			HallCalibrationStatus = "";
+			MessageBox.Show("Failed to read hall sensor calibration result, timeout occured.", "Error", MessageBoxButton.OK, MessageBoxImage.Error);
+		}
 	}
 }
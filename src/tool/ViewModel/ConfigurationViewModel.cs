@@ -3,6 +3,8 @@ using BBSFW.ViewModel.Base;
 using System;
 using System.Collections.Generic;
 using System.Linq;
+using System.Windows;
+using System.Windows.Media;
 
 namespace BBSFW.ViewModel
 {
@@ -182,6 +184,19 @@ namespace BBSFW.ViewModel
 			}
 		}
 
+		public float BatteryCapacityAh
+		{
+			get { return _config.BatteryCapacityAh; }
+			set
+			{
+				if (_config.BatteryCapacityAh != value)
+				{
+					_config.BatteryCapacityAh = value;
+					OnPropertyChanged(nameof(BatteryCapacityAh));
+				}
+			}
+		}
+
 		public uint MaxSpeedKph
 		{
 			get { return _config.MaxSpeedKph; }
@@ -394,6 +409,77 @@ namespace BBSFW.ViewModel
 			}
 		}
 
+		public uint ThrottleDeadbandMillivolts
+		{
+			get { return _config.ThrottleDeadbandMillivolts; }
+			set
+			{
+				if (_config.ThrottleDeadbandMillivolts != value)
+				{
+					_config.ThrottleDeadbandMillivolts = value;
+					OnPropertyChanged(nameof(ThrottleDeadbandMillivolts));
+				}
+			}
+		}
+
+		public uint ThrottleFilterCutoffHz
+		{
+			get { return _config.ThrottleFilterCutoffHz; }
+			set
+			{
+				if (_config.ThrottleFilterCutoffHz != value)
+				{
+					_config.ThrottleFilterCutoffHz = value;
+					OnPropertyChanged(nameof(ThrottleFilterCutoffHz));
+				}
+			}
+		}
+
+		public string ThrottleResponseCurve
+		{
+			get { return string.Join(", ", _config.ThrottleResponseCurve); }
+			set
+			{
+				var parts = value.Split(new[] { ',', ' ' }, StringSplitOptions.RemoveEmptyEntries);
+				var points = new uint[parts.Length];
+
+				bool valid = parts.Length == Configuration.ThrottleResponseCurvePoints;
+				for (int i = 0; valid && i < parts.Length; ++i)
+				{
+					valid = uint.TryParse(parts[i], out points[i]);
+				}
+
+				if (!valid)
+				{
+					// revert to current curve
+					OnPropertyChanged(nameof(ThrottleResponseCurve));
+				}
+				else if (!points.SequenceEqual(_config.ThrottleResponseCurve))
+				{
+					_config.ThrottleResponseCurve = points;
+					OnPropertyChanged(nameof(ThrottleResponseCurve));
+					OnPropertyChanged(nameof(ThrottleResponseCurvePreview));
+				}
+			}
+		}
+
+		// curve scaled to 100x100 for preview, y axis inverted
+		public PointCollection ThrottleResponseCurvePreview
+		{
+			get
+			{
+				var points = new PointCollection();
+				for (int i = 0; i < _config.ThrottleResponseCurve.Length; ++i)
+				{
+					double x = i * 100.0 / (_config.ThrottleResponseCurve.Length - 1);
+					double y = 100.0 - Math.Min(_config.ThrottleResponseCurve[i], 100u);
+					points.Add(new Point(x, y));
+				}
+
+				return points;
+			}
+		}
+
 
 
 		public uint PasStartDelayDegrees